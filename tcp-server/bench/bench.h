@@ -0,0 +1,78 @@
+#ifndef ECHOSERVER_BENCH_H
+#define ECHOSERVER_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        double ns_per_op_min;
+        double ns_per_op_median;
+        double ns_per_op_mean;
+        double ops_per_sec;
+        // calls to the global operator new per operation, counted across all threads
+        double allocs_per_op;
+    };
+
+    // Number of global operator new calls so far in this process
+    uint64_t allocation_count();
+
+    // Runs every registered case `repetitions` times and keeps per-op timings.
+    // Cases whose name does not contain `filter` are skipped. Progress goes to out.
+    class Runner {
+    public:
+        explicit Runner(std::ostream &out, std::string filter = "", int repetitions = 5) :
+                out(out), filter(std::move(filter)), repetitions(repetitions) {}
+
+        // body is called with the iteration number, once per measured operation
+        void run(const std::string &name, uint64_t iterations, const std::function<void(uint64_t)> &body);
+
+        // Same as run, but body performs the whole batch itself and returns the number of operations done
+        void run_batch(const std::string &name, const std::function<uint64_t()> &body);
+
+        const std::vector<Result> &results() const { return bench_results; }
+
+        // A check on what a case measured, reported right away; bench exits non-zero if any failed
+        void expect(bool ok, const std::string &what);
+
+        bool failed() const { return failures != 0; }
+
+    private:
+        bool selected(const std::string &name) const;
+
+        void record(const std::string &name, uint64_t iterations, std::vector<double> &ns_per_op,
+                    uint64_t allocations);
+
+        std::ostream &out;
+        std::string filter;
+        int repetitions;
+        std::vector<Result> bench_results;
+        int failures = 0;
+    };
+
+    // Prevents the optimizer from dropping a computed value
+    template<typename T>
+    inline void do_not_optimize(T const &value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    void register_protocol_benchmarks(Runner &runner);
+
+    void register_worker_pool_benchmarks(Runner &runner);
+
+    void register_findb_benchmarks(Runner &runner);
+
+    void register_server_benchmarks(Runner &runner);
+
+    void register_timer_benchmarks(Runner &runner);
+
+    void register_client_benchmarks(Runner &runner);
+}
+
+#endif //ECHOSERVER_BENCH_H
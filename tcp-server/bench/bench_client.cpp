@@ -0,0 +1,85 @@
+#include <unistd.h>
+#include "bench.h"
+#include "server.h"
+#include "../client/lib/fin_client.h"
+
+// Round trips through client/lib against an in-process server: one request at a time, a
+// window of pipelined requests, and the same window sent as a single batch, also with a
+// max_in_flight smaller than the batch.
+void bench::register_client_benchmarks(Runner &runner) {
+    auto &&db_path = "/tmp/client_bench_" + std::to_string(getpid()) + ".db";
+    findb::reset(db_path);
+    auto &&console = std::cout.rdbuf(nullptr);
+    {
+        server::ServerConfig config;
+        config.port = 0;
+        config.database_path = db_path;
+        server::Server server(config);
+        server.start();
+        client::ClientConfig client_config;
+        client_config.host = "127.0.0.1";
+        client_config.port = server.port();
+        client_config.connections = 1;
+        client::FinClient fin_client(client_config);
+        const uint64_t window = 64;
+
+        // text the server would split into two frames must not shift the replies after it
+        auto &&split = fin_client.echo("one" MESSAGE_END "two").get();
+        client::Batch split_batch;
+        split_batch.echo("hello");
+        split_batch.echo("one" MESSAGE_END "two");
+        auto &&split_replies = fin_client.submit(std::move(split_batch)).get();
+        auto &&after = fin_client.echo("after").get();
+        runner.expect(!split.ok && split_replies.size() == 2 && split_replies[0].kind == client::Reply::REJECTED &&
+                      after.ok && after.value == "after", "client: text containing MESSAGE_END was sent");
+
+        runner.run("client/echo_sequential", 5000, [&](uint64_t) {
+            bench::do_not_optimize(fin_client.echo("hello").get());
+        });
+
+        runner.run_batch("client/echo_pipelined", [&]() {
+            std::vector<std::future<client::Result<std::string>>> replies;
+            for (uint64_t i = 0; i < window * 50; ++i) {
+                replies.push_back(fin_client.echo("hello"));
+                if (replies.size() == window) {
+                    for (auto &&reply : replies) bench::do_not_optimize(reply.get());
+                    replies.clear();
+                }
+            }
+            for (auto &&reply : replies) bench::do_not_optimize(reply.get());
+            return window * 50;
+        });
+
+        runner.run_batch("client/echo_batch", [&]() {
+            for (uint64_t i = 0; i < 50; ++i) {
+                client::Batch batch;
+                for (uint64_t j = 0; j < window; ++j) batch.echo("hello");
+                bench::do_not_optimize(fin_client.submit(std::move(batch)).get());
+            }
+            return window * 50;
+        });
+
+        // a batch four times max_in_flight goes out in parts on one connection, replies in order
+        client_config.max_in_flight = window / 4;
+        client::FinClient capped_client(client_config);
+        runner.run_batch("client/echo_batch_over_in_flight_cap", [&]() {
+            for (uint64_t i = 0; i < 50; ++i) {
+                client::Batch batch;
+                for (uint64_t j = 0; j < window; ++j) batch.echo(std::to_string(j));
+                auto &&replies = capped_client.submit(std::move(batch)).get();
+                auto &&in_order = replies.size() == window;
+                for (uint64_t j = 0; in_order && j < window; ++j) {
+                    in_order = replies[j].kind == client::Reply::TEXT && replies[j].body == std::to_string(j);
+                }
+                runner.expect(in_order, "client/echo_batch_over_in_flight_cap: replies lost or out of order");
+            }
+            return window * 50;
+        });
+
+        capped_client.close();
+        fin_client.close();
+        server.stop();
+    }
+    std::cout.rdbuf(console);
+    std::remove(db_path.c_str());
+}
@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bench.h"
+#include "database/findb.h"
+#include "database/ingest_journal.h"
+#include "database/history_compactor.h"
+#include "quotes/quote_table.h"
+#include "feed/quote_feed.h"
+#include "defines.h"
+#include "json/src/json.hpp"
+
+void bench::register_findb_benchmarks(Runner &runner) {
+    auto &&db_path = "/tmp/findb_bench_" + std::to_string(getpid()) + ".db";
+    findb::reset(db_path);
+    {
+        findb database(db_path);
+        const int currencies = 32;
+        for (auto &&i = 0; i < currencies; ++i) {
+            auto &&currency = "CUR" + std::to_string(i);
+            database.add_currency(currency);
+            for (auto &&j = 0; j < 20; ++j) database.add_currency_value(database.symbol(currency), 50.0 + j);
+        }
+
+        uint64_t next_currency = 0;
+        runner.run("findb/add_currency", 200, [&](uint64_t) {
+            auto &&currency = "NEW" + std::to_string(next_currency++);
+            database.add_currency(currency);
+        });
+
+        runner.run("findb/add_currency_value", 200, [&](uint64_t i) {
+            auto &&currency = "CUR" + std::to_string(i % currencies);
+            database.add_currency_value(database.symbol(currency), 60.0 + i % 7);
+        });
+
+        // what a request waits for with --journal: append and fsync, the SQLite work happens behind it
+        auto &&journal_path = db_path + ".journal";
+        {
+            IngestJournal journal(database, journal_path, 0, JOURNAL_CHECKPOINT_BYTES);
+            journal.open();
+            runner.run("findb/add_currency_value_journaled", 2000, [&](uint64_t i) {
+                auto &&currency = "CUR" + std::to_string(i % currencies);
+                journal.append(database.symbol(currency), currency, 60.0 + i % 7);
+            });
+            journal.wait_applied();
+        }
+        std::remove(journal_path.c_str());
+
+        // what every request naming a currency pays once before working on the id
+        runner.run("findb/symbol", 100000, [&](uint64_t i) {
+            bench::do_not_optimize(database.symbol("CUR" + std::to_string(i % currencies)));
+        });
+
+        runner.run("findb/currency_list", 50, [&](uint64_t) {
+            nlohmann::json json;
+            database.currency_list(json);
+            bench::do_not_optimize(json);
+        });
+
+        // what a --quote-reader server does instead of currency_list, without the json
+        auto &&segment_path = db_path + ".quotes";
+        {
+            server::quotes::QuoteTable writer, reader;
+            std::vector<FinanceChange> latest;
+            database.latest_rows(latest);
+            if (writer.open_writer(segment_path, QUOTE_TABLE_SLOTS, false) && reader.open_reader(segment_path)) {
+                writer.load(latest);
+                std::vector<server::quotes::QuoteData> quotes;
+                runner.run("quotes/read_all", 10000, [&](uint64_t) {
+                    reader.read_all(quotes);
+                    bench::do_not_optimize(quotes);
+                });
+
+                // a writer that died inside a slot leaves its sequence odd, the next one has to
+                // even it out or readers spin on the slot forever
+                auto &&descriptor = open(segment_path.c_str(), O_RDWR | O_CLOEXEC);
+                auto &&size = server::quotes::segment_size(QUOTE_TABLE_SLOTS);
+                auto &&mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+                writer.close();
+                server::quotes::segment_slots(static_cast<server::quotes::SegmentHeader *>(mapping))[0].sequence++;
+                munmap(mapping, size);
+                close(descriptor);
+                writer.open_writer(segment_path, QUOTE_TABLE_SLOTS, false);
+                writer.load(latest);
+                runner.expect(reader.read_all(quotes) && quotes.size() == latest.size(),
+                              "quotes/read_all: not every quote readable after a writer crashed mid-write");
+                // the writer comes back with a larger table, the old mapping must not be read past
+                writer.close();
+                writer.open_writer(segment_path, QUOTE_TABLE_SLOTS * 2, false);
+                runner.expect(!reader.read_all(quotes), "quotes/read_all: read a segment resized under it");
+            }
+        }
+        std::remove(segment_path.c_str());
+
+        // what the feed adds to every accepted value, under the database lock: encode, ring, one sendto
+        {
+            server::feed::QuoteFeed feed;
+            if (feed.open("239.255.77.77", FEED_PORT, "127.0.0.1", 0, FEED_RETRANSMIT_SLOTS)) {
+                FinanceChange change{FinanceChange::INSERT_ROW, 1, "CUR1", true, 61.25, 0.5, 0.25,
+                                     "2017-Dec-01 12:00:00"};
+                runner.run("feed/publish", 100000, [&](uint64_t i) {
+                    change.value = 60.0 + i % 7;
+                    feed.publish(change);
+                });
+                std::pmr::string datagrams;
+                runner.run("feed/gap_fill_max", 2000, [&](uint64_t) {
+                    uint64_t first;
+                    datagrams.clear();
+                    feed.gap_fill(1, UINT64_MAX, datagrams, first);
+                    bench::do_not_optimize(datagrams);
+                });
+            }
+        }
+
+        runner.run("findb/currency_history", 500, [&](uint64_t i) {
+            auto &&currency = "CUR" + std::to_string(i % currencies);
+            nlohmann::json json;
+            database.currency_history(database.symbol(currency), json);
+            bench::do_not_optimize(json);
+        });
+
+        runner.run("findb/del_currency", 200, [&](uint64_t) {
+            auto &&currency = "DEL" + std::to_string(next_currency++);
+            database.add_currency(currency);
+            database.del_currency(database.symbol(currency));
+        });
+    }
+    std::remove(db_path.c_str());
+
+    // retention: 16 currencies with a value every 30 seconds for 5 days, all of it past the raw tier
+    findb::reset(db_path);
+    {
+        const int currencies = 16;
+        auto &&now = static_cast<int64_t>(time(nullptr));
+        {
+            SQLite::Database db(db_path, SQLite::OPEN_READWRITE);
+            SQLite::Transaction transaction(db);
+            SQLite::Statement insert(db, "INSERT INTO finance (currency, value, inc_rel, inc_abs, date)"
+                    " VALUES (?, ?, 0, 0, ?)");
+            for (auto &&at = now - 13 * 86400; at < now - 8 * 86400; at += 30) {
+                time_t stamp = at;
+                std::stringstream date;
+                date << std::put_time(std::localtime(&stamp), "%Y-%b-%d %H:%M:%S");
+                for (auto &&i = 0; i < currencies; ++i) {
+                    insert.bind(1, "CUR" + std::to_string(i));
+                    insert.bind(2, 50.0 + at % 7);
+                    insert.bind(3, date.str());
+                    insert.exec();
+                    insert.reset();
+                }
+            }
+            transaction.commit();
+        }
+        findb database(db_path);
+        runner.run("findb/add_currency_value_backlog", 200, [&](uint64_t i) {
+            auto &&currency = "CUR" + std::to_string(i % currencies);
+            database.add_currency_value(database.symbol(currency), 60.0 + i % 7);
+        });
+        HistoryCompactor compactor(database, {{0, 7 * 86400}, {60, 90 * 86400}, {3600, 0}},
+                                   COMPACTION_BATCH_ROWS, COMPACTION_PAUSE_MS);
+        runner.run("findb/compact_batch", 40, [&](uint64_t) {
+            compactor.compact_batch(now);
+        });
+
+        // the same writer while the compactor works through the rest of the backlog
+        compactor.start();
+        runner.run("findb/add_currency_value_compacting", 200, [&](uint64_t i) {
+            auto &&currency = "CUR" + std::to_string(i % currencies);
+            database.add_currency_value(database.symbol(currency), 60.0 + i % 7);
+        });
+        compactor.stop();
+
+        // and once the history is down to minute bars
+        while (compactor.compact_batch(now)) {}
+        runner.run("findb/add_currency_value_compacted", 200, [&](uint64_t i) {
+            auto &&currency = "CUR" + std::to_string(i % currencies);
+            database.add_currency_value(database.symbol(currency), 60.0 + i % 7);
+        });
+    }
+    std::remove(db_path.c_str());
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+#include "bench.h"
+#include "json/src/json.hpp"
+
+namespace {
+    std::atomic<uint64_t> allocations{0};
+}
+
+// the replacements below pair malloc with free, which gcc cannot see through
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto &&memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+uint64_t bench::allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+bool bench::Runner::selected(const std::string &name) const {
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+void bench::Runner::record(const std::string &name, uint64_t iterations, std::vector<double> &ns_per_op,
+                           uint64_t allocations) {
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    auto &&mean = std::accumulate(ns_per_op.begin(), ns_per_op.end(), 0.0) / ns_per_op.size();
+    auto &&median = ns_per_op[ns_per_op.size() / 2];
+    auto &&allocs_per_op = static_cast<double>(allocations) / (std::max<uint64_t>(iterations, 1) * repetitions);
+    bench_results.push_back({name, iterations, ns_per_op.front(), median, mean, 1e9 / median, allocs_per_op});
+    out << std::left << std::setw(48) << name
+        << std::right << std::setw(14) << std::fixed << std::setprecision(1) << median << " ns/op"
+        << std::setw(16) << std::setprecision(0) << 1e9 / median << " op/s"
+        << std::setw(12) << std::setprecision(2) << allocs_per_op << " allocs/op" << std::endl;
+}
+
+void bench::Runner::expect(bool ok, const std::string &what) {
+    if (ok) return;
+    failures++;
+    out << "FAILED: " << what << std::endl;
+}
+
+void bench::Runner::run(const std::string &name, uint64_t iterations,
+                        const std::function<void(uint64_t)> &body) {
+    if (!selected(name)) return;
+    for (uint64_t i = 0; i < std::min<uint64_t>(iterations / 10 + 1, 1000); ++i) body(i);
+    std::vector<double> ns_per_op;
+    ns_per_op.reserve(repetitions);
+    auto &&allocations_before = allocation_count();
+    for (auto &&rep = 0; rep < repetitions; ++rep) {
+        auto &&start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) body(i);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        ns_per_op.push_back(elapsed.count() / iterations);
+    }
+    record(name, iterations, ns_per_op, allocation_count() - allocations_before);
+}
+
+void bench::Runner::run_batch(const std::string &name, const std::function<uint64_t()> &body) {
+    if (!selected(name)) return;
+    body();
+    std::vector<double> ns_per_op;
+    ns_per_op.reserve(repetitions);
+    uint64_t iterations = 0;
+    auto &&allocations_before = allocation_count();
+    for (auto &&rep = 0; rep < repetitions; ++rep) {
+        auto &&start = std::chrono::steady_clock::now();
+        iterations = body();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        ns_per_op.push_back(elapsed.count() / std::max<uint64_t>(iterations, 1));
+    }
+    record(name, iterations, ns_per_op, allocation_count() - allocations_before);
+}
+
+
+void usage() {
+    std::cout << "bench [--filter substr] [--repetitions n] [--label text] [--out results.json] [--baseline old.json]\n"
+              << "Results are written as json so runs from different commits can be compared with --baseline"
+              << std::endl;
+}
+
+void compare_with_baseline(const std::string &baseline_path, const std::vector<bench::Result> &results) {
+    std::ifstream baseline_file(baseline_path);
+    if (!baseline_file) {
+        std::cerr << "Cannot open baseline " << baseline_path << std::endl;
+        return;
+    }
+    auto &&baseline = nlohmann::json::parse(baseline_file);
+    std::unordered_map<std::string, double> old_medians;
+    for (auto &&item : baseline["benchmarks"]) {
+        old_medians[item["name"].get<std::string>()] = item["ns_per_op_median"].get<double>();
+    }
+    std::cout << "\nCompared with " << baseline_path << " (" << baseline.value("label", "") << "):" << std::endl;
+    for (auto &&result : results) {
+        auto &&old = old_medians.find(result.name);
+        if (old == old_medians.end()) continue;
+        auto &&change = (result.ns_per_op_median - old->second) / old->second * 100.0;
+        std::cout << std::left << std::setw(48) << result.name
+                  << std::right << std::showpos << std::fixed << std::setprecision(1) << std::setw(10) << change
+                  << std::noshowpos << " %" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string filter, label, out_path = "bench_results.json", baseline_path;
+    int repetitions = 5;
+    for (auto &&i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto &&has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value) filter = argv[++i];
+        else if (arg == "--repetitions" && has_value) repetitions = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--label" && has_value) label = argv[++i];
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--baseline" && has_value) baseline_path = argv[++i];
+        else {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // server benchmarks silence std::cout, progress keeps going to the console through this stream
+    std::ostream progress(std::cout.rdbuf());
+    bench::Runner runner(progress, filter, repetitions);
+    bench::register_protocol_benchmarks(runner);
+    bench::register_worker_pool_benchmarks(runner);
+    bench::register_timer_benchmarks(runner);
+    bench::register_findb_benchmarks(runner);
+    bench::register_server_benchmarks(runner);
+    bench::register_client_benchmarks(runner);
+
+    nlohmann::json output = {
+            {"label",       label},
+            {"repetitions", repetitions},
+            {"benchmarks",  nlohmann::json::array()}
+    };
+    for (auto &&result : runner.results()) {
+        output["benchmarks"].push_back({
+                                               {"name",             result.name},
+                                               {"iterations",       result.iterations},
+                                               {"ns_per_op_min",    result.ns_per_op_min},
+                                               {"ns_per_op_median", result.ns_per_op_median},
+                                               {"ns_per_op_mean",   result.ns_per_op_mean},
+                                               {"ops_per_sec",      result.ops_per_sec},
+                                               {"allocs_per_op",    result.allocs_per_op}
+                                       });
+    }
+    std::ofstream out_file(out_path);
+    out_file << output.dump(4) << std::endl;
+    std::cout << "Results written to " << out_path << std::endl;
+
+    if (!baseline_path.empty()) compare_with_baseline(baseline_path, runner.results());
+    return runner.failed() ? 1 : 0;
+}
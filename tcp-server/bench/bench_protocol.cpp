@@ -0,0 +1,141 @@
+#include <array>
+#include <memory_resource>
+#include "bench.h"
+#include "defines.h"
+#include "protocol/framing.h"
+#include "protocol/opcode_table.h"
+#include "protocol/request_parser.h"
+#include "protocol/history_encoding.h"
+#include "workers/worker_pool.h"
+#include "json/src/json.hpp"
+
+namespace {
+    const std::string add_value_request =
+            JSON_PREFIX R"({"currency":"USD","type":"ADD_CURRENCY_VALUE","value":61.25})";
+
+    void framing_benchmarks(bench::Runner &runner) {
+        const auto frame = add_value_request + MESSAGE_END;
+        std::string buffer, message;
+        runner.run("framing/extract_single_frame", 1000000, [&](uint64_t) {
+            buffer.append(frame);
+            protocol::extract_frame(buffer, message);
+            bench::do_not_optimize(message);
+        });
+
+        std::string pipelined;
+        for (auto &&i = 0; i < 16; ++i) pipelined += frame;
+        runner.run("framing/extract_16_pipelined_frames", 100000, [&](uint64_t) {
+            buffer.append(pipelined);
+            while (protocol::extract_frame(buffer, message)) bench::do_not_optimize(message);
+        });
+
+        const auto half = frame.size() / 2;
+        runner.run("framing/extract_frame_split_in_two_reads", 1000000, [&](uint64_t) {
+            buffer.append(frame, 0, half);
+            protocol::extract_frame(buffer, message);
+            buffer.append(frame, half, std::string::npos);
+            protocol::extract_frame(buffer, message);
+            bench::do_not_optimize(message);
+        });
+    }
+
+    void dispatch_benchmarks(bench::Runner &runner) {
+        const std::array<std::string, 4> messages = {
+                CMD_PREFIX + std::string(REQUEST_GET_ALL_CURRENCIES),
+                TXT_PREFIX + std::string("hello"),
+                add_value_request,
+                std::string("xyz:garbage")
+        };
+        runner.run("dispatch/message_type_mixed", 4000000, [&](uint64_t i) {
+            auto &&type = protocol::message_type(messages[i & 3]);
+            bench::do_not_optimize(type);
+        });
+
+        // same shape as the server route table
+        static constexpr auto routes = protocol::make_opcode_table<int>({
+                {REQUEST_DISCONNECT,           0},
+                {REQUEST_GET_ALL_CURRENCIES,   1},
+                {REQUEST_ADD_CURRENCY,         2},
+                {REQUEST_ADD_CURRENCY_VALUE,   3},
+                {REQUEST_DEL_CURRENCY,         4},
+                {REQUEST_GET_CURRENCY_HISTORY, 5},
+        });
+        const std::array<std::string_view, 8> opcodes = {
+                REQUEST_ADD_CURRENCY_VALUE, REQUEST_GET_ALL_CURRENCIES, REQUEST_GET_CURRENCY_HISTORY,
+                REQUEST_ADD_CURRENCY, REQUEST_DEL_CURRENCY, REQUEST_DISCONNECT, "PING", "ADD_CURRENCY_VALUEX"
+        };
+        runner.run("dispatch/route_lookup_mixed", 4000000, [&](uint64_t i) {
+            auto &&route = routes.find(opcodes[i & 7]);
+            bench::do_not_optimize(route);
+        });
+    }
+
+    void json_benchmarks(bench::Runner &runner) {
+        std::string_view request(add_value_request);
+        request.remove_prefix(MESSAGE_PREFIX_LEN);
+        protocol::Request parsed;
+        runner.run("json/parse_add_currency_value_request", 1000000, [&](uint64_t) {
+            protocol::parse_request(request, parsed);
+            bench::do_not_optimize(parsed.value);
+        });
+
+        // the DOM parse the server used before the flat parser, kept for comparison
+        runner.run("json/parse_add_currency_value_request_dom", 200000, [&](uint64_t) {
+            auto &&client_json = nlohmann::json::parse(request);
+            std::string request_type = client_json["type"];
+            std::string currency = client_json["currency"];
+            double value = client_json["value"];
+            bench::do_not_optimize(request_type);
+            bench::do_not_optimize(currency);
+            bench::do_not_optimize(value);
+        });
+
+        std::string currency = "USD";
+        alignas(std::max_align_t) static char arena_buffer[server::WorkerPool::ARENA_SIZE];
+        std::pmr::monotonic_buffer_resource arena(arena_buffer, sizeof(arena_buffer), std::pmr::new_delete_resource());
+        runner.run("reply/encode_text_reply", 1000000, [&](uint64_t) {
+            {
+                std::pmr::string response(&arena);
+                protocol::build_frame(response, TXT_PREFIX, "Successfully add value for currency ", currency);
+                bench::do_not_optimize(response);
+            }
+            arena.release();
+        });
+
+        nlohmann::json history;
+        for (auto &&i = 0; i < 1000; ++i) {
+            history.push_back({{"value", 60.0 + i * 0.01}, {"date", "2017-Dec-01 12:00:00"}});
+        }
+        nlohmann::json history_response = {{"currency", currency}, {"history", history}};
+        runner.run("reply/encode_history_1000_points", 1000, [&](uint64_t) {
+            auto &&response = JSON_PREFIX + history_response.dump() + MESSAGE_END;
+            bench::do_not_optimize(response);
+        });
+
+        // the same history in HISTORY_ENCODING_GORILLA, one quote a second with two decimals
+        std::vector<protocol::HistoryPoint> points;
+        for (auto &&i = 0; i < 1000; ++i) points.push_back({1512129600 + i, (6000 + i % 37) / 100.0});
+        std::string payload, encoded;
+        runner.run("reply/encode_history_1000_points_gorilla", 1000, [&](uint64_t) {
+            protocol::encode_history(points, payload);
+            protocol::base64_encode(payload, encoded);
+            nlohmann::json compact_response = {{"currency", currency}, {"encoding", HISTORY_ENCODING_GORILLA},
+                                               {"history", encoded}};
+            auto &&response = JSON_PREFIX + compact_response.dump() + MESSAGE_END;
+            bench::do_not_optimize(response);
+        });
+
+        std::vector<protocol::HistoryPoint> decoded;
+        runner.run("reply/decode_history_1000_points_gorilla", 1000, [&](uint64_t) {
+            protocol::base64_decode(encoded, payload);
+            protocol::decode_history(payload, decoded);
+            bench::do_not_optimize(decoded);
+        });
+    }
+}
+
+void bench::register_protocol_benchmarks(Runner &runner) {
+    framing_benchmarks(runner);
+    dispatch_benchmarks(runner);
+    json_benchmarks(runner);
+}
@@ -0,0 +1,297 @@
+#include <cstdio>
+#include <cstring>
+#include <memory_resource>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "bench.h"
+#include "server.h"
+#include "tracing/trace.h"
+
+namespace {
+    int connect_loopback(int port) {
+        auto &&sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (connect(sock, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    // Sends one frame and reads until the reply terminator, without allocating
+    bool round_trip(int sock, const std::string &frame) {
+        if (send(sock, frame.data(), frame.size(), 0) != static_cast<ssize_t>(frame.size())) return false;
+        char reply[MESSAGE_SIZE * 4];
+        size_t received = 0;
+        const auto end_len = strlen(MESSAGE_END);
+        while (received < end_len || memcmp(reply + received - end_len, MESSAGE_END, end_len) != 0) {
+            if (received == sizeof(reply)) received = 0;
+            auto &&count = recv(sock, reply + received, sizeof(reply) - received, 0);
+            if (count <= 0) return false;
+            received += count;
+        }
+        return true;
+    }
+
+    // Sends one frame and reads exactly reply_size bytes back, for replies larger than round_trip's buffer
+    bool round_trip_sized(int sock, const std::string &frame, size_t reply_size) {
+        if (send(sock, frame.data(), frame.size(), 0) != static_cast<ssize_t>(frame.size())) return false;
+        char reply[64 * 1024];
+        size_t received = 0;
+        while (received < reply_size) {
+            auto &&count = recv(sock, reply, std::min(sizeof(reply), reply_size - received), 0);
+            if (count <= 0) return false;
+            received += count;
+        }
+        return true;
+    }
+
+    // round_trip over an in-process connection
+    bool round_trip_in_process(server::transport::InProcessStream &stream, const std::string &frame, size_t reply_size) {
+        if (!stream.send(frame.data(), frame.size())) return false;
+        char reply[64 * 1024];
+        size_t received = 0;
+        while (received < reply_size) {
+            auto &&count = stream.receive(reply, std::min(sizeof(reply), reply_size - received));
+            if (count == 0) return false;
+            received += count;
+        }
+        return true;
+    }
+
+    // Upstream of the worker arenas: whatever reaches it is request path memory the arena could not hold
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        uint64_t allocations() const { return count.load(std::memory_order_relaxed); }
+
+    private:
+        void *do_allocate(size_t bytes, size_t alignment) override {
+            count.fetch_add(1, std::memory_order_relaxed);
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *memory, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+        std::atomic<uint64_t> count{0};
+    };
+
+    // operator new calls one ADD_CURRENCY_VALUE round trip made when the check was added, all of
+    // them on the findb write path the request arena does not cover
+    const uint64_t ADD_CURRENCY_VALUE_ALLOCS = 5;
+
+    int connect_unix(const std::string &path) {
+        auto &&sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+        if (connect(sock, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+}
+
+// Whole request path in process: epoll thread, worker pool, dispatch and reply. The
+// allocs/op column of these cases is what keeps the request path allocation free.
+void bench::register_server_benchmarks(Runner &runner) {
+    auto &&db_path = "/tmp/server_bench_" + std::to_string(getpid()) + ".db";
+    findb::reset(db_path);
+    // the server logs every request, keep that out of the results
+    auto &&console = std::cout.rdbuf(nullptr);
+    static CountingResource arena_upstream;
+    server::set_arena_upstream(&arena_upstream);
+    {
+        server::ServerConfig config;
+        config.port = 0;
+        config.database_path = db_path;
+        server::Server server(config);
+        server.start();
+        auto &&sock = connect_loopback(server.port());
+        if (sock >= 0) {
+            const std::string text_frame = TXT_PREFIX "hello" MESSAGE_END;
+            runner.run("server/round_trip_text", 20000, [&](uint64_t) {
+                round_trip(sock, text_frame);
+            });
+
+            // every request traced, the ring buffers wrap many times over
+            server::tracing::set_sample_every(1);
+            runner.run("server/round_trip_text_traced", 20000, [&](uint64_t) {
+                round_trip(sock, text_frame);
+            });
+            server::tracing::set_sample_every(0);
+
+            const std::string unknown_frame = JSON_PREFIX R"({"type":"PING","currency":"USD"})" MESSAGE_END;
+            runner.run("server/round_trip_unknown_request_type", 20000, [&](uint64_t) {
+                round_trip(sock, unknown_frame);
+            });
+
+            round_trip(sock, JSON_PREFIX R"({"type":"ADD_CURRENCY","currency":"USD"})" MESSAGE_END);
+            const std::string add_value_frame =
+                    JSON_PREFIX R"({"type":"ADD_CURRENCY_VALUE","currency":"USD","value":61.25})" MESSAGE_END;
+            runner.run("server/round_trip_add_currency_value", 200, [&](uint64_t) {
+                round_trip(sock, add_value_frame);
+            });
+            // the findb write path is not arena backed yet, this only keeps it from getting worse
+            auto &&results = runner.results();
+            if (!results.empty() && results.back().name == "server/round_trip_add_currency_value") {
+                // SQLite growing its caches now and then adds a fraction of one per request
+                runner.expect(results.back().allocs_per_op < ADD_CURRENCY_VALUE_ALLOCS + 1,
+                              "server/round_trip_add_currency_value called operator new more than " +
+                              std::to_string(ADD_CURRENCY_VALUE_ALLOCS) + " times per request");
+            }
+            close(sock);
+        }
+        server.stop();
+
+        // Steady-state requests of every kind that does not touch SQLite or build an nlohmann
+        // reply, checked to reach the heap neither through operator new nor through a worker
+        // arena outgrowing its buffer. The feed gap fill is the one building its reply in the arena.
+        config.feed_group = "239.255.77.78";
+        {
+            server::Server feed_server(config);
+            feed_server.start();
+            auto &&feed_sock = connect_loopback(feed_server.port());
+            if (feed_sock >= 0) {
+                round_trip(feed_sock, JSON_PREFIX R"({"type":"ADD_CURRENCY","currency":"USD"})" MESSAGE_END);
+                for (auto &&i = 0; i < 16; ++i) {
+                    round_trip(feed_sock, JSON_PREFIX R"({"type":"ADD_CURRENCY_VALUE","currency":"USD","value":61.25})"
+                                          MESSAGE_END);
+                }
+                const std::string gap_fill_frame = JSON_PREFIX R"({"type":"FEED_GAP_FILL","from":1,"to":8})" MESSAGE_END;
+                runner.run("server/round_trip_feed_gap_fill_8", 2000, [&](uint64_t) {
+                    round_trip(feed_sock, gap_fill_frame);
+                });
+
+                const std::string frames[] = {
+                        TXT_PREFIX "hello" MESSAGE_END,
+                        JSON_PREFIX R"({"type":"PING","currency":"USD"})" MESSAGE_END,
+                        JSON_PREFIX R"({"type":"ADD_CURRENCY_VALUE","currency":"USD"})" MESSAGE_END,
+                        "bogus" MESSAGE_END,
+                        gap_fill_frame,
+                };
+                auto &&spilled = arena_upstream.allocations();
+                runner.run("server/round_trip_mixed_without_sqlite", 5000, [&](uint64_t i) {
+                    round_trip(feed_sock, frames[i % (sizeof(frames) / sizeof(frames[0]))]);
+                });
+                auto &&results = runner.results();
+                if (!results.empty() && results.back().name == "server/round_trip_mixed_without_sqlite") {
+                    runner.expect(results.back().allocs_per_op == 0, "server/round_trip_mixed_without_sqlite called operator new");
+                    runner.expect(arena_upstream.allocations() == spilled,
+                                  "server/round_trip_mixed_without_sqlite outgrew the request arena " +
+                                  std::to_string(arena_upstream.allocations() - spilled) + " times");
+                }
+                close(feed_sock);
+            }
+            feed_server.stop();
+        }
+        config.feed_group.clear();
+
+        // 256 KiB echoed back, copied into the socket and then with MSG_ZEROCOPY. Over loopback the
+        // kernel still copies zerocopy sends, the second case shows what the completion wait costs.
+        const std::string large_text(256 * 1024, 'x');
+        const std::string large_frame = TXT_PREFIX + large_text + MESSAGE_END;
+        const auto large_reply = large_text.size() + strlen(MESSAGE_END);
+        for (auto &&zerocopy : {false, true}) {
+            config.zerocopy_threshold = zerocopy ? 64 * 1024 : 0;
+            server::Server large_server(config);
+            large_server.start();
+            auto &&large_sock = connect_loopback(large_server.port());
+            if (large_sock >= 0) {
+                runner.run(zerocopy ? "server/round_trip_text_256k_zerocopy" : "server/round_trip_text_256k", 500,
+                           [&](uint64_t) {
+                    round_trip_sized(large_sock, large_frame, large_reply);
+                });
+                close(large_sock);
+            }
+            large_server.stop();
+        }
+        config.zerocopy_threshold = 0;
+
+        // The same round trips without the TCP stack: over a Unix socket, then in process where
+        // only framing, dispatch and the reply are left
+        const std::string text_frame = TXT_PREFIX "hello" MESSAGE_END;
+        const auto text_reply = strlen("hello" MESSAGE_END);
+
+        // Latency modes over TCP: defaults, --low-latency, and that with the epoll thread spinning
+        // before it blocks. The pipelined cases send 8 frames in one write and wait for all replies.
+        std::string pipelined_frames;
+        for (auto &&i = 0; i < 8; ++i) pipelined_frames += text_frame;
+        struct LatencyMode {
+            const char *suffix;
+            bool low_latency;
+            uint64_t spin_us;
+        };
+        for (auto &&mode : {LatencyMode{"", false, 0}, LatencyMode{"_low_latency", true, 0},
+                            LatencyMode{"_spin", true, 50}}) {
+            config.low_latency = mode.low_latency;
+            config.spin_us = mode.spin_us;
+            server::Server latency_server(config);
+            latency_server.start();
+            auto &&latency_sock = connect_loopback(latency_server.port());
+            if (latency_sock >= 0) {
+                // the plain round trip with default options is server/round_trip_text above
+                if (mode.low_latency) {
+                    runner.run(std::string("server/round_trip_text") + mode.suffix, 20000, [&](uint64_t) {
+                        round_trip(latency_sock, text_frame);
+                    });
+                }
+                // without TCP_NODELAY the replies after the first wait for a delayed ACK, hence few iterations
+                runner.run(std::string("server/pipelined_8_text") + mode.suffix, 200, [&](uint64_t) {
+                    round_trip_sized(latency_sock, pipelined_frames, 8 * text_reply);
+                });
+                close(latency_sock);
+            }
+            latency_server.stop();
+        }
+        config.low_latency = false;
+        config.spin_us = 0;
+
+        config.transport = server::TransportKind::unix_socket;
+        config.unix_socket_path = db_path + ".sock";
+        {
+            server::Server unix_server(config);
+            unix_server.start();
+            auto &&unix_sock = connect_unix(config.unix_socket_path);
+            if (unix_sock >= 0) {
+                runner.run("server/round_trip_text_unix", 20000, [&](uint64_t) {
+                    round_trip(unix_sock, text_frame);
+                });
+                close(unix_sock);
+            }
+            unix_server.stop();
+        }
+        std::remove(config.unix_socket_path.c_str());
+
+        config.transport = server::TransportKind::in_process;
+        {
+            server::Server in_process_server(config);
+            in_process_server.start();
+            auto &&stream = in_process_server.connect_in_process();
+            if (stream) {
+                runner.run("server/round_trip_text_in_process", 20000, [&](uint64_t) {
+                    round_trip_in_process(*stream, text_frame, text_reply);
+                });
+                // larger than the ring, the worker waits for the client to make room
+                runner.run("server/round_trip_text_256k_in_process", 500, [&](uint64_t) {
+                    round_trip_in_process(*stream, large_frame, large_reply);
+                });
+                stream->close();
+            }
+            in_process_server.stop();
+        }
+    }
+    server::set_arena_upstream(nullptr);
+    std::cout.rdbuf(console);
+    std::remove(db_path.c_str());
+}
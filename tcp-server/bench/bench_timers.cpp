@@ -0,0 +1,26 @@
+#include "bench.h"
+#include "utils/timer_wheel.h"
+
+void bench::register_timer_benchmarks(Runner &runner) {
+    const int connections = 200000;
+    const uint64_t idle_ms = 300000, tick_ms = idle_ms / server::TimerWheel::SLOTS + 1;
+    uint64_t now = 0;
+    server::TimerWheel timers(tick_ms, now);
+    for (auto &&fd = 0; fd < connections; ++fd) timers.schedule(fd, now + idle_ms + fd % 1000);
+
+    // what every read does: push the idle deadline of an active connection forward
+    runner.run("timers/reschedule_with_200k_pending", 2000000, [&](uint64_t i) {
+        timers.schedule(static_cast<int>((i * 7919) % connections), now + idle_ms + i % 1000);
+    });
+
+    runner.run("timers/next_timeout_with_200k_pending", 2000000, [&](uint64_t) {
+        auto &&timeout = timers.next_timeout_ms(now);
+        bench::do_not_optimize(timeout);
+    });
+
+    // one reactor iteration a tick apart, nothing due
+    runner.run("timers/advance_one_tick_with_200k_pending", 100000, [&](uint64_t) {
+        timers.advance(now, [](int) {});
+        now += 1;
+    });
+}
@@ -0,0 +1,61 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "bench.h"
+#include "workers/worker_pool.h"
+
+void bench::register_worker_pool_benchmarks(Runner &runner) {
+    std::atomic<uint64_t> done{0};
+    server::WorkerPool workers(4, 1024, [&done](std::string &, int) {
+        done.fetch_add(1, std::memory_order_relaxed);
+    });
+    const uint64_t batch = 100000;
+    std::string message;
+
+    // enqueue cost as seen by the epoll thread, frames from 64 clients
+    runner.run_batch("worker_pool/enqueue_noop", [&]() {
+        done = 0;
+        for (uint64_t i = 0; i < batch; ++i) {
+            message.assign("txt:hello");
+            workers.enqueue(static_cast<int>(i % 64), message);
+        }
+        while (done.load() != batch) std::this_thread::yield();
+        return batch;
+    });
+
+    // enqueue plus hand-off latency for a single outstanding task
+    runner.run("worker_pool/enqueue_and_wait", 20000, [&](uint64_t) {
+        auto &&expected = done.load() + 1;
+        message.assign("txt:hello");
+        workers.enqueue(0, message);
+        while (done.load() != expected) std::this_thread::yield();
+    });
+
+    // Round trip of a light client's request while 8 clients keep 64 requests of 200us or more each
+    // queued. Stays near one heavy request however deep their queues are.
+    std::atomic<uint64_t> light_done{0}, heavy_done{0};
+    server::WorkerPool shared(4, 1024, [&](std::string &message, int) {
+        if (message[0] != 'h') {
+            light_done.fetch_add(1);
+            return;
+        }
+        // blocks like a SQLite call rather than spinning, so the case also holds on a single core
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        heavy_done.fetch_add(1);
+    });
+    uint64_t heavy_sent = 0;
+    auto &&top_up = [&]() {
+        while (heavy_sent - heavy_done.load() < 8 * 64) {
+            message.assign("heavy");
+            shared.enqueue(static_cast<int>(100 + heavy_sent++ % 8), message);
+        }
+    };
+    runner.run("worker_pool/light_client_under_heavy_clients", 2000, [&](uint64_t) {
+        top_up();
+        auto &&expected = light_done.load() + 1;
+        message.assign("light");
+        shared.enqueue(0, message);
+        while (light_done.load() != expected) std::this_thread::yield();
+    });
+    shared.wait_idle();
+}
@@ -0,0 +1,100 @@
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "feed_subscriber.h"
+
+bool client::FeedSubscriber::open(std::string &error) {
+    ip_mreq membership{};
+    if (inet_pton(AF_INET, config.group.c_str(), &membership.imr_multiaddr) != 1 ||
+        inet_pton(AF_INET, config.interface_address.c_str(), &membership.imr_interface) != 1) {
+        error = "Bad group or interface address";
+        return false;
+    }
+    descriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (descriptor == -1) {
+        error = std::string("socket: ") + strerror(errno);
+        return false;
+    }
+    // every consumer on the host binds the same port
+    int enable = 1;
+    setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (config.receive_buffer > 0) {
+        setsockopt(descriptor, SOL_SOCKET, SO_RCVBUF, &config.receive_buffer, sizeof(config.receive_buffer));
+    }
+    // bound to the group rather than any address, so other groups on the same port stay out
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr = membership.imr_multiaddr;
+    address.sin_port = htons(static_cast<uint16_t>(config.port));
+    if (bind(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+        setsockopt(descriptor, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == -1) {
+        error = std::string("join: ") + strerror(errno);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void client::FeedSubscriber::close() {
+    if (descriptor != -1) ::close(descriptor);
+    descriptor = -1;
+}
+
+bool client::FeedSubscriber::next(server::feed::Tick &tick, int timeout_ms) {
+    while (ready.empty()) {
+        server::feed::Tick received;
+        if (!receive(received, timeout_ms)) {
+            // a quiet feed may just have lost its latest datagrams, nothing after them reveals the gap
+            if (session) expected = fill(expected, UINT64_MAX);
+            if (ready.empty()) return false;
+            break;
+        }
+        if (received.session != session) {
+            session = received.session;
+            expected = received.sequence;
+        }
+        // already handed out, through gap-fill or as a duplicate
+        if (received.sequence < expected) continue;
+        if (received.sequence > expected) fill(expected, received.sequence - 1);
+        ready.push_back(received);
+        expected = received.sequence + 1;
+    }
+    tick = ready.front();
+    ready.pop_front();
+    return true;
+}
+
+bool client::FeedSubscriber::receive(server::feed::Tick &tick, int timeout_ms) {
+    char datagram[server::feed::TICK_DATAGRAM_SIZE + 1];
+    while (descriptor != -1) {
+        pollfd readable{descriptor, POLLIN, 0};
+        if (poll(&readable, 1, timeout_ms) <= 0) return false;
+        auto &&size = recv(descriptor, datagram, sizeof(datagram), 0);
+        // anything else sent to the group is skipped
+        if (size > 0 && server::feed::decode_tick(datagram, static_cast<size_t>(size), tick)) return true;
+    }
+    return false;
+}
+
+uint64_t client::FeedSubscriber::fill(uint64_t from, uint64_t to) {
+    while (from <= to) {
+        auto &&result = client.feed_gap_fill(from, to).get();
+        if (!result.ok || result.value.session != session) break;
+        to = std::min(to, result.value.last);
+        if (result.value.ticks.empty()) break;
+        if (result.value.first > from) lost_count += result.value.first - from;
+        for (auto &&tick : result.value.ticks) {
+            if (tick.sequence > to) break;
+            ready.push_back(tick);
+            recovered_count++;
+        }
+        from = result.value.first + result.value.ticks.size();
+    }
+    // an open-ended range the server could not bound is retried on the next timeout
+    if (to == UINT64_MAX) return from;
+    if (from <= to) lost_count += to - from + 1;
+    return std::max(from, to + 1);
+}
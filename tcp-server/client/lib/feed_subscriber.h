@@ -0,0 +1,70 @@
+#ifndef ECHOSERVER_FEED_SUBSCRIBER_H
+#define ECHOSERVER_FEED_SUBSCRIBER_H
+
+#include <deque>
+#include <string>
+#include "fin_client.h"
+#include "feed/feed_wire.h"
+
+namespace client {
+    struct FeedConfig {
+        std::string group;
+        int port = FEED_PORT;
+        // address of the interface to join the group on, the server's --feed-interface
+        std::string interface_address = "127.0.0.1";
+        // kernel receive buffer in bytes, 0 keeps the system default
+        int receive_buffer = 0;
+    };
+
+    // Joins the multicast quote feed of a server and hands its ticks out in sequence order.
+    // When the sequence jumps, the datagram that revealed the gap is held back while the missing
+    // ones are fetched over TCP with FEED_GAP_FILL; those the server no longer has are counted in
+    // lost(). Losing the newest datagrams shows no jump, so a wait for the next tick that times
+    // out asks the server as well. A new session, after the server restarted, starts at the first datagram seen of it.
+    // Not thread safe, use from one thread.
+    class FeedSubscriber {
+    public:
+        FeedSubscriber(FinClient &client, FeedConfig config) : client(client), config(std::move(config)) {}
+
+        FeedSubscriber(const FeedSubscriber &) = delete;
+
+        FeedSubscriber &operator=(const FeedSubscriber &) = delete;
+
+        ~FeedSubscriber() {
+            close();
+        }
+
+        // Joins the group; false with the reason in error
+        bool open(std::string &error);
+
+        void close();
+
+        // Next tick in sequence order, false if no datagram arrived within timeout_ms (-1 waits)
+        bool next(server::feed::Tick &tick, int timeout_ms = -1);
+
+        // sequences neither the feed nor gap-fill could provide
+        uint64_t lost() const { return lost_count; }
+
+        // sequences that came through gap-fill
+        uint64_t recovered() const { return recovered_count; }
+
+    private:
+        bool receive(server::feed::Tick &tick, int timeout_ms);
+
+        // Queues the ticks from..to of the current session, fetched from the server; to is capped at
+        // the latest sequence the server published. Returns the sequence after the range.
+        uint64_t fill(uint64_t from, uint64_t to);
+
+        FinClient &client;
+        FeedConfig config;
+        int descriptor = -1;
+        uint64_t session = 0;
+        // next sequence to hand out, valid once a datagram of the session arrived
+        uint64_t expected = 0;
+        std::deque<server::feed::Tick> ready;
+        uint64_t lost_count = 0;
+        uint64_t recovered_count = 0;
+    };
+}
+
+#endif //ECHOSERVER_FEED_SUBSCRIBER_H
@@ -0,0 +1,534 @@
+#include <array>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "fin_client.h"
+#include "protocol/framing.h"
+#include "protocol/history_encoding.h"
+#include "json/src/json.hpp"
+
+namespace {
+    std::string json_frame(const char *type, const std::string &currency) {
+        nlohmann::json request = {
+                {"type",     type},
+                {"currency", currency}
+        };
+        return JSON_PREFIX + request.dump();
+    }
+
+    std::string history_frame(const std::string &currency, bool compact) {
+        nlohmann::json request = {
+                {"type",     REQUEST_GET_CURRENCY_HISTORY},
+                {"currency", currency}
+        };
+        if (compact) request["encoding"] = HISTORY_ENCODING_GORILLA;
+        return JSON_PREFIX + request.dump();
+    }
+
+    std::string value_frame(const std::string &currency, double value) {
+        nlohmann::json request = {
+                {"type",     REQUEST_ADD_CURRENCY_VALUE},
+                {"currency", currency},
+                {"value",    value}
+        };
+        return JSON_PREFIX + request.dump();
+    }
+
+    std::string gap_fill_frame(uint64_t from, uint64_t to) {
+        // the server reads numbers as doubles, anything past 2^53 means "up to the latest" anyway
+        to = std::min<uint64_t>(to, 1ull << 53);
+        nlohmann::json request = {
+                {"type", REQUEST_FEED_GAP_FILL},
+                {"from", from},
+                {"to",   to}
+        };
+        return JSON_PREFIX + request.dump();
+    }
+
+    client::Reply to_reply(std::string &frame) {
+        std::string_view prefix(frame.data(), std::min<size_t>(frame.size(), MESSAGE_PREFIX_LEN));
+        auto &&kind = prefix == TXT_PREFIX ? client::Reply::TEXT :
+                      prefix == JSON_PREFIX ? client::Reply::JSON :
+                      prefix == ERROR_PREFIX ? client::Reply::ERROR : client::Reply::Kind(-1);
+        // echoed text comes back without a prefix
+        if (kind == client::Reply::Kind(-1)) return {client::Reply::TEXT, std::move(frame)};
+        frame.erase(0, MESSAGE_PREFIX_LEN);
+        return {kind, std::move(frame)};
+    }
+
+    template<typename Value>
+    client::Result<Value> failed(client::Reply &reply) {
+        client::Result<Value> result;
+        result.error = std::move(reply.body);
+        return result;
+    }
+}
+
+void client::Batch::add_currency(const std::string &currency) {
+    frames.append(json_frame(REQUEST_ADD_CURRENCY, currency)).append(MESSAGE_END);
+    count++;
+}
+
+void client::Batch::add_currency_value(const std::string &currency, double value) {
+    frames.append(value_frame(currency, value)).append(MESSAGE_END);
+    count++;
+}
+
+void client::Batch::del_currency(const std::string &currency) {
+    frames.append(json_frame(REQUEST_DEL_CURRENCY, currency)).append(MESSAGE_END);
+    count++;
+}
+
+void client::Batch::list_currencies() {
+    frames.append(CMD_PREFIX).append(REQUEST_GET_ALL_CURRENCIES).append(MESSAGE_END);
+    count++;
+}
+
+void client::Batch::currency_history(const std::string &currency, bool compact) {
+    frames.append(history_frame(currency, compact)).append(MESSAGE_END);
+    count++;
+}
+
+void client::Batch::echo(const std::string &text) {
+    if (text.find(MESSAGE_END) != std::string::npos) rejected = "text contains MESSAGE_END";
+    frames.append(TXT_PREFIX).append(text).append(MESSAGE_END);
+    count++;
+}
+
+client::FinClient::FinClient(ClientConfig config) :
+        config(std::move(config)), epoll_descriptor(-1), wakeup_descriptor(-1), closing(false) {
+    connections.resize(std::max<size_t>(this->config.connections, 1));
+    epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u32 = UINT32_MAX;
+    epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, wakeup_descriptor, &event);
+    io_thread = std::thread(&FinClient::io_loop, this);
+}
+
+void client::FinClient::close() {
+    std::unique_lock<std::mutex> lock(submit_mutex);
+    if (!io_thread.joinable()) return;
+    closing = true;
+    lock.unlock();
+    uint64_t wakeup = 1;
+    write(wakeup_descriptor, &wakeup, sizeof(wakeup));
+    io_thread.join();
+    ::close(epoll_descriptor);
+    ::close(wakeup_descriptor);
+}
+
+void client::FinClient::send(std::string frame, Callback done) {
+    // replies are matched by position, a frame the server splits would shift every later one
+    if (frame.find(MESSAGE_END) != std::string::npos) {
+        done({Reply::REJECTED, "text contains MESSAGE_END"});
+        return;
+    }
+    frame.append(MESSAGE_END);
+    std::vector<Callback> callbacks;
+    callbacks.push_back(std::move(done));
+    std::unique_lock<std::mutex> lock(submit_mutex);
+    if (closing) {
+        lock.unlock();
+        callbacks.front()({Reply::DISCONNECTED, "client closed"});
+        return;
+    }
+    submitted.push_back({std::move(frame), std::move(callbacks)});
+    lock.unlock();
+    uint64_t wakeup = 1;
+    write(wakeup_descriptor, &wakeup, sizeof(wakeup));
+}
+
+void client::FinClient::submit(Batch &&batch, std::function<void(std::vector<Reply> &&)> done) {
+    if (batch.count == 0) {
+        done({});
+        return;
+    }
+    if (!batch.rejected.empty()) {
+        done(std::vector<Reply>(batch.count, {Reply::REJECTED, batch.rejected}));
+        return;
+    }
+    struct Pending {
+        std::vector<Reply> replies;
+        size_t remaining;
+        std::function<void(std::vector<Reply> &&)> done;
+    };
+    // every callback of the batch runs on the same thread, so the count needs no atomics
+    auto &&pending = std::make_shared<Pending>(Pending{std::vector<Reply>(batch.count), batch.count, std::move(done)});
+    Submission submission{std::move(batch.frames), {}};
+    for (size_t i = 0; i < batch.count; ++i) {
+        submission.callbacks.emplace_back([pending, i](Reply &&reply) {
+            pending->replies[i] = std::move(reply);
+            if (--pending->remaining == 0) pending->done(std::move(pending->replies));
+        });
+    }
+    std::unique_lock<std::mutex> lock(submit_mutex);
+    if (closing) {
+        lock.unlock();
+        for (auto &&callback : submission.callbacks) callback({Reply::DISCONNECTED, "client closed"});
+        return;
+    }
+    submitted.push_back(std::move(submission));
+    lock.unlock();
+    uint64_t wakeup = 1;
+    write(wakeup_descriptor, &wakeup, sizeof(wakeup));
+}
+
+std::future<std::vector<client::Reply>> client::FinClient::submit(Batch &&batch) {
+    auto &&promise = std::make_shared<std::promise<std::vector<Reply>>>();
+    auto &&future = promise->get_future();
+    submit(std::move(batch), [promise](std::vector<Reply> &&replies) { promise->set_value(std::move(replies)); });
+    return std::move(future);
+}
+
+template<typename Value>
+void client::FinClient::call(std::string frame, ResultCallback<Value> done, Result<Value> (*convert)(Reply &&)) {
+    send(std::move(frame), [done = std::move(done), convert](Reply &&reply) { done(convert(std::move(reply))); });
+}
+
+template<typename Value>
+std::future<client::Result<Value>> client::FinClient::call(std::string frame, Result<Value> (*convert)(Reply &&)) {
+    auto &&promise = std::make_shared<std::promise<Result<Value>>>();
+    auto &&future = promise->get_future();
+    call<Value>(std::move(frame), [promise](Result<Value> &&result) { promise->set_value(std::move(result)); },
+                convert);
+    return std::move(future);
+}
+
+std::future<client::Result<std::string>> client::FinClient::add_currency(const std::string &currency) {
+    return call<std::string>(json_frame(REQUEST_ADD_CURRENCY, currency), to_text);
+}
+
+void client::FinClient::add_currency(const std::string &currency, ResultCallback<std::string> done) {
+    call<std::string>(json_frame(REQUEST_ADD_CURRENCY, currency), std::move(done), to_text);
+}
+
+std::future<client::Result<std::string>> client::FinClient::add_currency_value(const std::string &currency,
+                                                                               double value) {
+    return call<std::string>(value_frame(currency, value), to_text);
+}
+
+void client::FinClient::add_currency_value(const std::string &currency, double value,
+                                           ResultCallback<std::string> done) {
+    call<std::string>(value_frame(currency, value), std::move(done), to_text);
+}
+
+std::future<client::Result<std::string>> client::FinClient::del_currency(const std::string &currency) {
+    return call<std::string>(json_frame(REQUEST_DEL_CURRENCY, currency), to_text);
+}
+
+void client::FinClient::del_currency(const std::string &currency, ResultCallback<std::string> done) {
+    call<std::string>(json_frame(REQUEST_DEL_CURRENCY, currency), std::move(done), to_text);
+}
+
+std::future<client::Result<std::vector<client::Quote>>> client::FinClient::list_currencies() {
+    return call<std::vector<Quote>>(std::string(CMD_PREFIX) + REQUEST_GET_ALL_CURRENCIES, to_quotes);
+}
+
+void client::FinClient::list_currencies(ResultCallback<std::vector<Quote>> done) {
+    call<std::vector<Quote>>(std::string(CMD_PREFIX) + REQUEST_GET_ALL_CURRENCIES, std::move(done), to_quotes);
+}
+
+std::future<client::Result<std::vector<client::HistoryPoint>>>
+client::FinClient::currency_history(const std::string &currency) {
+    return call<std::vector<HistoryPoint>>(history_frame(currency, config.compact_history), to_history);
+}
+
+void client::FinClient::currency_history(const std::string &currency,
+                                         ResultCallback<std::vector<HistoryPoint>> done) {
+    call<std::vector<HistoryPoint>>(history_frame(currency, config.compact_history), std::move(done), to_history);
+}
+
+std::future<client::Result<client::GapFill>> client::FinClient::feed_gap_fill(uint64_t from, uint64_t to) {
+    return call<GapFill>(gap_fill_frame(from, to), to_gap_fill);
+}
+
+void client::FinClient::feed_gap_fill(uint64_t from, uint64_t to, ResultCallback<GapFill> done) {
+    call<GapFill>(gap_fill_frame(from, to), std::move(done), to_gap_fill);
+}
+
+std::future<client::Result<std::string>> client::FinClient::echo(const std::string &text) {
+    return call<std::string>(TXT_PREFIX + text, to_text);
+}
+
+void client::FinClient::echo(const std::string &text, ResultCallback<std::string> done) {
+    call<std::string>(TXT_PREFIX + text, std::move(done), to_text);
+}
+
+client::Result<std::string> client::FinClient::to_text(Reply &&reply) {
+    if (!reply.ok()) return failed<std::string>(reply);
+    return {true, {}, std::move(reply.body)};
+}
+
+client::Result<std::vector<client::Quote>> client::FinClient::to_quotes(Reply &&reply) {
+    if (!reply.ok()) return failed<std::vector<Quote>>(reply);
+    Result<std::vector<Quote>> result;
+    try {
+        // an empty table is sent as null rather than []
+        for (auto &&item : nlohmann::json::parse(reply.body)) {
+            result.value.push_back({item["currency"], item["value"], item["relative_increase"],
+                                    item["absolute_increase"], item["date"]});
+        }
+        result.ok = true;
+    } catch (std::exception &ex) {
+        result.error = std::string("Malformed reply: ") + ex.what();
+    }
+    return result;
+}
+
+client::Result<std::vector<client::HistoryPoint>> client::FinClient::to_history(Reply &&reply) {
+    if (!reply.ok()) return failed<std::vector<HistoryPoint>>(reply);
+    Result<std::vector<HistoryPoint>> result;
+    try {
+        auto &&json = nlohmann::json::parse(reply.body);
+        if (json.contains("encoding")) {
+            std::string payload;
+            std::vector<protocol::HistoryPoint> points;
+            if (json["encoding"] != HISTORY_ENCODING_GORILLA ||
+                !protocol::base64_decode(json["history"].get<std::string>(), payload) ||
+                !protocol::decode_history(payload, points)) {
+                result.error = "Malformed reply: bad compact history";
+                return result;
+            }
+            result.value.reserve(points.size());
+            for (auto &&point : points) {
+                result.value.push_back({point.value, protocol::format_history_date(point.time)});
+            }
+        } else {
+            for (auto &&item : json["history"]) {
+                result.value.push_back({item["value"], item["date"]});
+            }
+        }
+        result.ok = true;
+    } catch (std::exception &ex) {
+        result.error = std::string("Malformed reply: ") + ex.what();
+    }
+    return result;
+}
+
+client::Result<client::GapFill> client::FinClient::to_gap_fill(Reply &&reply) {
+    if (!reply.ok()) return failed<GapFill>(reply);
+    Result<GapFill> result;
+    try {
+        auto &&json = nlohmann::json::parse(reply.body);
+        result.value.session = json["session"];
+        result.value.last = json["last"];
+        result.value.first = json["first"];
+        std::string datagrams;
+        if (!protocol::base64_decode(json["datagrams"].get<std::string>(), datagrams) ||
+            datagrams.size() % server::feed::TICK_DATAGRAM_SIZE != 0) {
+            result.error = "Malformed reply: bad datagrams";
+            return result;
+        }
+        result.value.ticks.resize(datagrams.size() / server::feed::TICK_DATAGRAM_SIZE);
+        for (size_t i = 0; i < result.value.ticks.size(); ++i) {
+            if (!server::feed::decode_tick(datagrams.data() + i * server::feed::TICK_DATAGRAM_SIZE,
+                                           server::feed::TICK_DATAGRAM_SIZE, result.value.ticks[i])) {
+                result.error = "Malformed reply: bad datagram";
+                return result;
+            }
+        }
+        result.ok = true;
+    } catch (std::exception &ex) {
+        result.error = std::string("Malformed reply: ") + ex.what();
+    }
+    return result;
+}
+
+void client::FinClient::io_loop() {
+    std::array<epoll_event, 16> events{};
+    std::vector<Submission> incoming;
+    while (true) {
+        auto &&event_cnt = epoll_wait(epoll_descriptor, events.data(), static_cast<int>(events.size()), -1);
+        for (auto &&i = 0; i < event_cnt; ++i) {
+            auto &&evt = events[i];
+            if (evt.data.u32 == UINT32_MAX) {
+                uint64_t wakeups;
+                read(wakeup_descriptor, &wakeups, sizeof(wakeups));
+                continue;
+            }
+            auto &&connection = connections[evt.data.u32];
+            if (connection.descriptor == -1) continue;
+            if (!connection.connected && (evt.events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int error = 0;
+                socklen_t error_len = sizeof(error);
+                getsockopt(connection.descriptor, SOL_SOCKET, SO_ERROR, &error, &error_len);
+                if (error != 0) {
+                    drop_connection(connection, std::string("connect failed: ") + strerror(error));
+                    continue;
+                }
+                connection.connected = true;
+            }
+            if (evt.events & EPOLLIN) read_replies(connection);
+            if (connection.descriptor == -1) continue;
+            if (evt.events & (EPOLLERR | EPOLLHUP)) {
+                drop_connection(connection, "connection closed by server");
+                continue;
+            }
+            if (evt.events & EPOLLOUT) flush(connection);
+        }
+
+        std::unique_lock<std::mutex> lock(submit_mutex);
+        incoming.swap(submitted);
+        bool stop = closing;
+        lock.unlock();
+        // replies above may have made room for what waits in the backlog
+        while (!backlog.empty() && dispatch(backlog.front())) backlog.pop_front();
+        for (auto &&submission : incoming) {
+            // once something waits, later submissions queue behind it to keep their order
+            if (!backlog.empty() || !dispatch(submission)) backlog.push_back(std::move(submission));
+        }
+        incoming.clear();
+        if (stop) break;
+    }
+    for (auto &&connection : connections) drop_connection(connection, "client closed");
+    for (auto &&submission : backlog) {
+        for (auto &&callback : submission.callbacks) callback({Reply::DISCONNECTED, "client closed"});
+    }
+    backlog.clear();
+}
+
+bool client::FinClient::dispatch(Submission &submission) {
+    auto &&target = &connections.front();
+    if (submission.connection >= 0) {
+        target = &connections[submission.connection];
+        // the first part of the batch has been failed already, the rest depends on it
+        if (target->generation != submission.generation) {
+            for (auto &&callback : submission.callbacks) callback({Reply::DISCONNECTED, "connection lost during batch"});
+            return true;
+        }
+    } else {
+        for (auto &&connection : connections) {
+            if (connection.waiting.size() < target->waiting.size()) target = &connection;
+        }
+    }
+    if (target->waiting.size() >= config.max_in_flight) return false;
+    auto &&connection = *target;
+    if (connection.descriptor == -1 && !open_connection(connection)) {
+        for (auto &&callback : submission.callbacks) {
+            callback({Reply::DISCONNECTED, "cannot connect to " + config.host + ":" + std::to_string(config.port)});
+        }
+        return true;
+    }
+    auto &&room = config.max_in_flight - connection.waiting.size();
+    if (submission.callbacks.size() <= room) {
+        connection.out.append(submission.frames);
+        for (auto &&callback : submission.callbacks) connection.waiting.push_back(std::move(callback));
+        if (connection.connected) flush(connection);
+        return true;
+    }
+    // frames never contain MESSAGE_END, so the first room of them end at the room-th one
+    const std::string message_end(MESSAGE_END);
+    size_t split = 0;
+    for (size_t i = 0; i < room; ++i) split = submission.frames.find(message_end, split) + message_end.size();
+    connection.out.append(submission.frames, 0, split);
+    submission.frames.erase(0, split);
+    for (size_t i = 0; i < room; ++i) connection.waiting.push_back(std::move(submission.callbacks[i]));
+    submission.callbacks.erase(submission.callbacks.begin(), submission.callbacks.begin() + room);
+    submission.connection = static_cast<int>(&connection - connections.data());
+    submission.generation = connection.generation;
+    if (connection.connected) flush(connection);
+    return false;
+}
+
+bool client::FinClient::open_connection(Connection &connection) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    auto &&port = std::to_string(config.port);
+    if (getaddrinfo(config.host.c_str(), port.c_str(), &hints, &addresses) != 0) return false;
+    auto &&descriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    auto &&status = descriptor == -1 ? -1 : connect(descriptor, addresses->ai_addr, addresses->ai_addrlen);
+    freeaddrinfo(addresses);
+    if (status == -1 && errno != EINPROGRESS) {
+        if (descriptor != -1) ::close(descriptor);
+        return false;
+    }
+    // pipelined requests are small, waiting for Nagle would only add latency
+    int enable_options = 1;
+    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enable_options, sizeof(enable_options));
+    connection.descriptor = descriptor;
+    connection.connected = status == 0;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.u32 = static_cast<uint32_t>(&connection - connections.data());
+    epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, descriptor, &event);
+    return true;
+}
+
+void client::FinClient::drop_connection(Connection &connection, const std::string &reason) {
+    if (connection.descriptor != -1) {
+        epoll_ctl(epoll_descriptor, EPOLL_CTL_DEL, connection.descriptor, nullptr);
+        ::close(connection.descriptor);
+        connection.generation++;
+    }
+    connection.descriptor = -1;
+    connection.connected = false;
+    connection.out.clear();
+    connection.out_offset = 0;
+    connection.in.clear();
+    // the server may or may not have acted on these
+    std::deque<Callback> waiting = std::move(connection.waiting);
+    connection.waiting.clear();
+    for (auto &&callback : waiting) callback({Reply::DISCONNECTED, reason});
+}
+
+void client::FinClient::flush(Connection &connection) {
+    while (connection.out_offset < connection.out.size()) {
+        auto &&sent = ::send(connection.descriptor, connection.out.data() + connection.out_offset,
+                             connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (sent < 0) {
+            drop_connection(connection, std::string("send failed: ") + strerror(errno));
+            return;
+        }
+        connection.out_offset += sent;
+    }
+    if (connection.out_offset == connection.out.size()) {
+        connection.out.clear();
+        connection.out_offset = 0;
+    }
+    update_interest(connection);
+}
+
+void client::FinClient::update_interest(Connection &connection) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    if (!connection.out.empty()) event.events |= EPOLLOUT;
+    event.data.u32 = static_cast<uint32_t>(&connection - connections.data());
+    epoll_ctl(epoll_descriptor, EPOLL_CTL_MOD, connection.descriptor, &event);
+}
+
+void client::FinClient::read_replies(Connection &connection) {
+    char read_buffer[64 * 1024];
+    while (true) {
+        auto &&count = read(connection.descriptor, read_buffer, sizeof(read_buffer));
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (count <= 0) {
+            drop_connection(connection, "connection closed by server");
+            return;
+        }
+        connection.in.append(read_buffer, static_cast<size_t>(count));
+    }
+    // The server writes each reply on its own and Nagle holds the next one back until this
+    // side acks; a delayed ack would stall a pipelined window for tens of milliseconds.
+    int enable_options = 1;
+    setsockopt(connection.descriptor, IPPROTO_TCP, TCP_QUICKACK, &enable_options, sizeof(enable_options));
+    std::string frame;
+    while (protocol::extract_frame(connection.in, frame)) {
+        // the server never speaks first, a reply nobody waits for is dropped
+        if (connection.waiting.empty()) continue;
+        Callback callback = std::move(connection.waiting.front());
+        connection.waiting.pop_front();
+        callback(to_reply(frame));
+    }
+}
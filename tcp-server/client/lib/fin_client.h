@@ -0,0 +1,236 @@
+#ifndef ECHOSERVER_FIN_CLIENT_H
+#define ECHOSERVER_FIN_CLIENT_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "defines.h"
+#include "feed/feed_wire.h"
+
+// Asynchronous Linux client for the finance server.
+//
+// Requests are pipelined over a small pool of non-blocking connections driven by one I/O
+// thread. The server answers the frames of a connection in order, so replies are matched to
+// requests by position and need no tags. Separate calls may go out on different connections
+// and complete in any order; requests that depend on each other belong in one Batch, which
+// always stays on a single connection. Every call comes as a future and as a callback
+// variant; callbacks run on the I/O thread and must not block it.
+namespace client {
+    struct ClientConfig {
+        std::string host = "127.0.0.1";
+        int port = SERVER_PORT;
+        size_t connections = 2;
+        // requests waiting for a reply per connection, beyond that they queue in the client; a
+        // larger batch goes out in parts on one connection
+        size_t max_in_flight = 128;
+        // ask for HISTORY_ENCODING_GORILLA history replies, a fraction of the json size
+        bool compact_history = true;
+    };
+
+    // One reply frame as the server sent it
+    struct Reply {
+        enum Kind : uint8_t {
+            TEXT,
+            JSON,
+            ERROR,
+            // the connection broke before the reply arrived, body holds the reason
+            DISCONNECTED,
+            // never sent because the server would have split the frame, body holds the reason
+            REJECTED
+        };
+
+        Kind kind;
+        // without the prefix and MESSAGE_END
+        std::string body;
+
+        bool ok() const { return kind == TEXT || kind == JSON; }
+    };
+
+    // A typed call resolves to a value, or to the server's error text, the connection error or
+    // why the request was not sent
+    template<typename Value>
+    struct Result {
+        bool ok = false;
+        std::string error;
+        Value value{};
+    };
+
+    struct Quote {
+        std::string currency;
+        double value;
+        double relative_increase;
+        double absolute_increase;
+        std::string date;
+    };
+
+    struct HistoryPoint {
+        double value;
+        std::string date;
+    };
+
+    // Quote feed datagrams served again by FEED_GAP_FILL
+    struct GapFill {
+        // session of the feed the datagrams belong to
+        uint64_t session = 0;
+        // latest sequence the server has published
+        uint64_t last = 0;
+        // sequence of ticks.front(), later than requested when older ones were overwritten
+        uint64_t first = 0;
+        // consecutive sequences from first on
+        std::vector<server::feed::Tick> ticks;
+    };
+
+    using Callback = std::function<void(Reply &&)>;
+
+    template<typename Value>
+    using ResultCallback = std::function<void(Result<Value> &&)>;
+
+    // Requests sent back to back on one connection and completed together
+    class Batch {
+    public:
+        void add_currency(const std::string &currency);
+
+        void add_currency_value(const std::string &currency, double value);
+
+        void del_currency(const std::string &currency);
+
+        void list_currencies();
+
+        void currency_history(const std::string &currency, bool compact = true);
+
+        // Text containing MESSAGE_END would be two frames to the server: the whole batch is then
+        // REJECTED without sending any of it
+        void echo(const std::string &text);
+
+        size_t size() const { return count; }
+
+    private:
+        friend class FinClient;
+
+        std::string frames;
+        size_t count = 0;
+        std::string rejected;
+    };
+
+    class FinClient {
+    public:
+        explicit FinClient(ClientConfig config = {});
+
+        ~FinClient() {
+            close();
+        }
+
+        std::future<Result<std::string>> add_currency(const std::string &currency);
+
+        void add_currency(const std::string &currency, ResultCallback<std::string> done);
+
+        std::future<Result<std::string>> add_currency_value(const std::string &currency, double value);
+
+        void add_currency_value(const std::string &currency, double value, ResultCallback<std::string> done);
+
+        std::future<Result<std::string>> del_currency(const std::string &currency);
+
+        void del_currency(const std::string &currency, ResultCallback<std::string> done);
+
+        std::future<Result<std::vector<Quote>>> list_currencies();
+
+        void list_currencies(ResultCallback<std::vector<Quote>> done);
+
+        std::future<Result<std::vector<HistoryPoint>>> currency_history(const std::string &currency);
+
+        void currency_history(const std::string &currency, ResultCallback<std::vector<HistoryPoint>> done);
+
+        // Feed datagrams from..to again, at most FEED_GAP_FILL_MAX of them per call
+        std::future<Result<GapFill>> feed_gap_fill(uint64_t from, uint64_t to);
+
+        void feed_gap_fill(uint64_t from, uint64_t to, ResultCallback<GapFill> done);
+
+        // Fails without sending anything when text contains MESSAGE_END
+        std::future<Result<std::string>> echo(const std::string &text);
+
+        void echo(const std::string &text, ResultCallback<std::string> done);
+
+        // Replies in the order the batch was built
+        std::future<std::vector<Reply>> submit(Batch &&batch);
+
+        void submit(Batch &&batch, std::function<void(std::vector<Reply> &&)> done);
+
+        // Raw frame, prefix included and MESSAGE_END excluded. A frame containing MESSAGE_END is
+        // REJECTED: its extra reply would be matched to the next request on the connection
+        void send(std::string frame, Callback done);
+
+        // Fails whatever is still waiting with DISCONNECTED and joins the I/O thread
+        void close();
+
+        static Result<std::string> to_text(Reply &&reply);
+
+        static Result<std::vector<Quote>> to_quotes(Reply &&reply);
+
+        static Result<std::vector<HistoryPoint>> to_history(Reply &&reply);
+
+        static Result<GapFill> to_gap_fill(Reply &&reply);
+
+    private:
+        struct Submission {
+            // MESSAGE_END terminated frames
+            std::string frames;
+            std::vector<Callback> callbacks;
+            // set once the first part of a batch larger than max_in_flight went out, the rest
+            // follows on the same connection as room frees up
+            int connection = -1;
+            uint32_t generation = 0;
+        };
+
+        struct Connection {
+            int descriptor = -1;
+            // counts reconnects, a batch split across a reconnect must not continue on the new one
+            uint32_t generation = 0;
+            bool connected = false;
+            std::string out;
+            size_t out_offset = 0;
+            std::string in;
+            // one per frame written or queued in out, in order
+            std::deque<Callback> waiting;
+        };
+
+        void io_loop();
+
+        // Sends as much of the submission as max_in_flight allows. False when something is left to
+        // send later, all of it when every connection is full, or the rest of a large batch
+        bool dispatch(Submission &submission);
+
+        bool open_connection(Connection &connection);
+
+        void drop_connection(Connection &connection, const std::string &reason);
+
+        void flush(Connection &connection);
+
+        void read_replies(Connection &connection);
+
+        void update_interest(Connection &connection);
+
+        template<typename Value>
+        void call(std::string frame, ResultCallback<Value> done, Result<Value> (*convert)(Reply &&));
+
+        template<typename Value>
+        std::future<Result<Value>> call(std::string frame, Result<Value> (*convert)(Reply &&));
+
+        ClientConfig config;
+        std::vector<Connection> connections;
+        // submissions that found every connection at max_in_flight
+        std::deque<Submission> backlog;
+        int epoll_descriptor;
+        int wakeup_descriptor;
+        std::mutex submit_mutex;
+        std::vector<Submission> submitted;
+        bool closing;
+        std::thread io_thread;
+    };
+}
+
+#endif //ECHOSERVER_FIN_CLIENT_H
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "defines.h"
+#include "capture/capture.h"
+#include "protocol/framing.h"
+#include "json/src/json.hpp"
+
+using replay_clock = std::chrono::steady_clock;
+
+struct ReplayOptions {
+    std::string capture_path;
+    std::string host = "127.0.0.1";
+    int port = SERVER_PORT;
+    bool paced = true;
+    double speed = 1.0;
+    int timeout_ms = 5000;
+    std::string report_path;
+    std::string baseline_path;
+};
+
+struct ConnectionStats {
+    std::vector<double> latencies_us;
+    std::vector<double> pacing_lag_us;
+    uint64_t sent = 0;
+    uint64_t errors = 0;
+};
+
+int connect_to_server(const ReplayOptions &options) {
+    auto &&sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    auto &&server = gethostbyname(options.host.c_str());
+    if (server == nullptr) {
+        close(sock);
+        return -1;
+    }
+    sockaddr_in server_address{};
+    server_address.sin_family = AF_INET;
+    memcpy(&server_address.sin_addr.s_addr, server->h_addr, static_cast<size_t>(server->h_length));
+    server_address.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (connect(sock, reinterpret_cast<sockaddr *>(&server_address), sizeof(server_address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    timeval timeout{options.timeout_ms / 1000, (options.timeout_ms % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+bool send_all(int sock, const std::string &data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        auto &&count = send(sock, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (count <= 0) return false;
+        offset += count;
+    }
+    return true;
+}
+
+bool receive_reply(int sock, std::string &buffer, std::string &reply) {
+    char read_buffer[MESSAGE_SIZE];
+    while (!protocol::extract_frame(buffer, reply)) {
+        auto &&count = recv(sock, read_buffer, MESSAGE_SIZE, 0);
+        if (count <= 0) return false;
+        buffer.append(read_buffer, static_cast<size_t>(count));
+    }
+    return true;
+}
+
+// Every connection is replayed closed-loop: the next frame goes out once the previous reply arrived,
+// and in paced mode not before its recorded offset
+void replay_connection(const ReplayOptions &options, const std::vector<capture::Record> &records,
+                       replay_clock::time_point replay_start, ConnectionStats &stats) {
+    auto &&sock = connect_to_server(options);
+    if (sock < 0) {
+        std::cerr << "Cannot connect to " << options.host << ":" << options.port << std::endl;
+        stats.errors += records.size();
+        return;
+    }
+    std::string buffer, reply, frame;
+    for (auto &&record : records) {
+        if (options.paced) {
+            auto &&offset = std::chrono::nanoseconds(static_cast<int64_t>(record.timestamp_ns / options.speed));
+            auto &&due = replay_start + offset;
+            std::this_thread::sleep_until(due);
+            std::chrono::duration<double, std::micro> lag = replay_clock::now() - due;
+            stats.pacing_lag_us.push_back(lag.count());
+        }
+        frame = record.frame + MESSAGE_END;
+        auto &&sent_at = replay_clock::now();
+        if (!send_all(sock, frame)) {
+            stats.errors++;
+            break;
+        }
+        stats.sent++;
+        if (record.frame == CMD_PREFIX "disconnect") break;
+        if (!receive_reply(sock, buffer, reply)) {
+            stats.errors++;
+            break;
+        }
+        std::chrono::duration<double, std::micro> latency = replay_clock::now() - sent_at;
+        stats.latencies_us.push_back(latency.count());
+    }
+    close(sock);
+}
+
+double percentile(std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    auto &&index = static_cast<size_t>(fraction * (sorted.size() - 1));
+    return sorted[index];
+}
+
+void print_difference(const nlohmann::json &report, const nlohmann::json &baseline, const char *key) {
+    double current = report[key], old = baseline.value(key, 0.0);
+    std::cout << std::left << std::setw(24) << key << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << old << std::setw(14) << current;
+    if (old != 0) std::cout << std::showpos << std::setw(10) << (current - old) / old * 100.0 << std::noshowpos << " %";
+    std::cout << std::endl;
+}
+
+void usage() {
+    std::cout << "replay capture_file [--host host] [--port port] [--fast] [--speed factor]\n"
+              << "       [--timeout-ms ms] [--report report.json] [--baseline old_report.json]\n"
+              << "  --fast: ignore recorded pacing and send as soon as the previous reply arrived\n"
+              << "  --speed: compress (>1) or stretch (<1) the recorded pacing" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    ReplayOptions options;
+    for (auto &&i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto &&has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) options.host = argv[++i];
+        else if (arg == "--port" && has_value) options.port = std::stoi(argv[++i]);
+        else if (arg == "--fast") options.paced = false;
+        else if (arg == "--speed" && has_value) options.speed = std::max(0.001, std::stod(argv[++i]));
+        else if (arg == "--timeout-ms" && has_value) options.timeout_ms = std::stoi(argv[++i]);
+        else if (arg == "--report" && has_value) options.report_path = argv[++i];
+        else if (arg == "--baseline" && has_value) options.baseline_path = argv[++i];
+        else if (arg[0] != '-' && options.capture_path.empty()) options.capture_path = arg;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.capture_path.empty()) {
+        usage();
+        return 1;
+    }
+
+    capture::CaptureReader reader;
+    if (!reader.open(options.capture_path)) return 1;
+    std::map<uint32_t, std::vector<capture::Record>> connections;
+    capture::Record record;
+    uint64_t recorded_frames = 0, recorded_duration_ns = 0;
+    while (reader.next(record)) {
+        recorded_duration_ns = std::max(recorded_duration_ns, record.timestamp_ns);
+        connections[record.connection_id].push_back(record);
+        recorded_frames++;
+    }
+    std::cout << "Replaying " << recorded_frames << " frames from " << connections.size() << " connections" << std::endl;
+
+    std::vector<ConnectionStats> stats(connections.size());
+    std::vector<std::thread> threads;
+    auto &&replay_start = replay_clock::now();
+    size_t index = 0;
+    for (auto &&[connection_id, records] : connections) {
+        threads.emplace_back(replay_connection, std::cref(options), std::cref(records), replay_start,
+                             std::ref(stats[index++]));
+    }
+    for (auto &&thread : threads) thread.join();
+    std::chrono::duration<double> elapsed = replay_clock::now() - replay_start;
+
+    ConnectionStats total;
+    for (auto &&connection : stats) {
+        total.latencies_us.insert(total.latencies_us.end(), connection.latencies_us.begin(), connection.latencies_us.end());
+        total.pacing_lag_us.insert(total.pacing_lag_us.end(), connection.pacing_lag_us.begin(), connection.pacing_lag_us.end());
+        total.sent += connection.sent;
+        total.errors += connection.errors;
+    }
+    std::sort(total.latencies_us.begin(), total.latencies_us.end());
+    std::sort(total.pacing_lag_us.begin(), total.pacing_lag_us.end());
+
+    nlohmann::json report = {
+            {"capture",              options.capture_path},
+            {"mode",                 options.paced ? "paced" : "fast"},
+            {"connections",          connections.size()},
+            {"frames_sent",          total.sent},
+            {"replies",              total.latencies_us.size()},
+            {"errors",               total.errors},
+            {"recorded_duration_s",  recorded_duration_ns / 1e9},
+            {"replay_duration_s",    elapsed.count()},
+            {"throughput_rps",       total.latencies_us.size() / elapsed.count()},
+            {"latency_p50_us",       percentile(total.latencies_us, 0.50)},
+            {"latency_p90_us",       percentile(total.latencies_us, 0.90)},
+            {"latency_p99_us",       percentile(total.latencies_us, 0.99)},
+            {"latency_max_us",       total.latencies_us.empty() ? 0.0 : total.latencies_us.back()},
+            {"pacing_lag_p99_us",    percentile(total.pacing_lag_us, 0.99)}
+    };
+    std::cout << report.dump(4) << std::endl;
+    if (!options.report_path.empty()) {
+        std::ofstream report_file(options.report_path);
+        report_file << report.dump(4) << std::endl;
+    }
+
+    if (!options.baseline_path.empty()) {
+        std::ifstream baseline_file(options.baseline_path);
+        if (!baseline_file) {
+            std::cerr << "Cannot open baseline " << options.baseline_path << std::endl;
+            return 1;
+        }
+        auto &&baseline = nlohmann::json::parse(baseline_file);
+        std::cout << std::left << std::setw(24) << "" << std::right << std::setw(14) << "baseline"
+                  << std::setw(14) << "current" << std::endl;
+        for (auto &&key : {"throughput_rps", "latency_p50_us", "latency_p90_us", "latency_p99_us", "latency_max_us"}) {
+            print_difference(report, baseline, key);
+        }
+    }
+    return total.errors == 0 ? 0 : 2;
+}
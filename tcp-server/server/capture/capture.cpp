@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "capture.h"
+
+namespace {
+    uint64_t monotonic_ns() {
+        auto &&now = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    }
+}
+
+bool capture::CaptureWriter::open(const std::string &path) {
+    std::unique_lock<std::mutex> lock(file_mutex);
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot open capture file " << path << std::endl;
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    auto &&wall_now = std::chrono::system_clock::now().time_since_epoch();
+    uint64_t wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_now).count());
+    start_ns = monotonic_ns();
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, file);
+    fwrite(&wall_ns, sizeof(wall_ns), 1, file);
+    return true;
+}
+
+void capture::CaptureWriter::record(uint32_t connection_id, std::string_view frame) {
+    uint64_t timestamp = monotonic_ns() - start_ns;
+    auto &&length = static_cast<uint32_t>(frame.size());
+    std::unique_lock<std::mutex> lock(file_mutex);
+    if (!file) return;
+    fwrite(&connection_id, sizeof(connection_id), 1, file);
+    fwrite(&timestamp, sizeof(timestamp), 1, file);
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(frame.data(), 1, frame.size(), file);
+}
+
+void capture::CaptureWriter::close() {
+    std::unique_lock<std::mutex> lock(file_mutex);
+    if (!file) return;
+    fclose(file);
+    file = nullptr;
+}
+
+bool capture::CaptureReader::open(const std::string &path) {
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Cannot open capture file " << path << std::endl;
+        return false;
+    }
+    char magic[CAPTURE_MAGIC_LEN];
+    if (fread(magic, 1, CAPTURE_MAGIC_LEN, file) != CAPTURE_MAGIC_LEN ||
+        memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0 ||
+        fread(&start_wall_ns, sizeof(start_wall_ns), 1, file) != 1) {
+        std::cerr << "Not a capture file " << path << std::endl;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool capture::CaptureReader::next(Record &record) {
+    if (!file) return false;
+    uint32_t length = 0;
+    if (fread(&record.connection_id, sizeof(record.connection_id), 1, file) != 1 ||
+        fread(&record.timestamp_ns, sizeof(record.timestamp_ns), 1, file) != 1 ||
+        fread(&length, sizeof(length), 1, file) != 1) {
+        return false;
+    }
+    record.frame.resize(length);
+    return fread(&record.frame[0], 1, length, file) == length;
+}
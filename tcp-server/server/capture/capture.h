@@ -0,0 +1,67 @@
+#ifndef ECHOSERVER_CAPTURE_H
+#define ECHOSERVER_CAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Capture file layout (host byte order):
+//   header: "FINCAP01" magic, uint64 wall clock start in ns since epoch
+//   record: uint32 connection id, uint64 arrival ns since capture start, uint32 length, frame bytes
+// Frames are stored with their prefix and without MESSAGE_END.
+namespace capture {
+    const char CAPTURE_MAGIC[] = "FINCAP01";
+    const size_t CAPTURE_MAGIC_LEN = 8;
+
+    struct Record {
+        uint32_t connection_id;
+        uint64_t timestamp_ns;
+        std::string frame;
+    };
+
+    class CaptureWriter {
+    public:
+        CaptureWriter() : file(nullptr), start_ns(0) {}
+
+        ~CaptureWriter() {
+            close();
+        }
+
+        bool open(const std::string &path);
+
+        void record(uint32_t connection_id, std::string_view frame);
+
+        void close();
+
+        bool is_open() const { return file != nullptr; }
+
+    private:
+        FILE *file;
+        uint64_t start_ns;
+        std::mutex file_mutex;
+    };
+
+    class CaptureReader {
+    public:
+        CaptureReader() : file(nullptr), start_wall_ns(0) {}
+
+        ~CaptureReader() {
+            if (file) fclose(file);
+        }
+
+        bool open(const std::string &path);
+
+        // Returns false at the end of the capture or on a truncated record
+        bool next(Record &record);
+
+        uint64_t start_wall_clock_ns() const { return start_wall_ns; }
+
+    private:
+        FILE *file;
+        uint64_t start_wall_ns;
+    };
+}
+
+#endif //ECHOSERVER_CAPTURE_H
@@ -1,5 +1,7 @@
 #include <c++/5/iostream>
+#include <ctime>
 #include "findb.h"
+#include "tracing/trace.h"
 
 std::tm parse_date(const std::string &date_str) {
     std::tm datetime = {};
@@ -8,11 +10,24 @@ std::tm parse_date(const std::string &date_str) {
     return datetime;
 }
 
-void findb::reset() {
+std::string format_date(time_t time) {
+    std::stringstream date;
+    date << std::put_time(std::localtime(&time), "%Y-%b-%d %H:%M:%S");
+    return date.str();
+}
+
+std::string current_date() {
+    return format_date(time(nullptr));
+}
+
+void findb::reset(const std::string &path) {
     try {
         std::cout <<  "Resetting database" << std::endl;
-        SQLite::Database db("finance.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        SQLite::Database db(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
         db.exec("DROP TABLE IF EXISTS finance");
+        db.exec("DROP TABLE IF EXISTS replication_state");
+        db.exec("DROP TABLE IF EXISTS journal_state");
+        db.exec("DROP TABLE IF EXISTS symbols");
         SQLite::Transaction transaction(db);
         db.exec("CREATE TABLE finance ("
                         " id INTEGER PRIMARY KEY,"
@@ -20,17 +35,49 @@ void findb::reset() {
                         " value REAL,"
                         " inc_rel REAL,"
                         " inc_abs REAL,"
-                        " date TEXT"
+                        " date TEXT,"
+                        " resolution INTEGER NOT NULL DEFAULT 0,"
+                        " currency_id INTEGER"
                         ")");
+        db.exec("CREATE TABLE symbols (id INTEGER PRIMARY KEY, currency TEXT NOT NULL UNIQUE)");
         transaction.commit();
     } catch (std::exception &ex) {
         std::cerr <<  "DB exception:" << ex.what() << std::endl;
     }
 }
 
+void findb::upgrade_schema() {
+    try {
+        auto &&has_resolution = false;
+        auto &&has_currency_id = false;
+        SQLite::Statement columns(*db_ptr, "PRAGMA table_info(finance)");
+        while (columns.executeStep()) {
+            auto &&column = columns.getColumn(1).getString();
+            if (column == "resolution") has_resolution = true;
+            if (column == "currency_id") has_currency_id = true;
+        }
+        SQLite::Transaction transaction(*db_ptr);
+        if (!has_resolution) db_ptr->exec("ALTER TABLE finance ADD COLUMN resolution INTEGER NOT NULL DEFAULT 0");
+        if (!has_currency_id) db_ptr->exec("ALTER TABLE finance ADD COLUMN currency_id INTEGER");
+        db_ptr->exec("CREATE TABLE IF NOT EXISTS symbols (id INTEGER PRIMARY KEY, currency TEXT NOT NULL UNIQUE)");
+        // history, del_currency and write_value look rows up by currency id, the compactor by resolution
+        db_ptr->exec("DROP INDEX IF EXISTS finance_currency");
+        db_ptr->exec("CREATE INDEX IF NOT EXISTS finance_symbol ON finance (currency_id)");
+        db_ptr->exec("CREATE INDEX IF NOT EXISTS finance_resolution ON finance (resolution, id)");
+        // rows written before currencies had ids, in the order the currencies first appeared
+        db_ptr->exec("INSERT OR IGNORE INTO symbols (currency) SELECT currency FROM finance"
+                             " WHERE currency_id IS NULL GROUP BY currency ORDER BY MIN(id)");
+        db_ptr->exec("UPDATE finance SET currency_id = (SELECT id FROM symbols WHERE symbols.currency = finance.currency)"
+                             " WHERE currency_id IS NULL");
+        transaction.commit();
+    } catch (std::exception &ex) {
+        std::cerr << "DB schema exception:" << ex.what() << std::endl;
+    }
+}
+
 int findb::insert(FinanceUnit &financeUnit) {
     std::stringstream sql_builder;
-    sql_builder << "INSERT INTO finance VALUES ("
+    sql_builder << "INSERT INTO finance (id, currency, value, inc_rel, inc_abs, date) VALUES ("
                 << "NULL" << ","
                 << "\"" << financeUnit.currency << "\","
                 << financeUnit.value << ","
@@ -53,29 +100,20 @@ int findb::insert(FinanceUnit &financeUnit) {
 }
 
 int findb::add_currency(std::string &currency) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
     try {
-        SQLite::Statement query(*db_ptr, "SELECT count(*) FROM finance WHERE currency = ?");
-        query.bind(1, currency);
-        query.executeStep();
-        int count = query.getColumn(0);
-        if (count != 0) return 1;
-        auto &&_time = time(nullptr);
-        auto &&timev = std::localtime(&_time);
-        std::stringstream sql_builder;
-        sql_builder << "INSERT INTO finance VALUES ("
-                    << "NULL" << ","
-                    << "\"" << currency << "\","
-                    << "NULL" << ","
-                    << "NULL" << ","
-                    << "NULL" << ","
-                    << "\"" << std::put_time(timev, "%Y-%b-%d %H:%M:%S") << "\""
-                    << ")";
-        auto &&sql = sql_builder.str();
-       // std::cerr <<  info(sql) << std::endl;
+        FinanceChange change{FinanceChange::INSERT_ROW, 0, currency, false, 0, 0, 0, current_date()};
         std::unique_lock<std::mutex> lock(db_mutex);
+        server::tracing::mark(server::tracing::DB_LOCKED);
+        // checked under the lock, two clients adding the same currency get one row
+        if (symbols.is_live(symbols.find(currency))) return 1;
         SQLite::Transaction transaction(*db_ptr);
-        db_ptr->exec(sql);
+        change.symbol = intern(currency);
+        write_change(change);
+        change.id = db_ptr->getLastInsertRowid();
         transaction.commit();
+        note_change(change);
+        if (change_listener) change_listener(change);
         lock.unlock();
 
     } catch (std::exception &ex) {
@@ -85,53 +123,17 @@ int findb::add_currency(std::string &currency) {
     return 0;
 }
 
-int findb::add_currency_value(std::string &currency, double value) {
-    try {
-        SQLite::Statement query(*db_ptr, "SELECT id, value, "
-                "CASE WHEN value IS NULL THEN 1 ELSE 0 END"
-                " FROM finance WHERE currency = ? ORDER BY date DESC");
-        query.bind(1, currency);
-        //std::cout <<  info(query.getQuery()) << std::endl;
-        auto &&status = query.executeStep();
-        if (!status) return 1;
-        int id = query.getColumn(0);
-        double cur_value = query.getColumn(1);
-        int is_new = query.getColumn(2);
-        double relative = 0, absolute = 0;
-        if (!is_new) {
-            absolute = value - cur_value;
-            relative = absolute / cur_value;
-        }
-        auto &&_time = time(nullptr);
-        auto &&timev = std::localtime(&_time);
-        std::stringstream sql_builder;
-        sql_builder << "(";
-        if (!is_new) {
-            sql_builder << "NULL,"
-                        << "\"" << currency << "\",";
-        }
-        sql_builder << value << ","
-                    << relative << ","
-                    << absolute << ","
-                    << "\"" << std::put_time(timev, "%Y-%b-%d %H:%M:%S") << "\""
-                    << ")";
-        auto &&sql_value = sql_builder.str();
-        sql_builder.str("");
-        if (is_new) {
-            sql_builder << "UPDATE finance SET"
-                        << "(value, inc_rel, inc_abs, date) = "
-                        << sql_value
-                        << "WHERE id = "
-                        << id;
-        } else {
-            sql_builder << "INSERT INTO finance VALUES" << sql_value;
-        }
-        auto &&sql = sql_builder.str();
-      //  std::cout <<  info(sql) << std::endl;
+int findb::add_currency_value(SymbolId symbol, double value) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
+    try {
+        FinanceChange change{};
         std::unique_lock<std::mutex> lock(db_mutex);
+        server::tracing::mark(server::tracing::DB_LOCKED);
         SQLite::Transaction transaction(*db_ptr);
-        db_ptr->exec(sql);
+        auto &&status = write_value(symbol, value, current_date(), change);
+        if (status != 0) return status;
         transaction.commit();
+        if (change_listener) change_listener(change);
         lock.unlock();
     } catch (std::exception &ex) {
         std::cerr << "DB select exception:" << ex.what() << std::endl;
@@ -140,15 +142,129 @@ int findb::add_currency_value(std::string &currency, double value) {
     return 0;
 }
 
-int findb::del_currency(std::string &currency) {
+int findb::write_value(SymbolId symbol, double value, const std::string &date, FinanceChange &change) {
+    if (!symbols.is_live(symbol)) return 1;
+    SQLite::Statement query(*db_ptr, "SELECT id, value, "
+            "CASE WHEN value IS NULL THEN 1 ELSE 0 END"
+            " FROM finance WHERE currency_id = ? ORDER BY date DESC");
+    query.bind(1, static_cast<int64_t>(symbol));
+    //std::cout <<  info(query.getQuery()) << std::endl;
+    auto &&status = query.executeStep();
+    if (!status) return 1;
+    int id = query.getColumn(0);
+    double cur_value = query.getColumn(1);
+    int is_new = query.getColumn(2);
+    double relative = 0, absolute = 0;
+    if (!is_new) {
+        absolute = value - cur_value;
+        relative = absolute / cur_value;
+    }
+    // the first value fills the row added with the currency, later ones append rows
+    change = {is_new ? FinanceChange::UPDATE_ROW : FinanceChange::INSERT_ROW, is_new ? id : 0,
+              symbols.name(symbol), true, value, relative, absolute, date, symbol};
+    write_change(change);
+    if (!is_new) change.id = db_ptr->getLastInsertRowid();
+    return 0;
+}
+
+int findb::add_currency_values(const std::vector<CurrencyTick> &ticks) {
+    if (ticks.empty()) return 0;
     try {
+        std::vector<FinanceChange> changes;
+        changes.reserve(ticks.size());
         std::unique_lock<std::mutex> lock(db_mutex);
-        SQLite::Statement query(*db_ptr, "DELETE FROM finance WHERE currency = ?");
-        query.bind(1, currency);
-       // std::cout << info(query.getQuery())  << std::endl;
         SQLite::Transaction transaction(*db_ptr);
-        auto &&count = query.exec();
+        db_ptr->exec("CREATE TABLE IF NOT EXISTS journal_state (id INTEGER PRIMARY KEY, sequence INTEGER)");
+        uint64_t stored_sequence = 0;
+        SQLite::Statement stored(*db_ptr, "SELECT sequence FROM journal_state WHERE id = 0");
+        if (stored.executeStep()) stored_sequence = static_cast<uint64_t>(stored.getColumn(0).getInt64());
+        // a tick replayed twice, by a second process or after a lost checkpoint, is applied once
+        if (ticks.back().sequence <= stored_sequence) return 0;
+        for (auto &&tick : ticks) {
+            if (tick.sequence <= stored_sequence) continue;
+            FinanceChange change{};
+            auto &&symbol = tick.symbol != NO_SYMBOL ? tick.symbol : symbols.find(tick.currency);
+            if (write_value(symbol, tick.value, format_date(tick.time), change) == 0) {
+                changes.push_back(std::move(change));
+            }
+        }
+        SQLite::Statement query(*db_ptr, "INSERT OR REPLACE INTO journal_state VALUES (0, ?)");
+        query.bind(1, static_cast<int64_t>(ticks.back().sequence));
+        query.exec();
         transaction.commit();
+        if (change_listener) {
+            for (auto &&change : changes) change_listener(change);
+        }
+        lock.unlock();
+    } catch (std::exception &ex) {
+        std::cerr << "DB journal apply exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::journal_sequence(uint64_t &sequence) {
+    sequence = 0;
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        db_ptr->exec("CREATE TABLE IF NOT EXISTS journal_state (id INTEGER PRIMARY KEY, sequence INTEGER)");
+        SQLite::Statement query(*db_ptr, "SELECT sequence FROM journal_state WHERE id = 0");
+        if (query.executeStep()) sequence = static_cast<uint64_t>(query.getColumn(0).getInt64());
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+SymbolId findb::intern(const std::string &currency) {
+    auto &&symbol = symbols.find(currency);
+    if (symbol != NO_SYMBOL) return symbol;
+    // interned by a transaction that was rolled back after all
+    SQLite::Statement query(*db_ptr, "SELECT id FROM symbols WHERE currency = ?");
+    query.bind(1, currency);
+    if (query.executeStep()) return static_cast<SymbolId>(query.getColumn(0).getInt64());
+    SQLite::Statement insert(*db_ptr, "INSERT INTO symbols (currency) VALUES (?)");
+    insert.bind(1, currency);
+    insert.exec();
+    auto &&id = db_ptr->getLastInsertRowid();
+    if (id <= 0 || id >= SymbolTable::MAX_SYMBOLS) throw std::runtime_error("symbol table full");
+    return static_cast<SymbolId>(id);
+}
+
+void findb::note_change(const FinanceChange &change) {
+    if (change.symbol == NO_SYMBOL) return;
+    symbols.assign(change.symbol, change.currency);
+    symbols.set_live(change.symbol, change.kind != FinanceChange::DELETE_CURRENCY);
+}
+
+void findb::load_symbols() {
+    try {
+        SQLite::Statement names(*db_ptr, "SELECT id, currency FROM symbols");
+        while (names.executeStep()) {
+            symbols.assign(static_cast<SymbolId>(names.getColumn(0).getInt64()), names.getColumn(1).getString());
+        }
+        for (SymbolId symbol = NO_SYMBOL + 1; symbol < symbols.end(); ++symbol) symbols.set_live(symbol, false);
+        SQLite::Statement live(*db_ptr, "SELECT DISTINCT currency_id FROM finance");
+        while (live.executeStep()) symbols.set_live(static_cast<SymbolId>(live.getColumn(0).getInt64()), true);
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+    }
+}
+
+int findb::del_currency(SymbolId symbol) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
+    try {
+        FinanceChange change{FinanceChange::DELETE_CURRENCY, 0, symbols.name(symbol), false, 0, 0, 0, "", symbol};
+        std::unique_lock<std::mutex> lock(db_mutex);
+        server::tracing::mark(server::tracing::DB_LOCKED);
+        if (!symbols.is_live(symbol)) return 1;
+        SQLite::Transaction transaction(*db_ptr);
+        write_change(change);
+        auto &&count = db_ptr->getChanges();
+        transaction.commit();
+        note_change(change);
+        if (count != 0 && change_listener) change_listener(change);
         lock.unlock();
         if (count == 0) return 1;
     }
@@ -159,7 +275,235 @@ int findb::del_currency(std::string &currency) {
     return 0;
 }
 
+void findb::write_change(const FinanceChange &change) {
+    if (change.kind == FinanceChange::DELETE_CURRENCY) {
+        SQLite::Statement query(*db_ptr, "DELETE FROM finance WHERE currency_id = ?");
+        query.bind(1, static_cast<int64_t>(change.symbol));
+        query.exec();
+        return;
+    }
+    SQLite::Statement query(*db_ptr, change.kind == FinanceChange::INSERT_ROW ?
+            "INSERT INTO finance (currency, value, inc_rel, inc_abs, date, id, currency_id) VALUES (?, ?, ?, ?, ?, ?, ?)" :
+            "UPDATE finance SET currency = ?, value = ?, inc_rel = ?, inc_abs = ?, date = ?, currency_id = ?7 WHERE id = ?6");
+    query.bind(1, change.currency);
+    if (change.has_value) {
+        query.bind(2, change.value);
+        query.bind(3, change.inc_rel);
+        query.bind(4, change.inc_abs);
+    } else {
+        query.bind(2);
+        query.bind(3);
+        query.bind(4);
+    }
+    query.bind(5, change.date);
+    // a local insert leaves the id to sqlite, a replicated one keeps the primary's id
+    if (change.id) query.bind(6, change.id);
+    else query.bind(6);
+    query.bind(7, static_cast<int64_t>(change.symbol));
+    query.exec();
+}
+
+void findb::set_change_listener(std::function<void(const FinanceChange &)> listener) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    change_listener = std::move(listener);
+}
+
+int findb::latest_rows(std::vector<FinanceChange> &rows) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Statement query(*db_ptr, "SELECT id, currency, value IS NOT NULL, value, inc_rel, inc_abs, date,"
+                " currency_id FROM finance WHERE id IN (SELECT MAX(id) FROM finance GROUP BY currency_id) ORDER BY id");
+        while (query.executeStep()) {
+            rows.push_back({FinanceChange::INSERT_ROW, query.getColumn(0).getInt64(), query.getColumn(1).getString(),
+                            query.getColumn(2).getInt() != 0, query.getColumn(3).getDouble(),
+                            query.getColumn(4).getDouble(), query.getColumn(5).getDouble(),
+                            query.getColumn(6).getString(), static_cast<SymbolId>(query.getColumn(7).getInt64())});
+        }
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::snapshot(std::vector<FinanceChange> &rows, const std::function<void()> &at_snapshot) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Statement query(*db_ptr, "SELECT id, currency, value IS NOT NULL, value, inc_rel, inc_abs, date,"
+                " currency_id FROM finance ORDER BY id");
+        while (query.executeStep()) {
+            rows.push_back({FinanceChange::INSERT_ROW, query.getColumn(0).getInt64(), query.getColumn(1).getString(),
+                            query.getColumn(2).getInt() != 0, query.getColumn(3).getDouble(),
+                            query.getColumn(4).getDouble(), query.getColumn(5).getDouble(),
+                            query.getColumn(6).getString(), static_cast<SymbolId>(query.getColumn(7).getInt64())});
+        }
+        at_snapshot();
+    } catch (std::exception &ex) {
+        std::cerr << "DB snapshot exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::install_snapshot(const std::vector<FinanceChange> &rows, uint64_t log_id, uint64_t position) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Transaction transaction(*db_ptr);
+        db_ptr->exec("DELETE FROM finance");
+        // the primary's ids for the names mean nothing here
+        std::vector<FinanceChange> installed(rows);
+        for (auto &&row : installed) {
+            row.symbol = intern(row.currency);
+            write_change(row);
+        }
+        store_position(log_id, position);
+        transaction.commit();
+        std::vector<SymbolId> replaced;
+        for (SymbolId symbol = NO_SYMBOL + 1; change_listener && symbol < symbols.end(); ++symbol) {
+            if (symbols.is_live(symbol)) replaced.push_back(symbol);
+        }
+        load_symbols();
+        if (change_listener) {
+            for (auto &&symbol : replaced) {
+                change_listener({FinanceChange::DELETE_CURRENCY, 0, symbols.name(symbol), false, 0, 0, 0, "", symbol});
+            }
+            // rows come in id order, the last one of a currency is its newest
+            std::vector<const FinanceChange *> newest(symbols.end(), nullptr);
+            for (auto &&row : installed) newest[row.symbol] = &row;
+            for (auto &&row : installed) {
+                if (newest[row.symbol] == &row) change_listener(row);
+            }
+        }
+    } catch (std::exception &ex) {
+        std::cerr << "DB snapshot exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::apply_change(const FinanceChange &change, uint64_t log_id, uint64_t position) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Transaction transaction(*db_ptr);
+        FinanceChange local = change;
+        // a deleted name that was never seen here deletes nothing
+        local.symbol = change.kind == FinanceChange::DELETE_CURRENCY ? symbols.find(change.currency)
+                                                                     : intern(change.currency);
+        write_change(local);
+        store_position(log_id, position);
+        transaction.commit();
+        note_change(local);
+        if (change_listener) change_listener(local);
+    } catch (std::exception &ex) {
+        std::cerr << "DB apply exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::replication_position(uint64_t &log_id, uint64_t &position) {
+    log_id = position = 0;
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        db_ptr->exec("CREATE TABLE IF NOT EXISTS replication_state ("
+                             " id INTEGER PRIMARY KEY,"
+                             " log_id INTEGER,"
+                             " position INTEGER"
+                             ")");
+        SQLite::Statement query(*db_ptr, "SELECT log_id, position FROM replication_state WHERE id = 0");
+        if (query.executeStep()) {
+            log_id = static_cast<uint64_t>(query.getColumn(0).getInt64());
+            position = static_cast<uint64_t>(query.getColumn(1).getInt64());
+        }
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// The state table is created by replication_position, which a follower reads before applying anything
+void findb::store_position(uint64_t log_id, uint64_t position) {
+    SQLite::Statement query(*db_ptr, "INSERT OR REPLACE INTO replication_state VALUES (0, ?, ?)");
+    query.bind(1, static_cast<int64_t>(log_id));
+    query.bind(2, static_cast<int64_t>(position));
+    query.exec();
+}
+
+int findb::retained_rows(uint32_t resolution, int64_t after_id, size_t limit, std::vector<RetainedRow> &rows) {
+    rows.clear();
+    try {
+        // one connection: unlocked, the select would see and be aborted by a writer's open transaction
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Statement query(*db_ptr, "SELECT id, currency_id, date FROM finance"
+                " WHERE resolution = ? AND id > ? AND value IS NOT NULL ORDER BY id LIMIT ?");
+        query.bind(1, static_cast<int64_t>(resolution));
+        query.bind(2, after_id);
+        query.bind(3, static_cast<int64_t>(limit));
+        while (query.executeStep()) {
+            rows.push_back({query.getColumn(0).getInt64(), static_cast<SymbolId>(query.getColumn(1).getInt64()),
+                            query.getColumn(2).getString()});
+        }
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::newest_retained(SymbolId symbol, uint32_t resolution, RetainedRow &row) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Statement query(*db_ptr, "SELECT id, currency_id, date FROM finance"
+                " WHERE currency_id = ? AND resolution = ? AND value IS NOT NULL ORDER BY id DESC LIMIT 1");
+        query.bind(1, static_cast<int64_t>(symbol));
+        query.bind(2, static_cast<int64_t>(resolution));
+        if (!query.executeStep()) return 1;
+        row = {query.getColumn(0).getInt64(), static_cast<SymbolId>(query.getColumn(1).getInt64()),
+               query.getColumn(2).getString()};
+    } catch (std::exception &ex) {
+        std::cerr << "DB select exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int findb::downsample(const std::vector<int64_t> &kept, const std::vector<int64_t> &dropped, uint32_t resolution) {
+    try {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        SQLite::Transaction transaction(*db_ptr);
+        SQLite::Statement promote(*db_ptr, "UPDATE finance SET resolution = ? WHERE id = ?");
+        for (auto &&id : kept) {
+            promote.bind(1, static_cast<int64_t>(resolution));
+            promote.bind(2, id);
+            promote.exec();
+            promote.reset();
+        }
+        SQLite::Statement remove(*db_ptr, "DELETE FROM finance WHERE id = ?");
+        for (auto &&id : dropped) {
+            remove.bind(1, id);
+            remove.exec();
+            remove.reset();
+        }
+        transaction.commit();
+    } catch (std::exception &ex) {
+        std::cerr << "DB downsample exception:" << ex.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int64_t findb::date_time(const std::string &date) {
+    // strptime instead of parse_date's stream, the feed converts every published value
+    std::tm datetime{};
+    if (!strptime(date.c_str(), "%Y-%b-%d %H:%M:%S", &datetime) || !datetime.tm_year) return -1;
+    // stored dates are local time, see format_date
+    datetime.tm_isdst = -1;
+    return static_cast<int64_t>(mktime(&datetime));
+}
+
 int findb::currency_list(nlohmann::json &json) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
     try {
         SQLite::Statement query(*db_ptr, "SELECT currency, value, inc_rel, inc_abs, date FROM finance");
         //std::cout << info(query.getQuery()) << std::endl;
@@ -186,10 +530,11 @@ int findb::currency_list(nlohmann::json &json) {
     return 0;
 }
 
-int findb::currency_history(std::string &curr, nlohmann::json &json) {
+int findb::currency_history(SymbolId symbol, nlohmann::json &json) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
     try {
-        SQLite::Statement query(*db_ptr, "SELECT value, date FROM finance WHERE currency = ?");
-        query.bind(1, curr);
+        SQLite::Statement query(*db_ptr, "SELECT value, date FROM finance WHERE currency_id = ?");
+        query.bind(1, static_cast<int64_t>(symbol));
         //std::cout << info(query.getQuery()) << std::endl;
         nlohmann::json result;
         while (query.executeStep()) {
@@ -202,7 +547,7 @@ int findb::currency_history(std::string &curr, nlohmann::json &json) {
             result.push_back(item);
         }
         if (result.empty()) return 1;
-        json["currency"] = curr;
+        json["currency"] = symbols.name(symbol);
         json["history"] = result;
     }
     catch (std::exception &ex) {
@@ -212,5 +557,22 @@ int findb::currency_history(std::string &curr, nlohmann::json &json) {
     return 0;
 }
 
+int findb::currency_history(SymbolId symbol, std::vector<HistoryRow> &rows) {
+    server::tracing::StageScope traced(server::tracing::FINDB_START, server::tracing::FINDB_END);
+    try {
+        SQLite::Statement query(*db_ptr, "SELECT value, date FROM finance WHERE currency_id = ?");
+        query.bind(1, static_cast<int64_t>(symbol));
+        rows.clear();
+        while (query.executeStep()) {
+            rows.push_back({query.getColumn(0).getDouble(), query.getColumn(1).getString()});
+        }
+        if (rows.empty()) return 1;
+    }
+    catch (std::exception &ex) {
+        return -1;
+    }
+    return 0;
+}
+
 
 
@@ -5,8 +5,11 @@
 #include <sstream>
 #include <iomanip>
 #include <mutex>
+#include <functional>
+#include <vector>
 
 #include "json/src/json.hpp"
+#include "symbol_table.h"
 
 struct FinanceUnit {
     std::string currency;
@@ -16,31 +19,160 @@ struct FinanceUnit {
     std::tm date;
 };
 
+// One committed row level change of the finance table, what replication ships to followers
+struct FinanceChange {
+    enum Kind : uint8_t {
+        INSERT_ROW = 1,
+        UPDATE_ROW = 2,
+        DELETE_CURRENCY = 3
+    };
+
+    Kind kind;
+    int64_t id;
+    std::string currency;
+    // false for a currency added without values yet, its value columns are NULL
+    bool has_value;
+    double value;
+    double inc_rel;
+    double inc_abs;
+    std::string date;
+    // id of currency in this database, set on everything findb hands out; not replicated,
+    // a follower interns the names itself
+    SymbolId symbol = NO_SYMBOL;
+};
+
+// A value accepted by the ingest journal and not necessarily applied yet
+struct CurrencyTick {
+    uint64_t sequence;
+    // when the value was accepted, seconds since the epoch
+    int64_t time;
+    double value;
+    std::string currency;
+    // resolved when the tick was accepted, NO_SYMBOL for ticks replayed from the file
+    SymbolId symbol = NO_SYMBOL;
+};
+
+// One row of a currency's history, as stored
+struct HistoryRow {
+    double value;
+    std::string date;
+};
+
+// A row with a value as the history compactor sees it
+struct RetainedRow {
+    int64_t id;
+    SymbolId symbol;
+    std::string date;
+};
+
 
 class findb {
 public:
-    findb() : db_ptr(new SQLite::Database("finance.db", SQLite::OPEN_READWRITE)), db_mutex() {}
+    explicit findb(const std::string &path = "finance.db") :
+            db_ptr(new SQLite::Database(path, SQLite::OPEN_READWRITE)), db_mutex() {
+        upgrade_schema();
+        load_symbols();
+    }
 
     virtual ~findb() = default;
 
 
-    static void reset();
+    static void reset(const std::string &path = "finance.db");
 
     int insert(FinanceUnit &financeUnit);
 
     int add_currency(std::string &currency);
 
-    int add_currency_value(std::string &currency, double value);
+    // Resolves a request's currency name once, the calls below take the id. NO_SYMBOL for a name
+    // never added, which they treat like a deleted currency
+    SymbolId symbol(const std::string &currency) const {
+        return symbols.find(currency);
+    }
+
+    int add_currency_value(SymbolId symbol, double value);
+
+    int del_currency(SymbolId symbol);
 
-    int del_currency(std::string &currency);
+    int currency_history(SymbolId symbol, nlohmann::json& json);
 
-    int currency_history(std::string &currency, nlohmann::json& json);
+    // Same rows without building json, for the compact history encodings
+    int currency_history(SymbolId symbol, std::vector<HistoryRow> &rows);
 
     int currency_list(nlohmann::json& json);
 
+    // Answered from memory, so the ingest path can validate a tick without touching SQLite
+    bool has_currency(SymbolId symbol) const {
+        return symbols.is_live(symbol);
+    }
+
+    // Adds journaled ticks in one transaction, in order, together with the last sequence.
+    // Ticks for currencies deleted in the meantime are dropped, and so are ticks at or below the
+    // stored sequence, which the database already has
+    int add_currency_values(const std::vector<CurrencyTick> &ticks);
+
+    // Last journal sequence added by add_currency_values, 0 if none
+    int journal_sequence(uint64_t &sequence);
+
+    // Called with every committed change, in commit order and while the database is locked
+    void set_change_listener(std::function<void(const FinanceChange &)> listener);
+
+    // Newest row of every currency as an INSERT_ROW change, in row order
+    int latest_rows(std::vector<FinanceChange> &rows);
+
+    // Every row as an INSERT_ROW change. at_snapshot runs while writes are blocked, so a
+    // position taken there matches the rows exactly
+    int snapshot(std::vector<FinanceChange> &rows, const std::function<void()> &at_snapshot);
+
+    // Follower side: replaces the table with a snapshot, or applies one change, and stores
+    // the replication position in the same transaction. The listener sees a snapshot as the
+    // deletion of every currency followed by the newest row of each one it contains
+    int install_snapshot(const std::vector<FinanceChange> &rows, uint64_t log_id, uint64_t position);
+
+    int apply_change(const FinanceChange &change, uint64_t log_id, uint64_t position);
+
+    // Last stored position, zeros when nothing was replicated into this database yet
+    int replication_position(uint64_t &log_id, uint64_t &position);
+
+    // Retention: every row carries the bucket width in seconds it stands for, 0 for a raw tick.
+    // Up to limit rows with a value at that resolution after after_id, in id order
+    int retained_rows(uint32_t resolution, int64_t after_id, size_t limit, std::vector<RetainedRow> &rows);
+
+    // Row with the highest id of the currency at that resolution: 0, 1 if there is none
+    int newest_retained(SymbolId symbol, uint32_t resolution, RetainedRow &row);
+
+    // One short transaction: kept rows move to resolution, then dropped rows are deleted.
+    // Neither is a FinanceChange, followers compact their own copy
+    int downsample(const std::vector<int64_t> &kept, const std::vector<int64_t> &dropped, uint32_t resolution);
+
+    // Seconds since the epoch of a stored date, -1 if it does not parse
+    static int64_t date_time(const std::string &date);
+
 private:
+    // Adds what databases created by an older initdb lack
+    void upgrade_schema();
+
+    // Writes the change, whose symbol is resolved, inside the caller's transaction
+    void write_change(const FinanceChange &change);
+
+    // add_currency_value inside the caller's transaction, change receives what was written
+    int write_value(SymbolId symbol, double value, const std::string &date, FinanceChange &change);
+
+    // Id of the name, added to the symbols table inside the caller's transaction when new. The
+    // table in memory learns it from note_change once committed
+    SymbolId intern(const std::string &currency);
+
+    // Keeps the symbol table in step with a committed change
+    void note_change(const FinanceChange &change);
+
+    // Every interned name, live when the finance table has rows of it
+    void load_symbols();
+
+    void store_position(uint64_t log_id, uint64_t position);
+
     SQLite::Database *db_ptr;
     std::mutex db_mutex;
+    std::function<void(const FinanceChange &)> change_listener;
+    SymbolTable symbols;
 };
 
 
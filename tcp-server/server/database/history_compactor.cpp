@@ -0,0 +1,137 @@
+#include <chrono>
+#include <iostream>
+#include "history_compactor.h"
+#include "defines.h"
+
+namespace {
+    // "90d" in seconds, 0 if malformed
+    uint64_t parse_duration(const std::string &text) {
+        if (text.size() < 2) return 0;
+        uint64_t count = 0;
+        for (auto &&i = 0u; i + 1 < text.size(); ++i) {
+            if (text[i] < '0' || text[i] > '9' || count > UINT32_MAX) return 0;
+            count = count * 10 + (text[i] - '0');
+        }
+        switch (text.back()) {
+            case 's': return count;
+            case 'm': return count * 60;
+            case 'h': return count * 3600;
+            case 'd': return count * 86400;
+            default: return 0;
+        }
+    }
+}
+
+HistoryCompactor::HistoryCompactor(findb &database, std::vector<RetentionTier> tiers, size_t batch_rows,
+                                   int pause_ms) :
+        database(database), tiers(std::move(tiers)), batch_rows(batch_rows), pause_ms(pause_ms), stopping(false) {
+    states.resize(this->tiers.size());
+}
+
+bool HistoryCompactor::parse_tiers(const std::string &spec, std::vector<RetentionTier> &tiers) {
+    tiers.clear();
+    size_t start = 0;
+    while (start <= spec.size()) {
+        auto &&end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        auto &&tier = spec.substr(start, end - start);
+        auto &&colon = tier.find(':');
+        auto &&resolution = tier.substr(0, colon);
+        RetentionTier parsed{0, 0};
+        if (resolution != "raw") {
+            auto &&seconds = parse_duration(resolution);
+            if (!seconds || seconds > UINT32_MAX) return false;
+            parsed.resolution_s = static_cast<uint32_t>(seconds);
+        }
+        if (colon != std::string::npos && !(parsed.keep_s = parse_duration(tier.substr(colon + 1)))) return false;
+        tiers.push_back(parsed);
+        start = end + 1;
+    }
+    if (tiers.size() < 2 || tiers.front().resolution_s != 0 || tiers.back().keep_s != 0) return false;
+    for (size_t i = 1; i < tiers.size(); ++i) {
+        auto &&finer = tiers[i - 1];
+        auto &&coarser = tiers[i];
+        if (!finer.keep_s || !coarser.resolution_s) return false;
+        if (finer.resolution_s && (coarser.resolution_s % finer.resolution_s != 0)) return false;
+        if (coarser.resolution_s <= finer.resolution_s) return false;
+        if (coarser.keep_s && coarser.keep_s <= finer.keep_s) return false;
+    }
+    return true;
+}
+
+size_t HistoryCompactor::compact_batch(int64_t now) {
+    std::vector<int64_t> kept;
+    std::vector<int64_t> dropped;
+    for (size_t tier = 0; tier + 1 < tiers.size(); ++tier) {
+        auto &&state = states[tier];
+        auto &&resolution = tiers[tier + 1].resolution_s;
+        auto &&cutoff = now - static_cast<int64_t>(tiers[tier].keep_s);
+        if (database.retained_rows(tiers[tier].resolution_s, state.cursor, batch_rows, rows) != 0) continue;
+        size_t read = 0;
+        for (auto &&row : rows) {
+            auto &&time = findb::date_time(row.date);
+            // ids follow time, so the first row still within the tier ends the batch
+            if (time >= cutoff) break;
+            ++read;
+            state.cursor = row.id;
+            if (time < 0) continue;
+            auto &&bucket = time / resolution;
+            if (row.symbol >= state.open.size()) state.open.resize(row.symbol + 1, {NOT_LOOKED_UP, 0});
+            auto &&open = state.open[row.symbol];
+            if (open.bucket == NOT_LOOKED_UP) {
+                // the bucket may have been started by a batch before a restart
+                open = {-1, 0};
+                RetainedRow newest;
+                if (database.newest_retained(row.symbol, resolution, newest) == 0) {
+                    auto &&newest_time = findb::date_time(newest.date);
+                    if (newest_time >= 0) open = {newest_time / resolution, newest.id};
+                }
+            }
+            if (open.bucket == bucket) {
+                // the later tick of the two closes the bucket
+                if (open.id > row.id) {
+                    dropped.push_back(row.id);
+                    continue;
+                }
+                dropped.push_back(open.id);
+            }
+            kept.push_back(row.id);
+            open = {bucket, row.id};
+        }
+        if (!read) continue;
+        if (database.downsample(kept, dropped, resolution) != 0) {
+            // read again on the next batch
+            state.cursor = 0;
+            state.open.clear();
+            return 0;
+        }
+        return read;
+    }
+    return 0;
+}
+
+void HistoryCompactor::start() {
+    stopping = false;
+    thread = std::thread(&HistoryCompactor::run, this);
+}
+
+void HistoryCompactor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex);
+        stopping = true;
+    }
+    stop_requested.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void HistoryCompactor::run() {
+    std::unique_lock<std::mutex> lock(stop_mutex);
+    while (!stopping) {
+        lock.unlock();
+        auto &&read = compact_batch(static_cast<int64_t>(time(nullptr)));
+        lock.lock();
+        // a full backlog goes out in batches spaced by the pause, a caught up one is checked now and then
+        auto &&wait_ms = read ? pause_ms : COMPACTION_IDLE_MS;
+        stop_requested.wait_for(lock, std::chrono::milliseconds(wait_ms), [this] { return stopping; });
+    }
+}
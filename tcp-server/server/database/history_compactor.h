@@ -0,0 +1,79 @@
+#ifndef ECHOSERVER_HISTORY_COMPACTOR_H
+#define ECHOSERVER_HISTORY_COMPACTOR_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "findb.h"
+
+// A resolution history is kept at, and for how long
+struct RetentionTier {
+    // bucket width in seconds, 0 for raw ticks
+    uint32_t resolution_s;
+    // rows older than this move on to the next tier, 0 for the last tier which keeps them
+    uint64_t keep_s;
+};
+
+// Rolls expired rows of a tier into the buckets of the next one in the background. A bucket
+// keeps the last tick that fell into it, unchanged, so the newest row of a currency - what
+// values are added on top of, what quote tables and followers hold - is never rewritten.
+// Each batch is one short transaction under the database lock with a pause after it, and the
+// reads choosing it are short indexed selects under the lock too, so writers never queue
+// behind a long run of deletes.
+class HistoryCompactor {
+public:
+    // tiers finest first, the first one raw; see parse_tiers
+    HistoryCompactor(findb &database, std::vector<RetentionTier> tiers, size_t batch_rows, int pause_ms);
+
+    ~HistoryCompactor() {
+        stop();
+    }
+
+    void start();
+
+    // Waits for the batch in progress
+    void stop();
+
+    // Compacts up to batch_rows expired rows of the finest tier that has some, as of now.
+    // Rows read and moved on, 0 once every tier is caught up
+    size_t compact_batch(int64_t now);
+
+    // "raw:7d,1m:90d,1h": resolution:keep per tier, finest first, the last one without keep.
+    // Units are s, m, h and d; each resolution a multiple of the one before. False if malformed
+    static bool parse_tiers(const std::string &spec, std::vector<RetentionTier> &tiers);
+
+private:
+    // last row kept in a currency's current bucket of the next tier
+    struct OpenBucket {
+        // NOT_LOOKED_UP until the database was asked, -1 when the currency has no row there
+        int64_t bucket;
+        int64_t id;
+    };
+
+    static constexpr int64_t NOT_LOOKED_UP = INT64_MIN;
+
+    struct TierState {
+        // rows of the tier up to this id have been moved on
+        int64_t cursor = 0;
+        // indexed by symbol
+        std::vector<OpenBucket> open;
+    };
+
+    void run();
+
+    findb &database;
+    std::vector<RetentionTier> tiers;
+    size_t batch_rows;
+    int pause_ms;
+    std::vector<TierState> states;
+    std::vector<RetainedRow> rows;
+
+    std::mutex stop_mutex;
+    std::condition_variable stop_requested;
+    bool stopping;
+    std::thread thread;
+};
+
+#endif //ECHOSERVER_HISTORY_COMPACTOR_H
@@ -0,0 +1,270 @@
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/file.h>
+#include <unistd.h>
+#include "ingest_journal.h"
+
+namespace {
+    const size_t ENTRY_HEADER_SIZE = 2 * sizeof(uint32_t);
+    // larger than any entry the server writes, a bigger length means a torn or corrupt tail
+    const uint32_t MAX_PAYLOAD_SIZE = 1 << 16;
+
+    constexpr std::array<uint32_t, 256> make_crc_table() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); ++i) {
+            uint32_t crc = i;
+            for (auto &&bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0);
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    constexpr auto CRC_TABLE = make_crc_table();
+
+    // CRC-32 as used by zlib
+    uint32_t crc32(const char *data, size_t length) {
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < length; ++i) {
+            crc = CRC_TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    template<typename Value>
+    void put(std::string &out, Value value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<typename Value>
+    bool get(const char *&data, const char *end, Value &value) {
+        if (static_cast<size_t>(end - data) < sizeof(value)) return false;
+        memcpy(&value, data, sizeof(value));
+        data += sizeof(value);
+        return true;
+    }
+
+    void encode_entry(std::string &out, const CurrencyTick &tick) {
+        auto &&header_at = out.size();
+        out.append(ENTRY_HEADER_SIZE, '\0');
+        put(out, tick.sequence);
+        put(out, tick.time);
+        put(out, tick.value);
+        put(out, static_cast<uint32_t>(tick.currency.size()));
+        out.append(tick.currency);
+        auto &&length = static_cast<uint32_t>(out.size() - header_at - ENTRY_HEADER_SIZE);
+        auto &&crc = crc32(out.data() + header_at + ENTRY_HEADER_SIZE, length);
+        memcpy(&out[header_at], &length, sizeof(length));
+        memcpy(&out[header_at + sizeof(length)], &crc, sizeof(crc));
+    }
+
+    bool decode_entry(const char *data, const char *end, CurrencyTick &tick) {
+        uint32_t currency_length = 0;
+        if (!get(data, end, tick.sequence) || !get(data, end, tick.time) || !get(data, end, tick.value) ||
+            !get(data, end, currency_length) || static_cast<size_t>(end - data) != currency_length) {
+            return false;
+        }
+        tick.currency.assign(data, currency_length);
+        return true;
+    }
+
+    bool write_all(int descriptor, const std::string &data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            auto &&count = write(descriptor, data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            written += count;
+        }
+        return true;
+    }
+}
+
+IngestJournal::IngestJournal(findb &database, std::string path, int sync_interval_ms, size_t checkpoint_bytes) :
+        database(database), path(std::move(path)), sync_interval_ms(sync_interval_ms),
+        checkpoint_bytes(checkpoint_bytes), descriptor(-1), next_sequence(1), written_sequence(0),
+        applied_sequence(0), failed_sequence(UINT64_MAX), apply_failed(false), file_size(0),
+        stopping_writer(false), stopping_applier(false) {}
+
+bool IngestJournal::open(bool wait_for_writer) {
+    descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (descriptor == -1) {
+        std::cout << "Cannot open journal " << path << std::endl;
+        return false;
+    }
+    // two processes replaying, appending and truncating the same file lose or duplicate values
+    if (flock(descriptor, wait_for_writer ? LOCK_EX : LOCK_EX | LOCK_NB) == -1) {
+        std::cout << "Journal " << path << " is in use by another process" << std::endl;
+        close(descriptor);
+        descriptor = -1;
+        return false;
+    }
+    if (!replay()) return false;
+    writer_thread = std::thread(&IngestJournal::writer_loop, this);
+    applier_thread = std::thread(&IngestJournal::applier_loop, this);
+    return true;
+}
+
+bool IngestJournal::replay() {
+    std::string contents;
+    char chunk[64 * 1024];
+    ssize_t count;
+    while ((count = pread(descriptor, chunk, sizeof(chunk), contents.size())) > 0) contents.append(chunk, count);
+    if (count < 0) return false;
+
+    uint64_t database_sequence = 0;
+    if (database.journal_sequence(database_sequence) != 0) return false;
+    std::vector<CurrencyTick> tail;
+    uint64_t last_sequence = database_sequence;
+    size_t offset = 0;
+    while (contents.size() - offset >= ENTRY_HEADER_SIZE) {
+        uint32_t length, crc;
+        memcpy(&length, contents.data() + offset, sizeof(length));
+        memcpy(&crc, contents.data() + offset + sizeof(length), sizeof(crc));
+        auto &&payload = contents.data() + offset + ENTRY_HEADER_SIZE;
+        CurrencyTick tick{};
+        if (length > MAX_PAYLOAD_SIZE || contents.size() - offset - ENTRY_HEADER_SIZE < length ||
+            crc32(payload, length) != crc || !decode_entry(payload, payload + length, tick)) {
+            break;
+        }
+        offset += ENTRY_HEADER_SIZE + length;
+        last_sequence = std::max(last_sequence, tick.sequence);
+        if (tick.sequence > database_sequence) tail.push_back(std::move(tick));
+    }
+    // an append cut short by a crash was never acknowledged
+    if (offset < contents.size()) {
+        std::cout << "Journal: dropping " << contents.size() - offset << " bytes of torn tail" << std::endl;
+    }
+    if (!tail.empty()) {
+        std::cout << "Journal: replaying " << tail.size() << " values" << std::endl;
+        if (database.add_currency_values(tail) != 0) return false;
+    }
+    next_sequence = last_sequence + 1;
+    written_sequence = applied_sequence = last_sequence;
+    file_size = contents.size();
+    checkpoint(true);
+    return true;
+}
+
+int IngestJournal::append(SymbolId symbol, const std::string &currency, double value) {
+    if (!database.has_currency(symbol)) return 1;
+    std::unique_lock<std::mutex> lock(journal_mutex);
+    if (stopping_writer || failed_sequence != UINT64_MAX || apply_failed) return -1;
+    auto &&sequence = next_sequence++;
+    pending_ticks.push_back({sequence, static_cast<int64_t>(time(nullptr)), value, currency, symbol});
+    encode_entry(pending, pending_ticks.back());
+    work_pending.notify_one();
+    written.wait(lock, [this, sequence] { return written_sequence >= sequence; });
+    return sequence >= failed_sequence ? -1 : 0;
+}
+
+void IngestJournal::writer_loop() {
+    std::string batch;
+    std::vector<CurrencyTick> batch_ticks;
+    std::unique_lock<std::mutex> lock(journal_mutex);
+    while (true) {
+        work_pending.wait(lock, [this] { return stopping_writer || !pending.empty(); });
+        if (pending.empty()) return;
+        if (sync_interval_ms > 0 && !stopping_writer) {
+            // lets concurrent appends join the batch, they all wait for the same fsync
+            work_pending.wait_for(lock, std::chrono::milliseconds(sync_interval_ms),
+                                  [this] { return stopping_writer; });
+        }
+        batch.swap(pending);
+        batch_ticks.swap(pending_ticks);
+        auto &&last = next_sequence - 1;
+        // after a failure the file may end in a partial entry, nothing may follow it
+        auto &&broken = failed_sequence != UINT64_MAX;
+        lock.unlock();
+
+        std::unique_lock<std::mutex> file_lock(file_mutex);
+        auto &&ok = !broken && write_all(descriptor, batch) &&
+                    (sync_interval_ms < 0 || fdatasync(descriptor) == 0);
+        lock.lock();
+        if (ok) {
+            file_size += batch.size();
+            unapplied.insert(unapplied.end(), std::make_move_iterator(batch_ticks.begin()),
+                             std::make_move_iterator(batch_ticks.end()));
+            apply_pending.notify_one();
+        } else if (failed_sequence == UINT64_MAX) {
+            std::cerr << "Journal write failed, refusing further values" << std::endl;
+            failed_sequence = batch_ticks.front().sequence;
+            // nothing from here on will be applied
+            applied.notify_all();
+        }
+        written_sequence = last;
+        file_lock.unlock();
+        written.notify_all();
+        batch.clear();
+        batch_ticks.clear();
+    }
+}
+
+void IngestJournal::applier_loop() {
+    std::vector<CurrencyTick> batch;
+    std::unique_lock<std::mutex> lock(journal_mutex);
+    while (true) {
+        apply_pending.wait(lock, [this] { return stopping_applier || !unapplied.empty(); });
+        if (unapplied.empty()) return;
+        // everything that piled up while the previous batch was applied goes in one transaction
+        batch.swap(unapplied);
+        // applying past a lost batch would move the stored sequence beyond it, the replay would skip it
+        auto &&status = -1;
+        if (!apply_failed) {
+            lock.unlock();
+            status = database.add_currency_values(batch);
+            lock.lock();
+        }
+        if (status == 0) {
+            applied_sequence = batch.back().sequence;
+        } else if (!apply_failed) {
+            std::cerr << "Journal apply failed, keeping " << path << " for replay at next start" << std::endl;
+            apply_failed = true;
+        }
+        batch.clear();
+        applied.notify_all();
+        if (file_size >= checkpoint_bytes && applied_sequence == written_sequence) {
+            lock.unlock();
+            checkpoint(false);
+            lock.lock();
+        }
+    }
+}
+
+void IngestJournal::checkpoint(bool force) {
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    // anything written after the applier looked is still needed
+    if (apply_failed || applied_sequence != written_sequence || (!force && file_size < checkpoint_bytes)) return;
+    // not synced: should the truncation be lost the stored sequence makes the replay skip everything
+    if (ftruncate(descriptor, 0) == 0) file_size = 0;
+}
+
+void IngestJournal::wait_applied() {
+    std::unique_lock<std::mutex> lock(journal_mutex);
+    auto &&target = next_sequence - 1;
+    applied.wait(lock, [this, target] {
+        return applied_sequence >= target || apply_failed ||
+               (failed_sequence <= target && applied_sequence + 1 >= failed_sequence);
+    });
+}
+
+void IngestJournal::stop() {
+    std::unique_lock<std::mutex> lock(journal_mutex);
+    if (stopping_writer || descriptor == -1) return;
+    stopping_writer = true;
+    lock.unlock();
+    work_pending.notify_all();
+    if (writer_thread.joinable()) writer_thread.join();
+    lock.lock();
+    stopping_applier = true;
+    lock.unlock();
+    apply_pending.notify_all();
+    if (applier_thread.joinable()) applier_thread.join();
+    checkpoint(true);
+    close(descriptor);
+    descriptor = -1;
+}
@@ -0,0 +1,88 @@
+#ifndef ECHOSERVER_INGEST_JOURNAL_H
+#define ECHOSERVER_INGEST_JOURNAL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "findb.h"
+
+// Journal file layout (host byte order):
+//   entry: uint32 payload length, uint32 crc32 of the payload, payload
+//   payload: uint64 sequence, int64 time, double value, uint32 + currency
+// Entries are only appended. A checkpoint truncates the file once everything in it is in
+// SQLite, and the database stores the last applied sequence in the same transaction as the
+// values, so a replay after a crash between the two skips what was already applied.
+class IngestJournal {
+public:
+    // sync_interval_ms: -1 never fsyncs, 0 syncs each group of appends as soon as it is written,
+    // more waits that long after the first unsynced append so that one fsync covers the batch
+    IngestJournal(findb &database, std::string path, int sync_interval_ms, size_t checkpoint_bytes);
+
+    ~IngestJournal() {
+        stop();
+    }
+
+    // Locks the file, replays the tail the database does not have yet, then starts the writer
+    // and applier. False when the file cannot be opened, another process has it locked, or the
+    // tail cannot be applied. With wait_for_writer a process taking over waits for the lock of
+    // the one it replaces, which holds it until stop() has applied and checkpointed everything.
+    bool open(bool wait_for_writer = false);
+
+    // Returns once the tick is in the journal, and synced unless syncing is off:
+    // 0, 1 for an unknown currency, -1 when the journal cannot be written or applied. symbol is
+    // findb::symbol of currency, the file keeps the name
+    int append(SymbolId symbol, const std::string &currency, double value);
+
+    // Blocks until every tick appended so far is in the database, so a read sees its own writes,
+    // or until applying failed, the ticks then wait in the file for the next start
+    void wait_applied();
+
+    // Writes, applies and checkpoints everything appended so far
+    void stop();
+
+private:
+    void writer_loop();
+
+    void applier_loop();
+
+    bool replay();
+
+    // Truncates the file when everything written is applied and it has grown past checkpoint_bytes
+    void checkpoint(bool force);
+
+    findb &database;
+    std::string path;
+    int sync_interval_ms;
+    size_t checkpoint_bytes;
+    int descriptor;
+
+    std::mutex journal_mutex;
+    // encoded entries not written yet, and the same ticks
+    std::string pending;
+    std::vector<CurrencyTick> pending_ticks;
+    // written and synced, waiting for the applier
+    std::vector<CurrencyTick> unapplied;
+    uint64_t next_sequence;
+    uint64_t written_sequence;
+    uint64_t applied_sequence;
+    // first sequence of a batch that could not be written, everything from there on fails
+    uint64_t failed_sequence;
+    // set when the applier failed: nothing more is applied or accepted, and the file is kept for
+    // the next start to replay from the last sequence the database has
+    bool apply_failed;
+    size_t file_size;
+    bool stopping_writer;
+    bool stopping_applier;
+    std::condition_variable work_pending;
+    std::condition_variable written;
+    std::condition_variable apply_pending;
+    std::condition_variable applied;
+    // held by the writer around write and fsync, and by a checkpoint around the truncation
+    std::mutex file_mutex;
+    std::thread writer_thread;
+    std::thread applier_thread;
+};
+
+#endif //ECHOSERVER_INGEST_JOURNAL_H
@@ -0,0 +1,58 @@
+#include "symbol_table.h"
+
+namespace {
+    const std::string NO_NAME;
+}
+
+SymbolTable::SymbolTable() : chunks(new std::atomic<Entry *>[MAX_CHUNKS]), assigned_end(NO_SYMBOL + 1) {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+SymbolTable::~SymbolTable() {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) delete[] chunks[i].load(std::memory_order_relaxed);
+}
+
+SymbolId SymbolTable::find(const std::string &name) const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    auto &&found = index.find(name);
+    return found == index.end() ? NO_SYMBOL : found->second;
+}
+
+const SymbolTable::Entry *SymbolTable::entry(SymbolId id) const {
+    if (id == NO_SYMBOL || id >= end()) return nullptr;
+    auto &&chunk = chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+    return chunk ? &chunk[id % CHUNK_SIZE] : nullptr;
+}
+
+const std::string &SymbolTable::name(SymbolId id) const {
+    auto &&found = entry(id);
+    return found ? found->name : NO_NAME;
+}
+
+bool SymbolTable::is_live(SymbolId id) const {
+    auto &&found = entry(id);
+    return found && found->live.load(std::memory_order_acquire);
+}
+
+bool SymbolTable::assign(SymbolId id, const std::string &name) {
+    if (id == NO_SYMBOL || id >= MAX_SYMBOLS) return false;
+    auto &&chunk = chunks[id / CHUNK_SIZE].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Entry[CHUNK_SIZE];
+        chunks[id / CHUNK_SIZE].store(chunk, std::memory_order_release);
+    }
+    auto &&slot = chunk[id % CHUNK_SIZE];
+    if (!slot.name.empty()) return true;
+    // the name is complete before end() lets readers at it
+    slot.name = name;
+    if (id >= assigned_end.load(std::memory_order_relaxed)) assigned_end.store(id + 1, std::memory_order_release);
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    index.emplace(name, id);
+    return true;
+}
+
+void SymbolTable::set_live(SymbolId id, bool live) {
+    if (id == NO_SYMBOL || id >= end()) return;
+    auto &&chunk = chunks[id / CHUNK_SIZE].load(std::memory_order_relaxed);
+    if (chunk) chunk[id % CHUNK_SIZE].live.store(live, std::memory_order_release);
+}
@@ -0,0 +1,67 @@
+#ifndef ECHOSERVER_SYMBOL_TABLE_H
+#define ECHOSERVER_SYMBOL_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// Dense id of an interned currency name. Ids are the rowids of the symbols table and are never
+// reused, so a currency deleted and added again gets its old id back
+using SymbolId = uint32_t;
+constexpr SymbolId NO_SYMBOL = 0;
+
+// Currency names interned to dense ids, so per-currency state can live in flat arrays indexed by
+// id. Written by findb alone, under its database lock. Names and liveness are read without a lock
+// from chunks that never move once allocated; only the name to id lookup takes a shared lock.
+class SymbolTable {
+public:
+    static constexpr size_t CHUNK_SIZE = 1024;
+    static constexpr size_t MAX_CHUNKS = 4096;
+    static constexpr SymbolId MAX_SYMBOLS = CHUNK_SIZE * MAX_CHUNKS;
+
+    SymbolTable();
+
+    ~SymbolTable();
+
+    SymbolTable(const SymbolTable &) = delete;
+
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
+    // NO_SYMBOL for a name that was never interned
+    SymbolId find(const std::string &name) const;
+
+    // Empty for NO_SYMBOL and ids never assigned
+    const std::string &name(SymbolId id) const;
+
+    // Whether the currency exists now, as opposed to having been deleted
+    bool is_live(SymbolId id) const;
+
+    // One past the highest id assigned, the size of an array indexed by id
+    SymbolId end() const {
+        return assigned_end.load(std::memory_order_acquire);
+    }
+
+    // Writer side. An id keeps its name for good, assigning it again is a no-op; false past MAX_SYMBOLS
+    bool assign(SymbolId id, const std::string &name);
+
+    void set_live(SymbolId id, bool live);
+
+private:
+    struct Entry {
+        std::string name;
+        std::atomic_bool live{false};
+    };
+
+    const Entry *entry(SymbolId id) const;
+
+    std::unique_ptr<std::atomic<Entry *>[]> chunks;
+    std::atomic<SymbolId> assigned_end;
+    mutable std::shared_mutex index_mutex;
+    std::unordered_map<std::string, SymbolId> index;
+};
+
+#endif //ECHOSERVER_SYMBOL_TABLE_H
@@ -0,0 +1,101 @@
+#ifndef ECHOSERVER_FEED_WIRE_H
+#define ECHOSERVER_FEED_WIRE_H
+
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+
+// Datagrams of the multicast quote feed a server started with --feed publishes. Every value the
+// database accepts goes out as one fixed-size datagram with the next sequence number; consumers
+// that see a sequence jump ask the server for the missing ones with a FEED_GAP_FILL request and
+// get the very same datagrams back from its retransmission ring. This header depends on
+// nothing else in the tree.
+//
+// Layout, integers big-endian and doubles as their IEEE-754 bits:
+//   0  magic "FQT1"          4
+//   4  version               2
+//   6  datagram size         2
+//   8  session               8   random per server start, sequences restart with it
+//  16  sequence              8   from 1, without gaps on the sending side
+//  24  time                  8   seconds since the epoch the value was recorded at
+//  32  value                 8
+//  40  relative increase     8
+//  48  absolute increase     8
+//  56  currency             40   NUL padded, longer names are not published
+namespace server::feed {
+    const char TICK_MAGIC[4] = {'F', 'Q', 'T', '1'};
+    const uint16_t TICK_VERSION = 1;
+    const size_t TICK_CURRENCY_SIZE = 40;
+    const size_t TICK_DATAGRAM_SIZE = 96;
+
+    struct Tick {
+        uint64_t session;
+        uint64_t sequence;
+        int64_t time;
+        double value;
+        double relative_increase;
+        double absolute_increase;
+        // NUL terminated
+        char currency[TICK_CURRENCY_SIZE];
+    };
+
+    namespace detail {
+        inline void put64(char *out, uint64_t value) {
+            value = htobe64(value);
+            memcpy(out, &value, sizeof(value));
+        }
+
+        inline uint64_t get64(const char *in) {
+            uint64_t value;
+            memcpy(&value, in, sizeof(value));
+            return be64toh(value);
+        }
+
+        inline uint64_t double_bits(double value) {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        inline double bits_double(uint64_t bits) {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    inline void encode_tick(const Tick &tick, char (&out)[TICK_DATAGRAM_SIZE]) {
+        memcpy(out, TICK_MAGIC, sizeof(TICK_MAGIC));
+        uint16_t version = htobe16(TICK_VERSION), size = htobe16(TICK_DATAGRAM_SIZE);
+        memcpy(out + 4, &version, sizeof(version));
+        memcpy(out + 6, &size, sizeof(size));
+        detail::put64(out + 8, tick.session);
+        detail::put64(out + 16, tick.sequence);
+        detail::put64(out + 24, static_cast<uint64_t>(tick.time));
+        detail::put64(out + 32, detail::double_bits(tick.value));
+        detail::put64(out + 40, detail::double_bits(tick.relative_increase));
+        detail::put64(out + 48, detail::double_bits(tick.absolute_increase));
+        memset(out + 56, 0, TICK_CURRENCY_SIZE);
+        memcpy(out + 56, tick.currency, strnlen(tick.currency, TICK_CURRENCY_SIZE - 1));
+    }
+
+    // False unless data is a complete datagram of this version
+    inline bool decode_tick(const char *data, size_t size, Tick &tick) {
+        if (size != TICK_DATAGRAM_SIZE || memcmp(data, TICK_MAGIC, sizeof(TICK_MAGIC)) != 0) return false;
+        uint16_t version, datagram_size;
+        memcpy(&version, data + 4, sizeof(version));
+        memcpy(&datagram_size, data + 6, sizeof(datagram_size));
+        if (be16toh(version) != TICK_VERSION || be16toh(datagram_size) != TICK_DATAGRAM_SIZE) return false;
+        tick.session = detail::get64(data + 8);
+        tick.sequence = detail::get64(data + 16);
+        tick.time = static_cast<int64_t>(detail::get64(data + 24));
+        tick.value = detail::bits_double(detail::get64(data + 32));
+        tick.relative_increase = detail::bits_double(detail::get64(data + 40));
+        tick.absolute_increase = detail::bits_double(detail::get64(data + 48));
+        memcpy(tick.currency, data + 56, TICK_CURRENCY_SIZE);
+        tick.currency[TICK_CURRENCY_SIZE - 1] = '\0';
+        return true;
+    }
+}
+
+#endif //ECHOSERVER_FEED_WIRE_H
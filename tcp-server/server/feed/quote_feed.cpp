@@ -0,0 +1,90 @@
+#include <iostream>
+#include <random>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "quote_feed.h"
+#include "defines.h"
+
+bool server::feed::QuoteFeed::open(const std::string &group, int port, const std::string &interface_address,
+                                   int ttl, size_t retransmit_slots) {
+    in_addr group_address{}, interface{};
+    if (inet_pton(AF_INET, group.c_str(), &group_address) != 1 || !IN_MULTICAST(ntohl(group_address.s_addr))) {
+        std::cout <<  "Not a multicast group: " << group << std::endl;
+        return false;
+    }
+    if (inet_pton(AF_INET, interface_address.c_str(), &interface) != 1) {
+        std::cout <<  "Not an interface address: " << interface_address << std::endl;
+        return false;
+    }
+    descriptor = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (descriptor == -1) {
+        std::cout <<  "Cannot open feed socket" << std::endl;
+        return false;
+    }
+    // loop on, so consumers on this host get the feed as well
+    unsigned char loop = 1, hops = static_cast<unsigned char>(ttl);
+    if (setsockopt(descriptor, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == -1 ||
+        setsockopt(descriptor, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == -1 ||
+        setsockopt(descriptor, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) == -1) {
+        std::cout <<  "Cannot send multicast out of " << interface_address << std::endl;
+        close();
+        return false;
+    }
+    destination.sin_family = AF_INET;
+    destination.sin_addr = group_address;
+    destination.sin_port = htons(static_cast<uint16_t>(port));
+    std::random_device random;
+    session_id = (static_cast<uint64_t>(random()) << 32) | random();
+    ring_slots = std::max<size_t>(retransmit_slots, 1);
+    ring.assign(ring_slots * TICK_DATAGRAM_SIZE, 0);
+    last_sent = 0;
+    return true;
+}
+
+void server::feed::QuoteFeed::close() {
+    if (descriptor != -1) ::close(descriptor);
+    descriptor = -1;
+}
+
+void server::feed::QuoteFeed::publish(const FinanceChange &change) {
+    if (descriptor == -1 || change.kind == FinanceChange::DELETE_CURRENCY || !change.has_value) return;
+    if (change.currency.size() >= TICK_CURRENCY_SIZE) {
+        if (!oversize_reported) std::cerr << "Currency name too long for the feed: " << change.currency << std::endl;
+        oversize_reported = true;
+        return;
+    }
+    Tick tick{};
+    tick.session = session_id;
+    tick.sequence = last_sent.load(std::memory_order_relaxed) + 1;
+    // stored dates are local time, not UTC
+    tick.time = std::max<int64_t>(findb::date_time(change.date), 0);
+    tick.value = change.value;
+    tick.relative_increase = change.inc_rel;
+    tick.absolute_increase = change.inc_abs;
+    change.currency.copy(tick.currency, change.currency.size());
+    char datagram[TICK_DATAGRAM_SIZE];
+    encode_tick(tick, datagram);
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        memcpy(ring.data() + (tick.sequence % ring_slots) * TICK_DATAGRAM_SIZE, datagram, sizeof(datagram));
+        last_sent.store(tick.sequence, std::memory_order_release);
+    }
+    // a datagram the kernel drops here is one consumers get through gap-fill like any other loss
+    sendto(descriptor, datagram, sizeof(datagram), MSG_DONTWAIT, reinterpret_cast<const sockaddr *>(&destination),
+           sizeof(destination));
+}
+
+size_t server::feed::QuoteFeed::gap_fill(uint64_t from, uint64_t to, std::pmr::string &out, uint64_t &first) {
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    uint64_t last = last_sent.load(std::memory_order_relaxed);
+    uint64_t oldest = last >= ring_slots ? last - ring_slots + 1 : 1;
+    first = std::max<uint64_t>(std::max<uint64_t>(from, oldest), 1);
+    to = std::min(to, last);
+    if (first > to) return 0;
+    size_t count = std::min<uint64_t>(to - first + 1, FEED_GAP_FILL_MAX);
+    out.reserve(out.size() + count * TICK_DATAGRAM_SIZE);
+    for (uint64_t sequence = first; sequence < first + count; ++sequence) {
+        out.append(ring.data() + (sequence % ring_slots) * TICK_DATAGRAM_SIZE, TICK_DATAGRAM_SIZE);
+    }
+    return count;
+}
@@ -0,0 +1,63 @@
+#ifndef ECHOSERVER_QUOTE_FEED_H
+#define ECHOSERVER_QUOTE_FEED_H
+
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include "database/findb.h"
+#include "feed_wire.h"
+
+namespace server::feed {
+    // Publishes every value the database accepts as a sequenced datagram to a UDP multicast
+    // group, see feed_wire.h. It is a change listener of the database and so is fed in commit
+    // order under the database lock, which hands out sequence numbers without a lock of its
+    // own. The last datagrams sent stay in a ring to answer gap-fill requests.
+    class QuoteFeed {
+    public:
+        QuoteFeed() = default;
+
+        QuoteFeed(const QuoteFeed &) = delete;
+
+        QuoteFeed &operator=(const QuoteFeed &) = delete;
+
+        ~QuoteFeed() {
+            close();
+        }
+
+        // Sends to group:port out of the interface with interface_address, 127.0.0.1 keeps the
+        // feed on this host. False after printing why.
+        bool open(const std::string &group, int port, const std::string &interface_address, int ttl,
+                  size_t retransmit_slots);
+
+        void close();
+
+        // Change listener of the database, called in commit order under the database lock
+        void publish(const FinanceChange &change);
+
+        // Appends the retained datagrams with sequences from..to, at most FEED_GAP_FILL_MAX of
+        // them, to out. first is set to the sequence of the first one copied, later than from when
+        // older datagrams have been overwritten. Returns the number of datagrams copied.
+        size_t gap_fill(uint64_t from, uint64_t to, std::pmr::string &out, uint64_t &first);
+
+        uint64_t session() const { return session_id; }
+
+        // sequence of the latest datagram, 0 before the first
+        uint64_t last_sequence() const { return last_sent.load(std::memory_order_acquire); }
+
+    private:
+        int descriptor = -1;
+        sockaddr_in destination{};
+        uint64_t session_id = 0;
+        std::atomic<uint64_t> last_sent{0};
+        // datagram of sequence s lives in slot s % size
+        std::vector<char> ring;
+        size_t ring_slots = 0;
+        std::mutex ring_mutex;
+        bool oversize_reported = false;
+    };
+}
+
+#endif //ECHOSERVER_QUOTE_FEED_H
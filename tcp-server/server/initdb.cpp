@@ -1,6 +1,7 @@
 #include "database/findb.h"
 
-int main (){
-    findb::reset();
+// initdb [path], a follower needs its own database next to the primary's finance.db
+int main (int argc, char **argv){
+    findb::reset(argc > 1 ? argv[1] : "finance.db");
     return 0;
 }
\ No newline at end of file
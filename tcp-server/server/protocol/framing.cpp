@@ -0,0 +1,36 @@
+#include <cstring>
+#include "framing.h"
+#include "opcode_table.h"
+
+bool protocol::extract_frame(std::string &buffer, std::string &message) {
+    auto &&message_end = buffer.find(MESSAGE_END);
+    if (message_end == std::string::npos) return false;
+    message.assign(buffer, 0, message_end);
+    buffer.erase(0, message_end + strlen(MESSAGE_END));
+    return true;
+}
+
+int protocol::frame_iovecs(iovec (&iov)[FRAME_IOVECS], std::string_view prefix, std::string_view text,
+                          std::string_view detail) {
+    auto &&count = 0;
+    for (auto &&part : {prefix, text, detail, std::string_view(MESSAGE_END)}) {
+        if (part.empty()) continue;
+        iov[count].iov_base = const_cast<char *>(part.data());
+        iov[count].iov_len = part.size();
+        ++count;
+    }
+    return count;
+}
+
+namespace {
+    constexpr auto message_prefixes = protocol::make_opcode_table<protocol::MessageType>({
+            {CMD_PREFIX,  protocol::MessageType::command},
+            {TXT_PREFIX,  protocol::MessageType::text},
+            {JSON_PREFIX, protocol::MessageType::json},
+    });
+}
+
+protocol::MessageType protocol::message_type(std::string_view message) {
+    auto &&type = message_prefixes.find(message.substr(0, MESSAGE_PREFIX_LEN));
+    return type ? *type : MessageType::unknown;
+}
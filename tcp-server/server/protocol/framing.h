@@ -0,0 +1,42 @@
+#ifndef ECHOSERVER_FRAMING_H
+#define ECHOSERVER_FRAMING_H
+
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include "defines.h"
+
+namespace protocol {
+    enum class MessageType {
+        command,
+        text,
+        json,
+        unknown
+    };
+
+    // Cuts the first MESSAGE_END terminated frame out of buffer into message.
+    // Returns false and leaves buffer untouched if no complete frame is buffered yet.
+    bool extract_frame(std::string &buffer, std::string &message);
+
+    // Classifies message by its prefix; the prefix itself is left in place.
+    MessageType message_type(std::string_view message);
+
+    // iovecs a frame takes at most: prefix, text, detail and MESSAGE_END
+    constexpr int FRAME_IOVECS = 4;
+
+    // Points iov at prefix, text, detail and MESSAGE_END without copying any of them; empty parts
+    // are left out. Returns the number of iovecs used. The views have to outlive the send.
+    int frame_iovecs(iovec (&iov)[FRAME_IOVECS], std::string_view prefix, std::string_view text,
+                     std::string_view detail = {});
+
+    // Writes prefix + text + detail + MESSAGE_END into out with a single reservation
+    template<typename String>
+    void build_frame(String &out, std::string_view prefix, std::string_view text, std::string_view detail = {}) {
+        std::string_view message_end(MESSAGE_END);
+        out.reserve(out.size() + prefix.size() + text.size() + detail.size() + message_end.size());
+        out.append(prefix.data(), prefix.size()).append(text.data(), text.size());
+        out.append(detail.data(), detail.size()).append(message_end.data(), message_end.size());
+    }
+}
+
+#endif //ECHOSERVER_FRAMING_H
@@ -0,0 +1,260 @@
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include "history_encoding.h"
+
+namespace {
+    void put_varint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    bool get_varint(const std::string &in, size_t &pos, uint64_t &value) {
+        value = 0;
+        for (auto &&shift = 0; shift < 64; shift += 7) {
+            if (pos >= in.size()) return false;
+            auto &&byte = static_cast<uint8_t>(in[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    uint64_t value_bits(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    double bits_value(uint64_t bits) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double decimal_scale(uint8_t decimals) {
+        double scale = 1;
+        for (auto &&i = 0; i < decimals && decimals != protocol::HISTORY_XOR_VALUES; ++i) scale *= 10;
+        return scale;
+    }
+
+    // Fewest decimal digits that represent every value exactly, scaled / scale giving back the
+    // very same double, or HISTORY_XOR_VALUES when there is no such count
+    uint8_t scaled_decimals(const std::vector<protocol::HistoryPoint> &points) {
+        const double exact_limit = 9007199254740992.0;
+        for (uint8_t decimals = 0; decimals <= protocol::HISTORY_MAX_DECIMALS; ++decimals) {
+            auto &&scale = decimal_scale(decimals);
+            bool exact = true;
+            for (auto &&point : points) {
+                auto &&scaled = point.value * scale;
+                // -0.0 would come back as 0.0
+                if (!(std::fabs(scaled) < exact_limit) || std::llround(scaled) / scale != point.value ||
+                    (point.value == 0 && std::signbit(point.value))) {
+                    exact = false;
+                    break;
+                }
+            }
+            if (exact) return decimals;
+        }
+        return protocol::HISTORY_XOR_VALUES;
+    }
+
+    const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    struct Base64Digits {
+        int8_t digits[256];
+
+        Base64Digits() : digits() {
+            for (auto &&i = 0; i < 256; ++i) digits[i] = -1;
+            for (auto &&i = 0; i < 64; ++i) digits[static_cast<uint8_t>(base64_alphabet[i])] = static_cast<int8_t>(i);
+        }
+
+        int8_t operator[](uint8_t c) const { return digits[c]; }
+    };
+
+    const Base64Digits base64_digits;
+
+    template<typename String>
+    void encode_base64(std::string_view in, String &out) {
+        out.clear();
+        out.reserve((in.size() + 2) / 3 * 4);
+        size_t i = 0;
+        for (; i + 2 < in.size(); i += 3) {
+            uint32_t group = static_cast<uint8_t>(in[i]) << 16 | static_cast<uint8_t>(in[i + 1]) << 8 |
+                             static_cast<uint8_t>(in[i + 2]);
+            out.push_back(base64_alphabet[group >> 18]);
+            out.push_back(base64_alphabet[(group >> 12) & 0x3F]);
+            out.push_back(base64_alphabet[(group >> 6) & 0x3F]);
+            out.push_back(base64_alphabet[group & 0x3F]);
+        }
+        if (i == in.size()) return;
+        uint32_t group = static_cast<uint8_t>(in[i]) << 16;
+        if (i + 1 < in.size()) group |= static_cast<uint8_t>(in[i + 1]) << 8;
+        out.push_back(base64_alphabet[group >> 18]);
+        out.push_back(base64_alphabet[(group >> 12) & 0x3F]);
+        out.push_back(i + 1 < in.size() ? base64_alphabet[(group >> 6) & 0x3F] : '=');
+        out.push_back('=');
+    }
+}
+
+void protocol::encode_history(const std::vector<HistoryPoint> &points, std::string &out) {
+    out.clear();
+    out.reserve(16 + points.size() * 4);
+    put_varint(out, points.size());
+    if (points.empty()) return;
+    auto &&decimals = scaled_decimals(points);
+    out.push_back(static_cast<char>(decimals));
+    auto &&scale = decimal_scale(decimals);
+    auto &&first = points.front();
+    put_varint(out, zigzag(first.time));
+    int64_t previous_scaled = 0;
+    uint64_t previous_bits = value_bits(first.value);
+    if (decimals == HISTORY_XOR_VALUES) {
+        for (auto &&i = 0; i < 8; ++i) out.push_back(static_cast<char>(previous_bits >> (8 * i)));
+    } else {
+        previous_scaled = std::llround(first.value * scale);
+        put_varint(out, zigzag(previous_scaled));
+    }
+
+    int64_t previous_time = first.time;
+    int64_t previous_delta = 0;
+    for (size_t i = 1; i < points.size(); ++i) {
+        auto &&point = points[i];
+        int64_t delta = point.time - previous_time;
+        put_varint(out, zigzag(delta - previous_delta));
+        previous_time = point.time;
+        previous_delta = delta;
+
+        if (decimals != HISTORY_XOR_VALUES) {
+            int64_t scaled = std::llround(point.value * scale);
+            put_varint(out, zigzag(scaled - previous_scaled));
+            previous_scaled = scaled;
+            continue;
+        }
+        uint64_t changed = value_bits(point.value) ^ previous_bits;
+        previous_bits ^= changed;
+        if (changed == 0) {
+            out.push_back(0);
+            continue;
+        }
+        auto &&trailing = __builtin_ctzll(changed);
+        out.push_back(static_cast<char>(trailing + 1));
+        put_varint(out, changed >> trailing);
+    }
+}
+
+bool protocol::decode_history(const std::string &payload, std::vector<HistoryPoint> &points) {
+    points.clear();
+    size_t pos = 0;
+    uint64_t count;
+    if (!get_varint(payload, pos, count)) return false;
+    if (count == 0) return pos == payload.size();
+    // every point takes at least two bytes, a larger count cannot be genuine
+    if (count > payload.size() || pos >= payload.size()) return false;
+    points.reserve(count);
+
+    auto &&decimals = static_cast<uint8_t>(payload[pos++]);
+    if (decimals > HISTORY_MAX_DECIMALS && decimals != HISTORY_XOR_VALUES) return false;
+    auto &&scale = decimal_scale(decimals);
+    uint64_t time;
+    if (!get_varint(payload, pos, time)) return false;
+    int64_t scaled = 0;
+    uint64_t bits = 0;
+    if (decimals == HISTORY_XOR_VALUES) {
+        if (pos + 8 > payload.size()) return false;
+        for (auto &&i = 0; i < 8; ++i) bits |= static_cast<uint64_t>(static_cast<uint8_t>(payload[pos++])) << (8 * i);
+    } else {
+        uint64_t first_scaled;
+        if (!get_varint(payload, pos, first_scaled)) return false;
+        scaled = unzigzag(first_scaled);
+    }
+    int64_t previous_time = unzigzag(time);
+    int64_t previous_delta = 0;
+    points.push_back({previous_time, decimals == HISTORY_XOR_VALUES ? bits_value(bits) : scaled / scale});
+
+    for (uint64_t i = 1; i < count; ++i) {
+        uint64_t delta_of_delta;
+        if (!get_varint(payload, pos, delta_of_delta)) return false;
+        previous_delta += unzigzag(delta_of_delta);
+        previous_time += previous_delta;
+
+        if (decimals != HISTORY_XOR_VALUES) {
+            uint64_t scaled_delta;
+            if (!get_varint(payload, pos, scaled_delta)) return false;
+            scaled += unzigzag(scaled_delta);
+            points.push_back({previous_time, scaled / scale});
+            continue;
+        }
+        if (pos >= payload.size()) return false;
+        auto &&trailing = static_cast<uint8_t>(payload[pos++]);
+        if (trailing > 64) return false;
+        if (trailing != 0) {
+            uint64_t changed;
+            if (!get_varint(payload, pos, changed)) return false;
+            bits ^= changed << (trailing - 1);
+        }
+        points.push_back({previous_time, bits_value(bits)});
+    }
+    return pos == payload.size();
+}
+
+bool protocol::parse_history_date(const std::string &date, int64_t &time) {
+    std::tm parsed{};
+    auto &&end = strptime(date.c_str(), "%Y-%b-%d %H:%M:%S", &parsed);
+    if (!end || *end != '\0') return false;
+    time = timegm(&parsed);
+    return true;
+}
+
+std::string protocol::format_history_date(int64_t time) {
+    auto &&seconds = static_cast<time_t>(time);
+    std::tm parts{};
+    gmtime_r(&seconds, &parts);
+    char date[64];
+    auto &&length = strftime(date, sizeof(date), "%Y-%b-%d %H:%M:%S", &parts);
+    return std::string(date, length);
+}
+
+void protocol::base64_encode(std::string_view in, std::string &out) {
+    encode_base64(in, out);
+}
+
+void protocol::base64_encode(std::string_view in, std::pmr::string &out) {
+    encode_base64(in, out);
+}
+
+bool protocol::base64_decode(const std::string &in, std::string &out) {
+    out.clear();
+    if (in.size() % 4 != 0) return false;
+    out.reserve(in.size() / 4 * 3);
+    uint32_t group = 0;
+    int bits = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        auto &&c = in[i];
+        if (c == '=') {
+            // padding only in the last two places
+            if (i + 2 < in.size() || (i + 1 < in.size() && in[i + 1] != '=')) return false;
+            break;
+        }
+        auto &&digit = base64_digits[static_cast<uint8_t>(c)];
+        if (digit < 0) return false;
+        group = group << 6 | static_cast<uint32_t>(digit);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(group >> bits));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef ECHOSERVER_HISTORY_ENCODING_H
+#define ECHOSERVER_HISTORY_ENCODING_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compact GET_CURRENCY_HISTORY payload, asked for with "encoding":"gorilla" in the request.
+//
+// Points are packed in the spirit of Facebook's Gorilla: timestamps as delta-of-delta and
+// values as the change from the previous one, but byte aligned, so every field is a LEB128
+// varint instead of a bit string. Quotes mostly carry a few decimal digits; when every value
+// of the history is an exact decimal with at most HISTORY_MAX_DECIMALS digits, values go as
+// deltas of the scaled integers, otherwise as the XOR of their IEEE 754 bits. Layout:
+//   varint count, nothing follows when 0
+//   byte            decimal digits of the scaled mode, or HISTORY_XOR_VALUES
+//   zigzag varint   first time, seconds
+//   first value     zigzag varint scaled value, or 8 bytes little endian IEEE 754
+//   per further point:
+//     zigzag varint   (time - previous time) - previous delta
+//     scaled mode:    zigzag varint scaled value - previous scaled value
+//     XOR mode:       byte 0 when the value repeats, otherwise trailing zero bits of the
+//                     XOR + 1 followed by varint XOR >> trailing zero bits
+// A steadily sampled quote costs two to four bytes per point against about fifty in json.
+// The reply carries the payload base64 encoded so frames stay MESSAGE_END safe.
+namespace protocol {
+    const int HISTORY_MAX_DECIMALS = 6;
+    const uint8_t HISTORY_XOR_VALUES = 0xFF;
+
+    struct HistoryPoint {
+        // seconds since the epoch, the stored date read as UTC
+        int64_t time;
+        double value;
+    };
+
+    void encode_history(const std::vector<HistoryPoint> &points, std::string &out);
+
+    // false on a truncated or malformed payload
+    bool decode_history(const std::string &payload, std::vector<HistoryPoint> &points);
+
+    // The finance table keeps dates as "%Y-%b-%d %H:%M:%S" text; these map them to seconds
+    // and back without involving the local time zone, so the round trip is exact.
+    bool parse_history_date(const std::string &date, int64_t &time);
+
+    std::string format_history_date(int64_t time);
+
+    void base64_encode(std::string_view in, std::string &out);
+
+    // The same into a string of the request arena
+    void base64_encode(std::string_view in, std::pmr::string &out);
+
+    bool base64_decode(const std::string &in, std::string &out);
+}
+
+#endif //ECHOSERVER_HISTORY_ENCODING_H
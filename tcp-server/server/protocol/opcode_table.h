@@ -0,0 +1,84 @@
+#ifndef ECHOSERVER_OPCODE_TABLE_H
+#define ECHOSERVER_OPCODE_TABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace protocol {
+    constexpr uint32_t hash_opcode(std::string_view opcode, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (auto &&c : opcode) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    template<typename Value>
+    struct OpcodeEntry {
+        std::string_view opcode;
+        Value value;
+    };
+
+    // Perfect hash from opcode strings to values, built at compile time: the constructor searches
+    // for a seed under which every opcode lands in its own slot. A lookup is one hash, one slot
+    // read and one string compare. Duplicate opcodes break the build.
+    template<typename Value, size_t N>
+    class OpcodeTable {
+    public:
+        static constexpr size_t SLOTS = [] {
+            size_t slots = 1;
+            while (slots < 2 * N) slots <<= 1;
+            return slots;
+        }();
+
+        constexpr explicit OpcodeTable(const OpcodeEntry<Value> (&entries)[N]) : entries{}, slot_entry{}, seed(0) {
+            for (size_t i = 0; i < N; ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (entries[i].opcode == entries[j].opcode) throw std::logic_error("duplicate opcode");
+                }
+                this->entries[i] = entries[i];
+            }
+            for (uint32_t candidate = 0; candidate < 10000; ++candidate) {
+                if (try_seed(candidate)) {
+                    seed = candidate;
+                    return;
+                }
+            }
+            throw std::logic_error("no perfect hash seed found");
+        }
+
+        constexpr const Value *find(std::string_view opcode) const {
+            auto &&index = slot_entry[hash_opcode(opcode, seed) & (SLOTS - 1)];
+            if (index == 0 || entries[index - 1].opcode != opcode) return nullptr;
+            return &entries[index - 1].value;
+        }
+
+    private:
+        constexpr bool try_seed(uint32_t candidate) {
+            for (auto &&slot : slot_entry) slot = 0;
+            for (size_t i = 0; i < N; ++i) {
+                auto &&slot = slot_entry[hash_opcode(entries[i].opcode, candidate) & (SLOTS - 1)];
+                if (slot != 0) return false;
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            return true;
+        }
+
+        static_assert(N < 255, "slot indexes are stored in a byte");
+
+        std::array<OpcodeEntry<Value>, N> entries;
+        std::array<uint8_t, SLOTS> slot_entry;
+        uint32_t seed;
+    };
+
+    template<typename Value, size_t N>
+    constexpr OpcodeTable<Value, N> make_opcode_table(const OpcodeEntry<Value> (&entries)[N]) {
+        return OpcodeTable<Value, N>(entries);
+    }
+}
+
+#endif //ECHOSERVER_OPCODE_TABLE_H
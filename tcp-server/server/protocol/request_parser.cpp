@@ -0,0 +1,248 @@
+#include <cstdlib>
+#include "request_parser.h"
+
+namespace {
+    class Scanner {
+    public:
+        Scanner(std::string_view text, protocol::Request &request) : text(text), pos(0), request(request) {}
+
+        bool parse_object();
+
+        bool at_end() {
+            skip_whitespace();
+            return pos == text.size();
+        }
+
+    private:
+        void skip_whitespace() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+                ++pos;
+        }
+
+        bool consume(char expected) {
+            skip_whitespace();
+            if (pos >= text.size() || text[pos] != expected) return false;
+            ++pos;
+            return true;
+        }
+
+        bool append_utf8(uint32_t code_point);
+
+        bool parse_hex4(uint32_t &code_point);
+
+        bool parse_string(std::string_view &out);
+
+        bool parse_number(double &out);
+
+        // non-negative integer, exact up to 2^53
+        bool parse_sequence(uint64_t &out);
+
+        bool skip_value();
+
+        std::string_view text;
+        size_t pos;
+        protocol::Request &request;
+    };
+
+    bool Scanner::append_utf8(uint32_t code_point) {
+        char encoded[4];
+        size_t length;
+        if (code_point < 0x80) {
+            encoded[0] = static_cast<char>(code_point);
+            length = 1;
+        } else if (code_point < 0x800) {
+            encoded[0] = static_cast<char>(0xC0 | (code_point >> 6));
+            encoded[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+            length = 2;
+        } else if (code_point < 0x10000) {
+            encoded[0] = static_cast<char>(0xE0 | (code_point >> 12));
+            encoded[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            encoded[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+            length = 3;
+        } else {
+            encoded[0] = static_cast<char>(0xF0 | (code_point >> 18));
+            encoded[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            encoded[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            encoded[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+            length = 4;
+        }
+        if (request.scratch_used + length > sizeof(request.scratch)) return false;
+        for (size_t i = 0; i < length; ++i) request.scratch[request.scratch_used++] = encoded[i];
+        return true;
+    }
+
+    bool Scanner::parse_hex4(uint32_t &code_point) {
+        if (pos + 4 > text.size()) return false;
+        code_point = 0;
+        for (auto &&i = 0; i < 4; ++i) {
+            auto &&c = text[pos++];
+            code_point <<= 4;
+            if (c >= '0' && c <= '9') code_point |= c - '0';
+            else if (c >= 'a' && c <= 'f') code_point |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code_point |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool Scanner::parse_string(std::string_view &out) {
+        if (!consume('"')) return false;
+        size_t start = pos;
+        while (pos < text.size() && text[pos] != '"' && text[pos] != '\\') ++pos;
+        if (pos >= text.size()) return false;
+        if (text[pos] == '"') {
+            out = text.substr(start, pos - start);
+            ++pos;
+            return true;
+        }
+        // escaped string, decode into the request scratch area
+        size_t decoded_start = request.scratch_used;
+        for (auto &&i = start; i < pos; ++i) {
+            if (request.scratch_used >= sizeof(request.scratch)) return false;
+            request.scratch[request.scratch_used++] = text[i];
+        }
+        while (pos < text.size() && text[pos] != '"') {
+            auto &&c = text[pos++];
+            if (c != '\\') {
+                if (request.scratch_used >= sizeof(request.scratch)) return false;
+                request.scratch[request.scratch_used++] = c;
+                continue;
+            }
+            if (pos >= text.size()) return false;
+            auto &&escaped = text[pos++];
+            uint32_t code_point;
+            switch (escaped) {
+                case '"': code_point = '"'; break;
+                case '\\': code_point = '\\'; break;
+                case '/': code_point = '/'; break;
+                case 'b': code_point = '\b'; break;
+                case 'f': code_point = '\f'; break;
+                case 'n': code_point = '\n'; break;
+                case 'r': code_point = '\r'; break;
+                case 't': code_point = '\t'; break;
+                case 'u': {
+                    if (!parse_hex4(code_point)) return false;
+                    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                        uint32_t low;
+                        if (pos + 2 > text.size() || text[pos] != '\\' || text[pos + 1] != 'u') return false;
+                        pos += 2;
+                        if (!parse_hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
+            if (!append_utf8(code_point)) return false;
+        }
+        if (pos >= text.size()) return false;
+        ++pos;
+        out = std::string_view(request.scratch + decoded_start, request.scratch_used - decoded_start);
+        return true;
+    }
+
+    bool Scanner::parse_number(double &out) {
+        skip_whitespace();
+        char digits[64];
+        size_t length = 0;
+        while (pos < text.size() && length + 1 < sizeof(digits)) {
+            auto &&c = text[pos];
+            if ((c < '0' || c > '9') && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') break;
+            digits[length++] = c;
+            ++pos;
+        }
+        if (length == 0) return false;
+        digits[length] = '\0';
+        char *end = nullptr;
+        out = std::strtod(digits, &end);
+        return end == digits + length;
+    }
+
+    bool Scanner::parse_sequence(uint64_t &out) {
+        double number;
+        if (!parse_number(number) || number < 0 || number > 9007199254740992.0) return false;
+        out = static_cast<uint64_t>(number);
+        return out == number;
+    }
+
+    bool Scanner::skip_value() {
+        skip_whitespace();
+        if (pos >= text.size()) return false;
+        auto &&c = text[pos];
+        if (c == '"') {
+            std::string_view ignored;
+            size_t scratch_used = request.scratch_used;
+            auto &&ok = parse_string(ignored);
+            request.scratch_used = scratch_used;
+            return ok;
+        }
+        if (c == '{' || c == '[') {
+            ++pos;
+            auto &&closing = c == '{' ? '}' : ']';
+            if (consume(closing)) return true;
+            while (true) {
+                if (c == '{') {
+                    std::string_view ignored_key;
+                    size_t scratch_used = request.scratch_used;
+                    auto &&ok = parse_string(ignored_key);
+                    request.scratch_used = scratch_used;
+                    if (!ok || !consume(':')) return false;
+                }
+                if (!skip_value()) return false;
+                if (consume(closing)) return true;
+                if (!consume(',')) return false;
+            }
+        }
+        for (auto &&literal : {std::string_view("true"), std::string_view("false"), std::string_view("null")}) {
+            if (text.compare(pos, literal.size(), literal) == 0) {
+                pos += literal.size();
+                return true;
+            }
+        }
+        double ignored;
+        return parse_number(ignored);
+    }
+
+    bool Scanner::parse_object() {
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        while (true) {
+            std::string_view key;
+            if (!parse_string(key) || !consume(':')) return false;
+            if (key == "type") {
+                if (!parse_string(request.type)) return false;
+            } else if (key == "currency") {
+                if (!parse_string(request.currency)) return false;
+            } else if (key == "encoding") {
+                if (!parse_string(request.encoding)) return false;
+            } else if (key == "value") {
+                if (!parse_number(request.value)) return false;
+                request.has_value = true;
+            } else if (key == "from") {
+                if (!parse_sequence(request.from)) return false;
+                request.has_from = true;
+            } else if (key == "to") {
+                if (!parse_sequence(request.to)) return false;
+                request.has_to = true;
+            } else if (!skip_value()) {
+                return false;
+            }
+            if (consume('}')) return true;
+            if (!consume(',')) return false;
+        }
+    }
+}
+
+bool protocol::parse_request(std::string_view json, Request &request) {
+    request.type = std::string_view();
+    request.currency = std::string_view();
+    request.encoding = std::string_view();
+    request.value = 0;
+    request.has_value = false;
+    request.from = request.to = 0;
+    request.has_from = request.has_to = false;
+    request.scratch_used = 0;
+    Scanner scanner(json, request);
+    return scanner.parse_object() && scanner.at_end();
+}
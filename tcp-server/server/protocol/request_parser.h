@@ -0,0 +1,31 @@
+#ifndef ECHOSERVER_REQUEST_PARSER_H
+#define ECHOSERVER_REQUEST_PARSER_H
+
+#include <string_view>
+#include "defines.h"
+
+namespace protocol {
+    // Fields of a jsn: request. The views point either into the parsed text or,
+    // for strings containing escapes, into the decoded copy kept in scratch.
+    struct Request {
+        std::string_view type;
+        std::string_view currency;
+        // empty unless the client asked for a compact reply
+        std::string_view encoding;
+        double value = 0;
+        bool has_value = false;
+        // inclusive sequence range of FEED_GAP_FILL
+        uint64_t from = 0;
+        uint64_t to = 0;
+        bool has_from = false;
+        bool has_to = false;
+        char scratch[MESSAGE_SIZE];
+        size_t scratch_used = 0;
+    };
+
+    // Parses a flat json object without building a DOM and without allocating.
+    // Unknown keys are skipped, nested values included. Returns false on malformed json.
+    bool parse_request(std::string_view json, Request &request);
+}
+
+#endif //ECHOSERVER_REQUEST_PARSER_H
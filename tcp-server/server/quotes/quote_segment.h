@@ -0,0 +1,86 @@
+#ifndef ECHOSERVER_QUOTE_SEGMENT_H
+#define ECHOSERVER_QUOTE_SEGMENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Fixed layout of the shared-memory quote table, the file a server started with --quote-table
+// keeps up to date. Local consumers may mmap the file read-only and use read_slot directly;
+// this header depends on nothing else in the tree.
+//
+// One writer process owns the file, it holds an exclusive flock on it. Every slot is guarded
+// by its own seqlock: the sequence is odd while the writer is inside the slot, and a reader
+// that saw the same even sequence before and after copying the data got a consistent quote.
+// Readers never write to the segment and never wait for the writer. A writer reopening the file
+// with another slot_count never shrinks it, a reader compares slot_count with the count it mapped
+// and reopens the file when they differ.
+namespace server::quotes {
+    const char SEGMENT_MAGIC[8] = {'F', 'I', 'N', 'Q', 'T', 'S', '0', '1'};
+
+    struct QuoteData {
+        enum Flags : uint32_t {
+            // the slot holds a currency, otherwise it is free
+            IN_USE = 1,
+            // false for a currency added without values, value and increases are 0 then
+            HAS_VALUE = 2
+        };
+
+        uint32_t flags;
+        // NUL terminated, longer currency names are not published
+        char currency[36];
+        double value;
+        double relative_increase;
+        double absolute_increase;
+        // "%Y-%b-%d %H:%M:%S" as in the database, NUL terminated
+        char date[32];
+    };
+
+    struct alignas(128) QuoteSlot {
+        std::atomic<uint64_t> sequence;
+        QuoteData data;
+    };
+
+    struct alignas(128) SegmentHeader {
+        char magic[8];
+        uint32_t slot_count;
+        // slots at or above this index have never been used, readers can stop there
+        std::atomic<uint32_t> slots_used;
+        // pid of the process that last opened the segment for writing
+        std::atomic<int32_t> writer_pid;
+    };
+
+    inline size_t segment_size(uint32_t slot_count) {
+        return sizeof(SegmentHeader) + static_cast<size_t>(slot_count) * sizeof(QuoteSlot);
+    }
+
+    inline QuoteSlot *segment_slots(SegmentHeader *header) {
+        return reinterpret_cast<QuoteSlot *>(header + 1);
+    }
+
+    inline const QuoteSlot *segment_slots(const SegmentHeader *header) {
+        return reinterpret_cast<const QuoteSlot *>(header + 1);
+    }
+
+    // Single writer only
+    inline void write_slot(QuoteSlot &slot, const QuoteData &data) {
+        auto &&sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.data, &data, sizeof(data));
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Copies a consistent quote out of the slot, retrying while the writer is inside it
+    inline void read_slot(const QuoteSlot &slot, QuoteData &data) {
+        while (true) {
+            auto &&before = slot.sequence.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            memcpy(&data, const_cast<const QuoteData *>(&slot.data), sizeof(data));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before) return;
+        }
+    }
+}
+
+#endif //ECHOSERVER_QUOTE_SEGMENT_H
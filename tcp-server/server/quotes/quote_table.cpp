@@ -0,0 +1,163 @@
+#include <fcntl.h>
+#include <iostream>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "quote_table.h"
+
+bool server::quotes::QuoteTable::open_writer(const std::string &path, uint32_t slot_count, bool wait_for_writer) {
+    descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (descriptor == -1) return false;
+    if (flock(descriptor, wait_for_writer ? LOCK_EX : LOCK_EX | LOCK_NB) == -1) {
+        std::cerr << "Quote table " << path << " already has a writer" << std::endl;
+        close();
+        return false;
+    }
+    mapped_size = segment_size(slot_count);
+    struct stat status{};
+    if (fstat(descriptor, &status) == -1 ||
+        (static_cast<size_t>(status.st_size) < mapped_size &&
+         ftruncate(descriptor, static_cast<off_t>(mapped_size)) == -1)) {
+        close();
+        return false;
+    }
+    auto &&mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    header = static_cast<SegmentHeader *>(mapping);
+    writer = true;
+    // Readers of a previous run may still be mapped: slots are emptied through their seqlocks
+    // and the header is only valid again once the slots are
+    auto &&reused = memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0 &&
+                    header->slot_count == slot_count;
+    if (!reused) memset(static_cast<void *>(header), 0, mapped_size);
+    QuoteData empty{};
+    auto &&slots = segment_slots(header);
+    uint32_t used = reused ? std::min(header->slots_used.load(), slot_count) : 0;
+    for (uint32_t i = 0; i < slot_count; ++i) {
+        auto &&sequence = slots[i].sequence.load(std::memory_order_relaxed);
+        if (sequence & 1) {
+            // a writer died inside the slot: finish its write with an empty quote, readers keep
+            // retrying until the sequence is even again
+            memcpy(&slots[i].data, &empty, sizeof(empty));
+            slots[i].sequence.store(sequence + 1, std::memory_order_release);
+        } else if (i < used) {
+            write_slot(slots[i], empty);
+        }
+    }
+    header->slot_count = slot_count;
+    header->slots_used.store(0, std::memory_order_release);
+    header->writer_pid.store(getpid(), std::memory_order_relaxed);
+    memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    return true;
+}
+
+bool server::quotes::QuoteTable::open_reader(const std::string &path) {
+    descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1) return false;
+    struct stat status{};
+    if (fstat(descriptor, &status) == -1 || static_cast<size_t>(status.st_size) < sizeof(SegmentHeader)) {
+        close();
+        return false;
+    }
+    mapped_size = static_cast<size_t>(status.st_size);
+    auto &&mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    header = static_cast<SegmentHeader *>(mapping);
+    if (memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+        segment_size(header->slot_count) > mapped_size) {
+        close();
+        return false;
+    }
+    mapped_slots = header->slot_count;
+    return true;
+}
+
+void server::quotes::QuoteTable::close() {
+    if (header) munmap(header, mapped_size);
+    // closing the descriptor drops the writer lock
+    if (descriptor != -1) ::close(descriptor);
+    header = nullptr;
+    descriptor = -1;
+    mapped_size = 0;
+    mapped_slots = 0;
+    writer = false;
+    slot_of.clear();
+    free_slots.clear();
+}
+
+void server::quotes::QuoteTable::load(const std::vector<FinanceChange> &latest) {
+    for (auto &&change : latest) write(change);
+}
+
+void server::quotes::QuoteTable::publish(const FinanceChange &change) {
+    if (writer) write(change);
+}
+
+void server::quotes::QuoteTable::write(const FinanceChange &change) {
+    auto &&slots = segment_slots(header);
+    if (change.symbol == NO_SYMBOL) return;
+    if (change.symbol >= slot_of.size()) slot_of.resize(change.symbol + 1, NO_SLOT);
+    auto &&found = slot_of[change.symbol];
+    if (change.kind == FinanceChange::DELETE_CURRENCY) {
+        if (found == NO_SLOT) return;
+        QuoteData empty{};
+        write_slot(slots[found], empty);
+        free_slots.push_back(found);
+        found = NO_SLOT;
+        return;
+    }
+    QuoteData data{};
+    if (change.currency.size() >= sizeof(data.currency)) return;
+    uint32_t slot;
+    if (found != NO_SLOT) {
+        slot = found;
+    } else if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else if (header->slots_used.load(std::memory_order_relaxed) < header->slot_count) {
+        slot = header->slots_used.load(std::memory_order_relaxed);
+    } else {
+        if (!full_reported) std::cerr << "Quote table full, " << change.currency << " not published" << std::endl;
+        full_reported = true;
+        return;
+    }
+    data.flags = QuoteData::IN_USE;
+    if (change.has_value) data.flags |= QuoteData::HAS_VALUE;
+    memcpy(data.currency, change.currency.data(), change.currency.size());
+    if (change.has_value) {
+        data.value = change.value;
+        data.relative_increase = change.inc_rel;
+        data.absolute_increase = change.inc_abs;
+    }
+    memcpy(data.date, change.date.data(), std::min(change.date.size(), sizeof(data.date) - 1));
+    write_slot(slots[slot], data);
+    if (found == NO_SLOT) {
+        found = slot;
+        // published after the slot so a reader never scans a slot that is still being filled
+        if (slot == header->slots_used.load(std::memory_order_relaxed)) {
+            header->slots_used.store(slot + 1, std::memory_order_release);
+        }
+    }
+}
+
+bool server::quotes::QuoteTable::read_all(std::vector<QuoteData> &quotes) const {
+    quotes.clear();
+    if (!header) return false;
+    if (header->slot_count != mapped_slots) return false;
+    auto &&slots = segment_slots(header);
+    // never past the mapping, whatever the header says by now
+    uint32_t used = std::min(header->slots_used.load(std::memory_order_acquire), mapped_slots);
+    QuoteData data{};
+    for (uint32_t i = 0; i < used; ++i) {
+        read_slot(slots[i], data);
+        if (data.flags & QuoteData::IN_USE) quotes.push_back(data);
+    }
+    return true;
+}
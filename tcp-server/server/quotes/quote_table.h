@@ -0,0 +1,63 @@
+#ifndef ECHOSERVER_QUOTE_TABLE_H
+#define ECHOSERVER_QUOTE_TABLE_H
+
+#include <string>
+#include <vector>
+#include "database/findb.h"
+#include "quote_segment.h"
+
+namespace server::quotes {
+    // Latest quote of every currency in a shared-memory segment, see quote_segment.h.
+    // The writer side is a change listener of the database and is fed in commit order under
+    // the database lock, which makes it the single writer the seqlocks need. The reader side
+    // maps the same file read-only in other processes.
+    class QuoteTable {
+    public:
+        QuoteTable() = default;
+
+        QuoteTable(const QuoteTable &) = delete;
+
+        QuoteTable &operator=(const QuoteTable &) = delete;
+
+        ~QuoteTable() {
+            close();
+        }
+
+        // Creates or resets the segment and locks it against other writers. wait_for_writer
+        // blocks until the current writer is gone instead of failing, for a hot upgrade. The file
+        // only ever grows, so readers mapped with an earlier slot count never fault
+        bool open_writer(const std::string &path, uint32_t slot_count, bool wait_for_writer);
+
+        bool open_reader(const std::string &path);
+
+        void close();
+
+        // Fills the table with the latest row of every currency, before any change is published
+        void load(const std::vector<FinanceChange> &latest);
+
+        // Change listener of the database
+        void publish(const FinanceChange &change);
+
+        // Every quote in use, in slot order. False when the writer has reopened the segment with
+        // a different slot count since this reader mapped it, the reader has to be reopened then
+        bool read_all(std::vector<QuoteData> &quotes) const;
+
+    private:
+        void write(const FinanceChange &change);
+
+        int descriptor = -1;
+        SegmentHeader *header = nullptr;
+        size_t mapped_size = 0;
+        // slot count the mapping was made for, the header may change under a reader
+        uint32_t mapped_slots = 0;
+        bool writer = false;
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        // writer only: slot of every published currency indexed by symbol, and slots freed by deletes
+        std::vector<uint32_t> slot_of;
+        std::vector<uint32_t> free_slots;
+        bool full_reported = false;
+    };
+}
+
+#endif //ECHOSERVER_QUOTE_TABLE_H
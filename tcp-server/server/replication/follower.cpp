@@ -0,0 +1,103 @@
+#include <chrono>
+#include <iostream>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "follower.h"
+#include "wire.h"
+
+namespace {
+    const auto RECONNECT_DELAY = std::chrono::seconds(1);
+}
+
+server::replication::Follower::Follower(findb &database, std::string primary_host, int primary_port) :
+        database(database), primary_host(std::move(primary_host)), primary_port(primary_port), stopping(false),
+        connection(-1) {}
+
+void server::replication::Follower::start() {
+    follow_thread = std::thread(&Follower::follow_loop, this);
+}
+
+void server::replication::Follower::stop() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    if (stopping) return;
+    stopping = true;
+    if (connection != -1) shutdown(connection, SHUT_RDWR);
+    lock.unlock();
+    stop_requested.notify_all();
+    if (follow_thread.joinable()) follow_thread.join();
+}
+
+void server::replication::Follower::follow_loop() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    while (!stopping) {
+        lock.unlock();
+        auto &&primary = connect_to_primary();
+        lock.lock();
+        if (primary != -1) {
+            connection = primary;
+            if (stopping) shutdown(primary, SHUT_RDWR);
+            lock.unlock();
+            follow(primary);
+            lock.lock();
+            connection = -1;
+            close(primary);
+            if (!stopping) std::cout << "Lost primary, reconnecting" << std::endl;
+        }
+        stop_requested.wait_for(lock, RECONNECT_DELAY, [this] { return stopping; });
+    }
+}
+
+int server::replication::Follower::connect_to_primary() {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    auto &&port = std::to_string(primary_port);
+    if (getaddrinfo(primary_host.c_str(), port.c_str(), &hints, &addresses) != 0) return -1;
+    auto &&primary = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (primary != -1 && connect(primary, addresses->ai_addr, addresses->ai_addrlen) == -1) {
+        close(primary);
+        primary = -1;
+    }
+    freeaddrinfo(addresses);
+    return primary;
+}
+
+void server::replication::Follower::follow(int primary) {
+    uint64_t log_id = 0, position = 0;
+    if (database.replication_position(log_id, position) != 0) return;
+    std::string buffer;
+    encode_record(buffer, {HELLO, log_id, position, {}});
+    if (!write_all(primary, buffer)) return;
+    std::cout << "Following " << primary_host << ":" << primary_port << " from position " << position << std::endl;
+
+    std::vector<FinanceChange> snapshot;
+    Record record{};
+    while (read_record(primary, buffer, record)) {
+        switch (record.type) {
+            case SNAPSHOT_BEGIN:
+                snapshot.clear();
+                break;
+            case SNAPSHOT_ROW:
+                snapshot.push_back(std::move(record.change));
+                break;
+            case SNAPSHOT_END:
+                if (database.install_snapshot(snapshot, record.log_id, record.position) != 0) return;
+                std::cout << "Installed snapshot of " << snapshot.size() << " rows at position " << record.position
+                          << std::endl;
+                log_id = record.log_id;
+                position = record.position;
+                snapshot.clear();
+                break;
+            case CHANGE:
+                // anything out of order means the stream is broken, reconnecting sorts it out
+                if (record.log_id != log_id || record.position != position + 1) return;
+                if (database.apply_change(record.change, log_id, record.position) != 0) return;
+                position = record.position;
+                break;
+            default:
+                return;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef ECHOSERVER_REPLICATION_FOLLOWER_H
+#define ECHOSERVER_REPLICATION_FOLLOWER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "database/findb.h"
+
+namespace server::replication {
+    // Keeps a read-only copy of the primary's database. The applied position is stored with
+    // every change, so a restarted follower resumes where it stopped if the primary still has it.
+    class Follower {
+    public:
+        Follower(findb &database, std::string primary_host, int primary_port);
+
+        ~Follower() {
+            stop();
+        }
+
+        void start();
+
+        void stop();
+
+    private:
+        void follow_loop();
+
+        // Applies records from one connection until it breaks
+        void follow(int connection);
+
+        int connect_to_primary();
+
+        findb &database;
+        std::string primary_host;
+        int primary_port;
+        bool stopping;
+        // the current connection, shut down by stop to unblock the reader
+        int connection;
+        std::mutex state_mutex;
+        std::condition_variable stop_requested;
+        std::thread follow_thread;
+    };
+}
+
+#endif //ECHOSERVER_REPLICATION_FOLLOWER_H
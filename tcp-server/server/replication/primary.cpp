@@ -0,0 +1,167 @@
+#include <iostream>
+#include <random>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "primary.h"
+#include "wire.h"
+
+namespace {
+    // records sent to a follower per write while it is catching up
+    const size_t BATCH_BYTES = 64 * 1024;
+}
+
+server::replication::Primary::Primary(findb &database, int port, size_t log_capacity, int taken_listener) :
+        database(database), first_position(1), last_position(0), log_capacity(std::max<size_t>(log_capacity, 1)),
+        stopping(false), listen_descriptor(taken_listener), wakeup_descriptor(-1), bound_port(-1) {
+    std::random_device random;
+    log_id = (uint64_t(random()) << 32 | random()) | 1;
+
+    sockaddr_in address{};
+    socklen_t address_len = sizeof(address);
+    if (listen_descriptor == -1) {
+        listen_descriptor = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int enable_options = 1;
+        setsockopt(listen_descriptor, SOL_SOCKET, SO_REUSEADDR, &enable_options, sizeof(enable_options));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (listen_descriptor != -1 &&
+            (bind(listen_descriptor, reinterpret_cast<sockaddr *>(&address), address_len) == -1 ||
+             listen(listen_descriptor, SOMAXCONN) == -1)) {
+            close(listen_descriptor);
+            listen_descriptor = -1;
+        }
+    }
+    wakeup_descriptor = eventfd(0, EFD_CLOEXEC);
+    // during a hot upgrade both processes poll the socket, the one that loses a connection must not block
+    if (listen_descriptor == -1 || wakeup_descriptor == -1 ||
+        fcntl(listen_descriptor, F_SETFL, fcntl(listen_descriptor, F_GETFL) | O_NONBLOCK) == -1) {
+        std::cout << "Cannot listen for followers on port " << port << std::endl;
+        if (listen_descriptor != -1) close(listen_descriptor);
+        listen_descriptor = -1;
+        return;
+    }
+    getsockname(listen_descriptor, reinterpret_cast<sockaddr *>(&address), &address_len);
+    bound_port = ntohs(address.sin_port);
+}
+
+void server::replication::Primary::start() {
+    if (!listening()) return;
+    accept_thread = std::thread(&Primary::accept_loop, this);
+    std::cout << "Replication log " << std::hex << log_id << std::dec << " on port " << bound_port << std::endl;
+}
+
+void server::replication::Primary::stop() {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    if (stopping) return;
+    stopping = true;
+    lock.unlock();
+    log_appended.notify_all();
+    uint64_t wake = 1;
+    if (wakeup_descriptor != -1 && write(wakeup_descriptor, &wake, sizeof(wake)) < 0) {
+        std::cout << "Cannot wake the follower accept loop" << std::endl;
+    }
+    if (accept_thread.joinable()) accept_thread.join();
+    if (listen_descriptor != -1) close(listen_descriptor);
+    if (wakeup_descriptor != -1) close(wakeup_descriptor);
+    for (auto &&session : sessions) {
+        shutdown(session.connection, SHUT_RDWR);
+        if (session.thread.joinable()) session.thread.join();
+        close(session.connection);
+    }
+    sessions.clear();
+}
+
+void server::replication::Primary::publish(const FinanceChange &change) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    std::string record;
+    encode_record(record, {CHANGE, log_id, last_position + 1, change});
+    log.push_back(std::move(record));
+    last_position++;
+    if (log.size() > log_capacity) {
+        log.pop_front();
+        first_position++;
+    }
+    lock.unlock();
+    log_appended.notify_all();
+}
+
+void server::replication::Primary::accept_loop() {
+    while (true) {
+        pollfd ready[] = {{listen_descriptor, POLLIN, 0}, {wakeup_descriptor, POLLIN, 0}};
+        if (poll(ready, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (ready[1].revents) return;
+        auto &&connection = accept4(listen_descriptor, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection == -1) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        sessions.remove_if([](Session &session) {
+            if (!session.done) return false;
+            session.thread.join();
+            close(session.connection);
+            return true;
+        });
+        auto &&session = sessions.emplace_back();
+        session.connection = connection;
+        session.thread = std::thread(&Primary::serve_follower, this, std::ref(session));
+    }
+}
+
+void server::replication::Primary::serve_follower(Session &session) {
+    std::string buffer;
+    Record hello{};
+    if (!read_record(session.connection, buffer, hello) || hello.type != HELLO) {
+        shutdown(session.connection, SHUT_RDWR);
+        session.done = true;
+        return;
+    }
+    std::unique_lock<std::mutex> lock(log_mutex);
+    uint64_t position = hello.position;
+    auto &&resumable = hello.log_id == log_id && position + 1 >= first_position && position <= last_position;
+    lock.unlock();
+
+    std::string out;
+    if (resumable) {
+        std::cout << "Follower resumes at position " << position << std::endl;
+    } else {
+        std::vector<FinanceChange> rows;
+        auto &&status = database.snapshot(rows, [this, &position] {
+            std::lock_guard<std::mutex> log_lock(log_mutex);
+            position = last_position;
+        });
+        if (status != 0) {
+            shutdown(session.connection, SHUT_RDWR);
+            session.done = true;
+            return;
+        }
+        encode_record(out, {SNAPSHOT_BEGIN, log_id, position, {}});
+        for (auto &&row : rows) encode_record(out, {SNAPSHOT_ROW, log_id, position, row});
+        encode_record(out, {SNAPSHOT_END, log_id, position, {}});
+        std::cout << "Follower gets snapshot of " << rows.size() << " rows at position " << position << std::endl;
+    }
+    // a follower that falls out of the log is dropped and comes back for a snapshot
+    while (write_all(session.connection, out) && wait_records(position, out)) {}
+    // the descriptor is closed by whoever joins the session
+    shutdown(session.connection, SHUT_RDWR);
+    session.done = true;
+}
+
+bool server::replication::Primary::wait_records(uint64_t &position, std::string &out) {
+    out.clear();
+    std::unique_lock<std::mutex> lock(log_mutex);
+    log_appended.wait(lock, [this, &position] { return stopping || last_position > position; });
+    if (stopping || position + 1 < first_position) return false;
+    while (position < last_position && out.size() < BATCH_BYTES) {
+        out += log[++position - first_position];
+    }
+    return true;
+}
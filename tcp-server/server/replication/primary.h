@@ -0,0 +1,80 @@
+#ifndef ECHOSERVER_REPLICATION_PRIMARY_H
+#define ECHOSERVER_REPLICATION_PRIMARY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "database/findb.h"
+
+namespace server::replication {
+    // Ships every committed change of the database to followers connected on a TCP port.
+    // The log of recent changes lives in memory and gets a fresh random id on every start, so
+    // a follower that reconnects within the retained log resumes from its position and one
+    // that is further behind, or that followed a previous run of the primary, gets a snapshot.
+    class Primary {
+    public:
+        // port 0 picks an ephemeral port, see port(). A listening socket taken over from a running
+        // server is used as is instead of binding port. See listening() for whether it worked
+        Primary(findb &database, int port, size_t log_capacity, int taken_listener = -1);
+
+        ~Primary() {
+            stop();
+        }
+
+        void start();
+
+        void stop();
+
+        // Change listener of the database, called in commit order under the database lock
+        void publish(const FinanceChange &change);
+
+        int port() const { return bound_port; }
+
+        bool listening() const { return listen_descriptor != -1; }
+
+        // For a hot upgrade: the new process accepts followers on the same socket. stop() leaves
+        // the socket itself alone, only this process's descriptor of it is closed
+        int listener() const { return listen_descriptor; }
+
+    private:
+        struct Session {
+            int connection = -1;
+            std::thread thread;
+            std::atomic_bool done{false};
+        };
+
+        void accept_loop();
+
+        void serve_follower(Session &session);
+
+        // Encoded records after position, waits while there are none. False once stopping or
+        // when position has already dropped out of the log
+        bool wait_records(uint64_t &position, std::string &out);
+
+        findb &database;
+        uint64_t log_id;
+        // encoded CHANGE records, log.front() is at first_position
+        std::deque<std::string> log;
+        uint64_t first_position;
+        uint64_t last_position;
+        size_t log_capacity;
+        bool stopping;
+        std::mutex log_mutex;
+        std::condition_variable log_appended;
+        int listen_descriptor;
+        // eventfd that ends the accept loop; shutting the listener down would end it for a new
+        // process sharing the socket as well
+        int wakeup_descriptor;
+        int bound_port;
+        std::thread accept_thread;
+        std::mutex sessions_mutex;
+        // list so sessions keep their address while the others come and go
+        std::list<Session> sessions;
+    };
+}
+
+#endif //ECHOSERVER_REPLICATION_PRIMARY_H
@@ -0,0 +1,102 @@
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "wire.h"
+
+namespace {
+    // far above any real change, protects the follower from a corrupt length
+    const uint32_t MAX_RECORD_SIZE = 1 << 20;
+
+    template<typename Value>
+    void put(std::string &out, Value value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void put_string(std::string &out, const std::string &value) {
+        put(out, static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+
+    template<typename Value>
+    bool get(std::string_view &in, Value &value) {
+        if (in.size() < sizeof(value)) return false;
+        memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return true;
+    }
+
+    bool get_string(std::string_view &in, std::string &value) {
+        uint32_t length;
+        if (!get(in, length) || in.size() < length) return false;
+        value.assign(in.data(), length);
+        in.remove_prefix(length);
+        return true;
+    }
+
+    bool has_change(server::replication::RecordType type) {
+        return type == server::replication::SNAPSHOT_ROW || type == server::replication::CHANGE;
+    }
+
+    bool read_all(int connection, char *data, size_t length) {
+        while (length > 0) {
+            auto &&count = read(connection, data, length);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+}
+
+void server::replication::encode_record(std::string &out, const Record &record) {
+    auto &&length_at = out.size();
+    put(out, uint32_t(0));
+    put(out, record.type);
+    put(out, record.log_id);
+    put(out, record.position);
+    if (has_change(record.type)) {
+        auto &&change = record.change;
+        put(out, change.kind);
+        put(out, change.id);
+        put(out, static_cast<uint8_t>(change.has_value));
+        put(out, change.value);
+        put(out, change.inc_rel);
+        put(out, change.inc_abs);
+        put_string(out, change.currency);
+        put_string(out, change.date);
+    }
+    auto &&length = static_cast<uint32_t>(out.size() - length_at - sizeof(uint32_t));
+    memcpy(&out[length_at], &length, sizeof(length));
+}
+
+bool server::replication::read_record(int connection, std::string &buffer, Record &record) {
+    uint32_t length = 0;
+    if (!read_all(connection, reinterpret_cast<char *>(&length), sizeof(length)) || length > MAX_RECORD_SIZE) {
+        return false;
+    }
+    buffer.resize(length);
+    if (!read_all(connection, &buffer[0], length)) return false;
+    std::string_view in(buffer);
+    if (!get(in, record.type) || !get(in, record.log_id) || !get(in, record.position)) return false;
+    if (!has_change(record.type)) return in.empty();
+    auto &&change = record.change;
+    uint8_t has_value = 0;
+    if (!get(in, change.kind) || !get(in, change.id) || !get(in, has_value) || !get(in, change.value) ||
+        !get(in, change.inc_rel) || !get(in, change.inc_abs) || !get_string(in, change.currency) ||
+        !get_string(in, change.date)) {
+        return false;
+    }
+    change.has_value = has_value != 0;
+    return in.empty();
+}
+
+bool server::replication::write_all(int connection, std::string_view data) {
+    while (!data.empty()) {
+        auto &&written = send(connection, data.data(), data.size(), MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
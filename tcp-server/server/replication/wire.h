@@ -0,0 +1,41 @@
+#ifndef ECHOSERVER_REPLICATION_WIRE_H
+#define ECHOSERVER_REPLICATION_WIRE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "database/findb.h"
+
+// Replication stream between a primary and its followers (host byte order, loopback or same arch):
+//   record: uint32 length of the rest, uint8 type, uint64 log id, uint64 position, [change]
+//   change: uint8 kind, int64 id, uint8 has value, 3 x double value/inc_rel/inc_abs,
+//           uint32 + currency, uint32 + date
+// A follower opens with HELLO carrying the log id and position it has applied. The primary
+// either streams CHANGE records from the next position or, when its log no longer covers that
+// position, sends SNAPSHOT_BEGIN, one SNAPSHOT_ROW per row, SNAPSHOT_END and then streams.
+namespace server::replication {
+    enum RecordType : uint8_t {
+        HELLO = 1,
+        SNAPSHOT_BEGIN = 2,
+        SNAPSHOT_ROW = 3,
+        SNAPSHOT_END = 4,
+        CHANGE = 5
+    };
+
+    struct Record {
+        RecordType type;
+        uint64_t log_id;
+        uint64_t position;
+        // only for SNAPSHOT_ROW and CHANGE
+        FinanceChange change;
+    };
+
+    void encode_record(std::string &out, const Record &record);
+
+    // Reads one record, false on a closed connection or a malformed record
+    bool read_record(int connection, std::string &buffer, Record &record);
+
+    bool write_all(int connection, std::string_view data);
+}
+
+#endif //ECHOSERVER_REPLICATION_WIRE_H
@@ -1,40 +1,305 @@
+#include <iostream>
 #include <sstream>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <linux/errqueue.h>
 #include "server.h"
-#include "utils/sockutils.h"
+#include "transport/socket_transport.h"
+#include "protocol/framing.h"
+#include "protocol/request_parser.h"
+#include "protocol/history_encoding.h"
+#include "protocol/opcode_table.h"
+#include "upgrade/handoff.h"
+#include "tracing/trace.h"
 #include "json/src/json.hpp"
 
+namespace {
+    // whether the request handled on this worker sent anything, see flush_held_reply
+    thread_local bool reply_sent = false;
+}
+
+
+void server::Server::create_transport() {
+    switch (config.transport) {
+        case TransportKind::unix_socket:
+            transport = std::make_unique<transport::SocketTransport>(config.port, config.unix_socket_path);
+            break;
+        case TransportKind::in_process:
+            transport = std::make_unique<transport::InProcessTransport>(IN_PROCESS_RING_BYTES);
+            break;
+        default:
+            transport = std::make_unique<transport::SocketTransport>(config.port, "");
+    }
+    // the upgrade hands descriptors over with SCM_RIGHTS, which only sockets survive
+    if ((config.take_over || !config.upgrade_socket_path.empty()) && !transport->kernel_sockets()) {
+        std::cout <<  "Hot upgrade needs a socket transport" << std::endl;
+        std::exit(1);
+    }
+}
 
 void server::Server::create_server_socket() {
-    auto &&server_d = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_d < 0) {
-        std::cout <<  "Cannot open socket" << std::endl;
+    server_socket = transport->listen();
+    if (server_socket == -1) std::exit(1);
+    bound_port = transport->port();
+}
+
+void server::Server::enable_zerocopy() {
+    int enable = 1;
+    // probed on the listening socket, accept_client sets it on every new client
+    auto &&enabled = setsockopt(server_socket, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+    for (auto &&[client_d, client] : clients) {
+        enabled = setsockopt(client_d, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0 && enabled;
+    }
+    if (!enabled) {
+        std::cout <<  "SO_ZEROCOPY refused, large replies are copied" << std::endl;
+        config.zerocopy_threshold = 0;
+    }
+}
+
+void server::Server::enable_low_latency() {
+    if (config.transport != TransportKind::tcp) {
+        std::cout <<  "Low-latency mode needs the TCP transport, socket options left alone" << std::endl;
+        config.low_latency = false;
+        return;
+    }
+    for (auto &&[client_d, client] : clients) tune_client_socket(client_d);
+}
+
+bool server::Server::tune_client_socket(int client_d) {
+    int enable = 1;
+    if (setsockopt(client_d, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) == -1) return false;
+    // raising it above net.core.busy_read needs CAP_NET_ADMIN, without it the client still gets the rest
+    if (config.busy_poll_us > 0 &&
+        setsockopt(client_d, SOL_SOCKET, SO_BUSY_POLL, &config.busy_poll_us, sizeof(config.busy_poll_us)) == -1) {
+        std::cout <<  "SO_BUSY_POLL refused, clients are not busy polled" << std::endl;
+        config.busy_poll_us = 0;
+    }
+    return true;
+}
+
+// Setting TCP_NODELAY again sends whatever MSG_MORE left in the socket
+void server::Server::flush_held_reply(int client_id) {
+    int enable = 1;
+    setsockopt(client_id, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+void server::Server::create_wakeup_descriptor() {
+    wakeup_descriptor = eventfd(0, EFD_NONBLOCK);
+    if (wakeup_descriptor == -1) {
+        std::cout <<  "Cannot create wakeup eventfd" << std::endl;
         std::exit(1);
     }
-    int enable_options = 1;
-    setsockopt(server_d, SOL_SOCKET, SO_REUSEADDR, &enable_options, sizeof(enable_options));
+}
 
-    sockaddr_in server_address{};
-    bzero(&server_address, sizeof(server_address));
-    server_address.sin_family = AF_INET;
-    server_address.sin_addr.s_addr = INADDR_ANY;
-    server_address.sin_port = htons(SERVER_PORT);
-    auto &&bind_addr = reinterpret_cast<const sockaddr *>(&server_address);
-    auto &&bind_stat = bind(server_d, bind_addr, sizeof(server_address));
-    if (bind_stat < 0) {
-        std::cout <<  "Cannot bind" << std::endl;
+void server::Server::create_upgrade_descriptor() {
+    upgrade_descriptor = handoff::listen_channel(config.upgrade_socket_path, config.take_over);
+    if (upgrade_descriptor == -1) {
+        std::cout <<  "Cannot listen for upgrades on " << config.upgrade_socket_path << std::endl;
         std::exit(1);
     }
-    if (!socket_utils::set_socket_nonblock(server_d)) {
-        std::cout <<  "Cannot set server socket nonblock" << std::endl;
+}
+
+void server::Server::create_quote_table() {
+    if (config.quote_table_path.empty()) return;
+    quote_table = std::make_unique<quotes::QuoteTable>();
+    if (config.quote_reader) {
+        if (!quote_table->open_reader(config.quote_table_path)) {
+            start_failed("Cannot map quote table " + config.quote_table_path);
+            quote_table.reset();
+        }
+        return;
+    }
+    // a server taking over waits for the one it replaces to let go of the table
+    if (!quote_table->open_writer(config.quote_table_path, config.quote_table_slots, config.take_over)) {
+        start_failed("Cannot open quote table " + config.quote_table_path);
+        quote_table.reset();
+        return;
+    }
+    std::vector<FinanceChange> latest;
+    database.latest_rows(latest);
+    quote_table->load(latest);
+}
+
+void server::Server::create_quote_feed() {
+    if (config.feed_group.empty()) return;
+    quote_feed = std::make_unique<feed::QuoteFeed>();
+    if (!quote_feed->open(config.feed_group, config.feed_port, config.feed_interface, config.feed_ttl,
+                          config.feed_retransmit_slots)) {
+        start_failed("Cannot start quote feed on " + config.feed_group + ":" + std::to_string(config.feed_port));
+        quote_feed.reset();
+    }
+}
+
+void server::Server::create_replication() {
+    // the listener of the server taken over keeps the followers' connection attempts queued
+    // across the upgrade, unless this process is told to listen somewhere else
+    if (taken_replication_listener != -1) {
+        sockaddr_in address{};
+        socklen_t address_len = sizeof(address);
+        getsockname(taken_replication_listener, reinterpret_cast<sockaddr *>(&address), &address_len);
+        if (config.replication_port != ntohs(address.sin_port)) {
+            close(taken_replication_listener);
+            taken_replication_listener = -1;
+        }
+    }
+    if (config.replication_port >= 0) {
+        replication_primary = std::make_unique<replication::Primary>(database, config.replication_port,
+                                                                     config.replication_log_size,
+                                                                     taken_replication_listener);
+        taken_replication_listener = -1;
+        if (!replication_primary->listening()) {
+            start_failed("Cannot ship changes to followers");
+            replication_primary.reset();
+        }
+    }
+    // set before the follower and the journal start applying changes
+    auto &&primary = replication_primary.get();
+    auto &&quotes = config.quote_reader ? nullptr : quote_table.get();
+    auto &&feed = quote_feed.get();
+    if (primary || quotes || feed) {
+        database.set_change_listener([primary, quotes, feed](const FinanceChange &change) {
+            if (primary) primary->publish(change);
+            if (quotes) quotes->publish(change);
+            if (feed) feed->publish(change);
+        });
+    }
+    if (!config.primary_host.empty()) {
+        replication_follower = std::make_unique<replication::Follower>(database, config.primary_host,
+                                                                       config.primary_port);
+    }
+}
+
+void server::Server::create_journal() {
+    if (config.journal_path.empty()) return;
+    journal = std::make_unique<IngestJournal>(database, config.journal_path, config.journal_sync_ms,
+                                              config.journal_checkpoint_bytes);
+    // a server taking over waits until the one it replaces has applied and released the journal
+    if (!journal->open(config.take_over)) {
+        start_failed("Cannot start ingest journal " + config.journal_path);
+        journal.reset();
+    }
+}
+
+void server::Server::create_compactor() {
+    // a quote reader's database belongs to the process writing the quotes
+    if (config.retention.empty() || config.quote_reader) return;
+    compactor = std::make_unique<HistoryCompactor>(database, config.retention, config.compaction_batch_rows,
+                                                   config.compaction_pause_ms);
+    compactor->start();
+}
+
+void server::Server::start_failed(const std::string &message) {
+    if (!config.take_over) {
+        std::cout <<  message << std::endl;
         std::exit(1);
     }
-    auto &&listen_stat = listen(server_d, 2);
-    if (listen_stat == -1) {
-        std::cout <<  "set server socket listen error" << std::endl;
+    std::cout <<  message << ", serving the clients taken over without it" << std::endl;
+}
+
+void server::Server::take_over_running_server() {
+    auto &&channel = handoff::request_takeover(config.upgrade_socket_path);
+    if (channel == -1) {
+        std::cout <<  "Cannot reach running server at " << config.upgrade_socket_path << std::endl;
         std::exit(1);
     }
-    server_socket = server_d;
+    handoff::State state;
+    if (!handoff::receive_state(channel, state) || !handoff::send_ack(channel)) {
+        std::cout <<  "Takeover failed, running server keeps serving" << std::endl;
+        std::exit(1);
+    }
+    close(channel);
+    server_socket = state.listen_descriptor;
+    taken_replication_listener = state.replication_descriptor;
+    next_connection_id = state.next_connection_id;
+    for (auto &&taken : state.clients) {
+        epoll_event event{};
+        event.data.fd = taken.descriptor;
+        event.events = EPOLLIN;
+        auto &&client = clients[taken.descriptor] = Client(taken.descriptor, taken.connection_id, event, taken.client_ip);
+        client.receive_buffer = std::move(taken.receive_buffer);
+    }
+    sockaddr_in server_address{};
+    socklen_t address_len = sizeof(server_address);
+    getsockname(server_socket, reinterpret_cast<sockaddr *>(&server_address), &address_len);
+    bound_port = ntohs(server_address.sin_port);
+    std::cout <<  "Took over " << clients.size() << " clients from running server" << std::endl;
+}
+
+// Runs on the epoll thread, which stops reading while the hand-off is in progress
+void server::Server::hand_off(int channel) {
+    if (!handoff::read_takeover_request(channel)) {
+        std::cout <<  "Bad upgrade request ignored" << std::endl;
+        close(channel);
+        return;
+    }
+    std::cout <<  "Hot upgrade requested" << std::endl;
+    // replies to everything already read go out before the new process starts writing
+    watch_connections(EPOLL_CTL_DEL);
+    workers.wait_idle();
+    // the new process replays whatever is still unapplied, better nothing
+    if (journal) journal->wait_applied();
+
+    handoff::State state;
+    state.listen_descriptor = server_socket;
+    state.replication_descriptor = replication_primary ? replication_primary->listener() : -1;
+    state.next_connection_id = next_connection_id;
+    std::unique_lock<std::mutex> lock(clients_mutex);
+    for (auto &&[client_d, client] : clients) {
+        state.clients.push_back({client_d, client.connection_id, client.client_ip_addr, client.receive_buffer});
+    }
+    lock.unlock();
+    auto &&confirmed = handoff::send_state(channel, state) && handoff::wait_ack(channel);
+    close(channel);
+    if (!confirmed) {
+        std::cout <<  "Hot upgrade failed, resuming" << std::endl;
+        watch_connections(EPOLL_CTL_ADD);
+        return;
+    }
+
+    // the new process holds its own copies, closing ours leaves the connections open
+    lock.lock();
+    for (auto &&[client_d, client] : clients) {
+        timers.cancel(client_d);
+        close(client_d);
+        client.is_active = false;
+    }
+    clients.clear();
+    lock.unlock();
+    close(server_socket);
+    server_socket = -1;
+    // followers reconnect to the new process, which accepts them on the same socket from now on
+    if (replication_primary) replication_primary->stop();
+    handed_off = true;
+    terminate = true;
+    std::cout <<  "Handed " << state.clients.size() << " clients over to the new process" << std::endl;
+}
+
+bool server::Server::watch_connections(int operation) {
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLHUP;
+    event.data.fd = server_socket;
+    auto &&watched = epoll_ctl(epoll_descriptor, operation, server_socket, &event) != -1;
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto &&[client_d, client] : clients) {
+        watched = epoll_ctl(epoll_descriptor, operation, client_d, &client.event) != -1 && watched;
+    }
+    return watched;
+}
+
+uint64_t server::Server::monotonic_ms() {
+    auto &&now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+uint64_t server::Server::timer_tick_ms(const ServerConfig &config) {
+    auto &&longest = std::max(config.idle_timeout_ms, config.partial_frame_timeout_ms);
+    return std::max<uint64_t>(10, (longest + TimerWheel::SLOTS - 1) / TimerWheel::SLOTS);
 }
 
 void server::Server::close_client(int client_d) {
@@ -42,27 +307,34 @@ void server::Server::close_client(int client_d) {
     if (clients.find(client_d) == clients.end())
         return;
     auto &&client = clients[client_d];
-    clients.erase(client_d);
     epoll_ctl(epoll_descriptor, EPOLL_CTL_DEL, client_d, &client.event);
-    close(client.descriptor);
+    transport->close(client.descriptor);
     client.is_active = false;
+    clients.erase(client_d);
     lock.unlock();
+    workers.forget(client_d);
     std::cout <<  "Client  disconnected"<< client_d << std::endl;
 }
 
 void server::Server::accept_client() {
-    sockaddr_in client_addr{};
-    auto &&client_addr_in = reinterpret_cast<sockaddr *>(&client_addr);
-    auto &&client_addr_len = static_cast<socklen_t>(sizeof(sockaddr));
-    auto &&client_d = accept(server_socket, client_addr_in, &client_addr_len);
+    std::string client_info;
+    auto &&client_d = transport->accept(server_socket, client_info);
     if (client_d == -1) {
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
             std::cout <<  "Accept failed" << std::endl;
         }
         return;
     }
-    if (!socket_utils::set_socket_nonblock(client_d)) {
-        std::cerr <<  "Cannot set client socket nonblock" << client_d<< std::endl;
+    int enable = 1;
+    if (config.zerocopy_threshold && setsockopt(client_d, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == -1) {
+        // its MSG_ZEROCOPY sends would be copied without a completion ever being queued
+        std::cerr <<  "Cannot enable zerocopy for socket" << client_d << std::endl;
+        transport->close(client_d);
+        return;
+    }
+    if (config.low_latency && !tune_client_socket(client_d)) {
+        std::cerr <<  "Cannot set TCP_NODELAY for socket" << client_d << std::endl;
+        transport->close(client_d);
         return;
     }
     epoll_event event{};
@@ -71,71 +343,220 @@ void server::Server::accept_client() {
     auto &&ctl_stat = epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, client_d, &event);
     if (ctl_stat == -1) {
         std::cerr <<  "epoll_ctl failed" << std::endl;
+        transport->close(client_d);
         return;
     }
-    std::string client_info = inet_ntoa(client_addr.sin_addr);
     std::unique_lock<std::mutex> lock(clients_mutex);
-    clients[client_d] = Client(client_d, event, client_info);
+    auto &&client = clients[client_d] = Client(client_d, next_connection_id++, event, client_info);
     lock.unlock();
+    rearm_client_timer(client, false);
     std::cout <<  "New connection from " << client_info << "on socketstd" << client_d << std::endl;
 }
 
-void server::Server::read_client_data(int client_id) {
+bool server::Server::read_client_data(int client_id) {
     char read_buffer[MESSAGE_SIZE];
-    auto &&count = read(client_id, read_buffer, MESSAGE_SIZE);
-    if (count == -1 && errno == EAGAIN) return;
+    auto &&count = transport->read(client_id, read_buffer, MESSAGE_SIZE);
+    if (count == -1 && errno == EAGAIN) return true;
     if (count == -1) std::cout <<  "Error in read for socket" << client_id << std::endl;
     if (count <= 0) {
+        timers.cancel(client_id);
         close_client(client_id);
-        return;
+        return false;
     }
+    if (config.trace_sample_every) last_read_ns = tracing::now_ns();
     auto &&client = clients[client_id];
     client.receive_buffer.append(read_buffer, static_cast<unsigned long>(count));
+    return true;
 }
 
 void server::Server::handle_client_if_possible(int client_id) {
     auto &&client = clients[client_id];
-    auto &&message_end = client.receive_buffer.find(MESSAGE_END);
-    if (message_end != std::string::npos) {
-        auto &&message = client.receive_buffer.substr(0, message_end);
-        client.receive_buffer.erase(0, message_end + strlen(MESSAGE_END));
-        workers.enqueue(&Server::process_client_message, this, message, client_id);
+    auto &&frame_completed = false;
+    while (protocol::extract_frame(client.receive_buffer, frame_buffer)) {
+        auto &&trace = tracing::sample();
+        if (trace) {
+            tracing::record(trace, tracing::READ, last_read_ns);
+            tracing::record(trace, tracing::FRAMED);
+        }
+        if (capture_writer.is_open()) capture_writer.record(client.connection_id, frame_buffer);
+        workers.enqueue(client_id, frame_buffer, trace);
+        frame_completed = true;
+    }
+    rearm_client_timer(client, frame_completed);
+}
+
+void server::Server::rearm_client_timer(Client &client, bool frame_completed) {
+    auto &&now = monotonic_ms();
+    if (client.receive_buffer.empty()) client.partial_frame_since_ms = 0;
+    else if (frame_completed || client.partial_frame_since_ms == 0) client.partial_frame_since_ms = now;
+    auto &&deadline = UINT64_MAX;
+    if (config.idle_timeout_ms) deadline = now + config.idle_timeout_ms;
+    if (client.partial_frame_since_ms && config.partial_frame_timeout_ms) {
+        deadline = std::min(deadline, client.partial_frame_since_ms + config.partial_frame_timeout_ms);
     }
+    if (deadline == UINT64_MAX) timers.cancel(client.descriptor);
+    else timers.schedule(client.descriptor, deadline);
 }
 
+void server::Server::expire_client(int client_d) {
+    std::unique_lock<std::mutex> lock(clients_mutex);
+    auto &&client = clients.find(client_d);
+    if (client == clients.end()) return;
+    auto &&partial_frame = client->second.partial_frame_since_ms != 0;
+    lock.unlock();
+    std::cout <<  "Client " << client_d << (partial_frame ? " partial frame timeout" : " idle timeout") << std::endl;
+    close_client(client_d);
+}
+
+
+// Writes the whole reply. A client that does not drain its socket within
+// write_stall_timeout_ms gets shut down and is then closed by the epoll thread.
+void server::Server::send_message(int client_id, iovec *iov, int count) {
+    size_t length = 0;
+    for (auto &&i = 0; i < count; ++i) length += iov[i].iov_len;
+    int flags = MSG_NOSIGNAL;
+    if (config.zerocopy_threshold && length >= config.zerocopy_threshold) flags |= MSG_ZEROCOPY;
+    // the reply to the next pipelined request pushes this one out in the same segment
+    if (config.low_latency && WorkerPool::more_queued()) flags |= MSG_MORE;
+    reply_sent = true;
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = static_cast<size_t>(count);
+    uint32_t zerocopy_sends = 0;
+    uint64_t stall_deadline = 0;
+    while (message.msg_iovlen > 0) {
+        auto &&send_stat = transport->send(client_id, message, flags);
+        if (send_stat >= 0) {
+            if ((flags & MSG_ZEROCOPY) && send_stat > 0) ++zerocopy_sends;
+            auto &&sent = static_cast<size_t>(send_stat);
+            while (message.msg_iovlen > 0 && sent >= message.msg_iov->iov_len) {
+                sent -= message.msg_iov->iov_len;
+                ++message.msg_iov;
+                --message.msg_iovlen;
+            }
+            if (message.msg_iovlen > 0) {
+                message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + sent;
+                message.msg_iov->iov_len -= sent;
+            }
+            continue;
+        }
+        if (errno == EINTR) continue;
+        // out of optmem for pinned pages, the rest of the reply is copied
+        if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+            flags &= ~MSG_ZEROCOPY;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cout <<  "Error in send for id" << client_id << std::endl;
+            break;
+        }
+        if (!wait_for_client(client_id, POLLOUT, stall_deadline)) break;
+    }
+    if (zerocopy_sends) await_zerocopy(client_id, zerocopy_sends, stall_deadline);
+}
 
-void send_message(int client_id, std::string_view message) {
-    auto &&send_stat = send(client_id, message.data(), message.length(), 0);
-    if (send_stat == -1) {
-        std::cout <<  "Error in send for id" << client_id << std::endl;
+bool server::Server::wait_for_client(int client_id, short events, uint64_t &stall_deadline) {
+    auto &&now = monotonic_ms();
+    if (stall_deadline == 0) stall_deadline = now + config.write_stall_timeout_ms;
+    short ready = 0;
+    if (config.write_stall_timeout_ms == 0) {
+        ready = transport->wait(client_id, events, -1);
+    } else if (now >= stall_deadline ||
+               (ready = transport->wait(client_id, events, static_cast<int>(stall_deadline - now))) == 0) {
+        std::cout <<  "Write stall timeout for id" << client_id << std::endl;
+        transport->shutdown(client_id);
+        return false;
     }
+    return (ready & POLLNVAL) == 0;
+}
+
+// The kernel numbers the MSG_ZEROCOPY sends of a socket and reports finished ranges on its error
+// queue. A client is served by one worker at a time and every reply waits here for its own sends,
+// so counting completions is enough and no ids have to be tracked per client. The kernel holds its
+// own references to the pages, giving up early only lets the reply change under the send.
+void server::Server::await_zerocopy(int client_id, uint32_t sends, uint64_t &stall_deadline) {
+    while (sends > 0) {
+        char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(client_id, &message, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR) continue;
+            // POLLERR is reported once the error queue has something, whatever the events asked for
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) || !wait_for_client(client_id, 0, stall_deadline)) {
+                abandon_zerocopy(client_id);
+                return;
+            }
+            continue;
+        }
+        for (auto &&cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+            auto &&error = reinterpret_cast<sock_extended_err *>(CMSG_DATA(cmsg));
+            if (error->ee_errno != 0 || error->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // ee_info..ee_data is an inclusive range of send ids, merged by the kernel when it can
+            uint32_t completed = error->ee_data - error->ee_info + 1;
+            sends -= std::min(sends, completed);
+        }
+    }
+}
+
+void server::Server::abandon_zerocopy(int client_id) {
+    char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+    msghdr message{};
+    while (true) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(client_id, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1 && errno != EINTR) break;
+    }
+    // completions still to come would raise EPOLLERR again, the reactor closes the client instead
+    transport->shutdown(client_id);
+}
+
+bool server::Server::has_socket_error(int client_d) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    return getsockopt(client_d, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0;
+}
+
+// Points the parts of the reply at one iovec chain, nothing is copied before the send
+void server::Server::send_reply(int client_id, std::string_view prefix, std::string_view text, std::string_view detail) {
+    iovec reply[protocol::FRAME_IOVECS];
+    auto &&count = protocol::frame_iovecs(reply, prefix, text, detail);
+    tracing::mark(tracing::ENCODED);
+    send_message(client_id, reply, count);
+    tracing::mark(tracing::SENT);
 }
 
 
 void server::Server::process_client_message(std::string &message, int client_id) {
+    reply_sent = false;
     std::cout <<  message << std::endl;
     std::string_view message_view(message);
-    if (message_view.compare(0, MESSAGE_PREFIX_LEN, CMD_PREFIX) == 0) {
-        message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_command(message_view, client_id);
-    } else if (message_view.compare(0, MESSAGE_PREFIX_LEN, TXT_PREFIX) == 0) {
-        message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_text(message_view, client_id);
-    } else if (message_view.compare(0, MESSAGE_PREFIX_LEN, JSON_PREFIX) == 0) {
-        message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_json(message_view, client_id);
-    } else {
-        std::cout <<  "Client" << client_id << "Unknown message type" << message << std::endl;
-        auto &&err_message = ERROR_PREFIX + std::string("Unknown message type") + MESSAGE_END;
-        send_message(client_id, err_message);
+    auto &&type = protocol::message_type(message_view);
+    if (type != protocol::MessageType::unknown) message_view.remove_prefix(MESSAGE_PREFIX_LEN);
+    switch (type) {
+        case protocol::MessageType::command:
+            process_client_command(message_view, client_id);
+            break;
+        case protocol::MessageType::text:
+            process_client_text(message_view, client_id);
+            break;
+        case protocol::MessageType::json:
+            process_client_json(message_view, client_id);
+            break;
+        default:
+            std::cout <<  "Client" << client_id << "Unknown message type" << message << std::endl;
+            send_reply(client_id, ERROR_PREFIX, "Unknown message type");
     }
+    // a request that sent nothing must not leave the reply before it held back
+    if (config.low_latency && !reply_sent && !WorkerPool::more_queued()) flush_held_reply(client_id);
 }
 
 
 void server::Server::process_client_text(std::string_view text, int client_id) {
     std::cout <<  "Text from client" << client_id << ":" << text.data() << std::endl;
-    auto &&to_send = std::string(text) + MESSAGE_END;
-    send_message(client_id, to_send);
+    send_reply(client_id, "", text);
 }
 
 
@@ -143,169 +564,344 @@ void server::Server::process_add_currency(std::string &currency, int client_id)
     std::cout <<  "Client" << client_id << "add currency " << currency<< std::endl;
     auto &&status = database.add_currency(currency);
     if (status == 0) {
-        auto &&response = TXT_PREFIX + std::string("Successfully add currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_reply(client_id, TXT_PREFIX, "Successfully add currency ", currency);
     } else if (status == 1) {
-        auto &&err_message = ERROR_PREFIX + std::string("Currency already exists: ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Currency already exists: ", currency);
     } else {
-        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Database error");
     }
 }
 
 void server::Server::process_add_currency_value(std::string &currency, double value, int client_id) {
     std::cout <<  "Client" << client_id << "add currency " << currency<< "value "<< value << std::endl;
-    auto &&status = database.add_currency_value(currency, value);
+    // resolved once, everything below works on the id
+    auto &&symbol = database.symbol(currency);
+    auto &&status = journal ? journal->append(symbol, currency, value) : database.add_currency_value(symbol, value);
     if (status == 0) {
-        auto &&response = TXT_PREFIX + std::string("Successfully add value for currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_reply(client_id, TXT_PREFIX, "Successfully add value for currency ", currency);
     } else if (status == 1) {
-        auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "No such currency ", currency);
     } else {
-        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Database error");
     }
 }
 
 void server::Server::process_del_currency(std::string &currency, int client_id) {
     std::cout <<  "Client" << client_id << "del currency " << currency<< std::endl;
-    auto &&status = database.del_currency(currency);
+    // journaled values of the currency must not outlive it
+    if (journal) journal->wait_applied();
+    auto &&status = database.del_currency(database.symbol(currency));
     if (status == 0) {
-        auto &&response = TXT_PREFIX + std::string("Successfully del currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_reply(client_id, TXT_PREFIX, "Successfully del currency ", currency);
     } else if (status == 1) {
-        auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "No such currency ", currency);
     } else {
-        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Database error");
     }
 }
 
 void server::Server::process_list_all_currencies(int client_id) {
     std::cout <<  "Client" << client_id << "list all currencies" <<  std::endl;
+    if (config.quote_reader) {
+        list_quotes(client_id);
+        return;
+    }
+    if (journal) journal->wait_applied();
     nlohmann::json json_response;
     auto &&status = database.currency_list(json_response);
     if (status == 0) {
-        auto &&response = JSON_PREFIX + json_response.dump() + MESSAGE_END;
-        send_message(client_id, response);
+        send_reply(client_id, JSON_PREFIX, json_response.dump());
     } else {
-        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Database error");
     }
 }
 
-void server::Server::process_currency_history(std::string &currency, int client_id) {
+// Straight from the shared segment: the newest quote of each currency rather than every row
+void server::Server::list_quotes(int client_id) {
+    if (!quote_table) {
+        send_reply(client_id, ERROR_PREFIX, "Quote table unavailable");
+        return;
+    }
+    thread_local std::vector<quotes::QuoteData> quotes;
+    if (!quote_table->read_all(quotes)) {
+        send_reply(client_id, ERROR_PREFIX, "Quote table was resized by its writer, restart to read it");
+        return;
+    }
+    nlohmann::json json_response;
+    for (auto &&quote : quotes) {
+        json_response.push_back({
+                {"currency",          quote.currency},
+                {"value",             quote.value},
+                {"relative_increase", quote.relative_increase},
+                {"absolute_increase", quote.absolute_increase},
+                {"date",              quote.date},
+        });
+    }
+    send_reply(client_id, JSON_PREFIX, json_response.dump());
+}
+
+void server::Server::process_currency_history(std::string &currency, std::string_view encoding, int client_id) {
+    if (journal) journal->wait_applied();
+    if (!encoding.empty() && encoding != HISTORY_ENCODING_GORILLA) {
+        send_reply(client_id, ERROR_PREFIX, "Unknown encoding ", encoding);
+        return;
+    }
     nlohmann::json json_response;
-    auto &&status = database.currency_history(currency, json_response);
+    auto &&symbol = database.symbol(currency);
+    // dates that do not parse, hand edited rows for instance, fall back to the plain reply
+    auto &&status = encoding.empty() ? database.currency_history(symbol, json_response)
+                                     : compact_currency_history(symbol, currency, json_response);
     if (status == 0) {
-        auto &&response = JSON_PREFIX + json_response.dump() + MESSAGE_END;
-        send_message(client_id, response);
+        send_reply(client_id, JSON_PREFIX, json_response.dump());
     } else if (status == 1) {
-        auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "No such currency ", currency);
     } else {
-        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Database error");
     }
 }
 
+int server::Server::compact_currency_history(SymbolId symbol, const std::string &currency, nlohmann::json &json) {
+    std::vector<HistoryRow> rows;
+    auto &&status = database.currency_history(symbol, rows);
+    if (status != 0) return status;
+    std::vector<protocol::HistoryPoint> points(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        points[i].value = rows[i].value;
+        if (!protocol::parse_history_date(rows[i].date, points[i].time)) return database.currency_history(symbol, json);
+    }
+    std::string payload, encoded;
+    protocol::encode_history(points, payload);
+    protocol::base64_encode(payload, encoded);
+    json["currency"] = currency;
+    json["encoding"] = HISTORY_ENCODING_GORILLA;
+    json["history"] = std::move(encoded);
+    return 0;
+}
+
+void server::Server::process_feed_gap_fill(uint64_t from, uint64_t to, int client_id) {
+    if (!quote_feed) {
+        send_reply(client_id, ERROR_PREFIX, "Quote feed disabled");
+        return;
+    }
+    // built in the request arena, only a gap fill close to FEED_GAP_FILL_MAX outgrows it
+    std::pmr::string datagrams(request_arena()), encoded(request_arena()), reply(request_arena());
+    uint64_t first;
+    auto &&count = quote_feed->gap_fill(from, to, datagrams, first);
+    protocol::base64_encode(datagrams, encoded);
+    auto &&append_field = [&reply](std::string_view name, uint64_t value) {
+        char digits[24];
+        auto &&end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        reply.append(name.data(), name.size()).append(digits, end - digits);
+    };
+    reply.reserve(encoded.size() + 128);
+    append_field("{\"count\":", count);
+    reply.append(",\"datagrams\":\"").append(encoded).append("\"");
+    // first > from tells the consumer the sequences before it are gone for good
+    append_field(",\"first\":", count ? first : 0);
+    append_field(",\"last\":", quote_feed->last_sequence());
+    append_field(",\"session\":", quote_feed->session());
+    reply.push_back('}');
+    send_reply(client_id, JSON_PREFIX, reply);
+}
+
+// Adding a request type is one entry here plus its process_ function
+const server::Server::Route *server::Server::find_route(std::string_view opcode) {
+    using protocol::MessageType;
+    static constexpr auto routes = protocol::make_opcode_table<Route>({
+            {REQUEST_DISCONNECT,           {MessageType::command, NO_FIELDS, false, [](Server &server, RequestArgs &args) {
+                server.close_client(args.client_id);
+            }}},
+            {REQUEST_GET_ALL_CURRENCIES,   {MessageType::command, NO_FIELDS, false, [](Server &server, RequestArgs &args) {
+                server.process_list_all_currencies(args.client_id);
+            }}},
+            {REQUEST_ADD_CURRENCY,         {MessageType::json, CURRENCY_FIELD, true, [](Server &server, RequestArgs &args) {
+                server.process_add_currency(args.currency, args.client_id);
+            }}},
+            {REQUEST_ADD_CURRENCY_VALUE,   {MessageType::json, CURRENCY_FIELD | VALUE_FIELD, true, [](Server &server, RequestArgs &args) {
+                server.process_add_currency_value(args.currency, args.value, args.client_id);
+            }}},
+            {REQUEST_DEL_CURRENCY,         {MessageType::json, CURRENCY_FIELD, true, [](Server &server, RequestArgs &args) {
+                server.process_del_currency(args.currency, args.client_id);
+            }}},
+            {REQUEST_GET_CURRENCY_HISTORY, {MessageType::json, CURRENCY_FIELD, false, [](Server &server, RequestArgs &args) {
+                server.process_currency_history(args.currency, args.encoding, args.client_id);
+            }}},
+            {REQUEST_FEED_GAP_FILL,        {MessageType::json, RANGE_FIELDS, false, [](Server &server, RequestArgs &args) {
+                server.process_feed_gap_fill(args.from, args.to, args.client_id);
+            }}},
+    });
+    return routes.find(opcode);
+}
+
+bool server::Server::is_write_request(const std::string &message) {
+    std::string_view message_view(message);
+    if (protocol::message_type(message_view) != protocol::MessageType::json) return false;
+    message_view.remove_prefix(MESSAGE_PREFIX_LEN);
+    protocol::Request request;
+    if (!protocol::parse_request(message_view, request)) return false;
+    auto &&route = find_route(request.type);
+    return route && route->writes;
+}
+
 void server::Server::process_client_command(std::string_view command, int client_id) {
     std::cout <<  "Command from client " << client_id << ":" << command.data() << std::endl;
-    if (command == "disconnect") {
-        close_client(client_id);
-    } else if (command == REQUEST_GET_ALL_CURRENCIES) {
-        process_list_all_currencies(client_id);
-    } else {
+    auto &&route = find_route(command);
+    if (!route || route->kind != protocol::MessageType::command) {
         std::cout <<  "Client " << client_id << "Unknown command " << command.data() << std::endl;
-        auto &&err_message = ERROR_PREFIX + std::string("Unknown command") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_reply(client_id, ERROR_PREFIX, "Unknown command");
+        return;
     }
+    thread_local std::string no_currency;
+    RequestArgs args{no_currency, 0, client_id, {}};
+    route->handle(*this, args);
 }
 
 
 void server::Server::process_client_json(std::string_view json_string, int client_id) {
     std::cout <<  "Json from client " << client_id << ":" << json_string.data() << std::endl;
-    try {
-        auto &&client_json = nlohmann::json::parse(json_string);
-        std::string request_type = client_json["type"];
-        std::string currency = client_json["currency"];
-        if (request_type == REQUEST_ADD_CURRENCY) {
-            process_add_currency(currency, client_id);
-        } else if (request_type == REQUEST_ADD_CURRENCY_VALUE) {
-            double value = client_json["value"];
-            process_add_currency_value(currency, value, client_id);
-        } else if (request_type == REQUEST_DEL_CURRENCY) {
-            process_del_currency(currency, client_id);
-        } else if (request_type == REQUEST_GET_CURRENCY_HISTORY) {
-            process_currency_history(currency, client_id);
-        } else {
-            std::cout <<  "Client " << client_id << "Unknown request type:" << request_type << std::endl;
-            auto &&err_message = ERROR_PREFIX + std::string("Unknown request type") + MESSAGE_END;
-            send_message(client_id, err_message);
-        }
-
-    } catch (nlohmann::json::parse_error &ex) {
-        std::cout <<  ex.what() << "client" << json_string<< "Unknown request type:" << json_string.data()<< std::endl;
-        auto &&err_message = ERROR_PREFIX + std::string("Incorrect json") + MESSAGE_END;
-        send_message(client_id, err_message);
+    protocol::Request request;
+    if (!protocol::parse_request(json_string, request)) {
+        std::cout <<  "client" << client_id << "Incorrect json:" << json_string.data() << std::endl;
+        send_reply(client_id, ERROR_PREFIX, "Incorrect json");
         return;
     }
-
+    auto &&route = find_route(request.type);
+    if (!route || route->kind != protocol::MessageType::json) {
+        std::cout <<  "Client " << client_id << "Unknown request type:" << request.type << std::endl;
+        send_reply(client_id, ERROR_PREFIX, "Unknown request type");
+        return;
+    }
+    if (((route->required_fields & CURRENCY_FIELD) && request.currency.empty()) ||
+        ((route->required_fields & VALUE_FIELD) && !request.has_value) ||
+        ((route->required_fields & RANGE_FIELDS) && !(request.has_from && request.has_to))) {
+        send_reply(client_id, ERROR_PREFIX, "Incorrect json");
+        return;
+    }
+    if (route->writes && replication_follower) {
+        send_reply(client_id, ERROR_PREFIX, "Read-only follower");
+        return;
+    }
+    if (route->writes && config.quote_reader) {
+        send_reply(client_id, ERROR_PREFIX, "Read-only quote reader");
+        return;
+    }
+    // keeps its capacity between requests handled by this worker
+    thread_local std::string currency;
+    currency.assign(request.currency);
+    RequestArgs args{currency, request.value, client_id, request.encoding, request.from, request.to};
+    route->handle(*this, args);
 }
 
 void server::Server::epoll_loop() {
+    tracing::thread_label = "epoll";
+    if (config.reactor_cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.reactor_cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            std::cout <<  "Cannot pin epoll thread to CPU " << config.reactor_cpu << std::endl;
+        }
+    }
     epoll_descriptor = epoll_create(1);
     if (epoll_descriptor == -1) {
         std::cout <<  "Cannot create epoll descriptor" << std::endl;
         std::exit(1);
     }
-    epoll_event event{};
-    event.events = EPOLLIN | EPOLLHUP;
-    event.data.fd = server_socket;
-    auto &&ctl_stat = epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, server_socket, &event);
-    if (ctl_stat == -1) {
+    // clients are only there already when taken over from a running server
+    if (!watch_connections(EPOLL_CTL_ADD)) {
         std::cout <<  "epoll_ctl failed" << std::endl;
         std::exit(1);
     }
+    for (auto &&[client_d, client] : clients) rearm_client_timer(client, false);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    for (auto &&descriptor : {wakeup_descriptor, upgrade_descriptor}) {
+        if (descriptor == -1) continue;
+        event.data.fd = descriptor;
+        if (epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, descriptor, &event) == -1) {
+            std::cout <<  "epoll_ctl failed" << std::endl;
+            std::exit(1);
+        }
+    }
     std::array<epoll_event, 10> events{};
-    std::cout <<  "Server started on port" << SERVER_PORT<< std::endl;
+    std::cout <<  "Server started on port" << bound_port << std::endl;
+    uint64_t spin_until_ns = 0;
     while (!terminate) {
-        auto &&event_cnt = epoll_wait(epoll_descriptor, events.data(), 10, 1000);
+        // sleeps until the next deadline instead of polling, unless still within the spin budget
+        auto &&timeout = timers.next_timeout_ms(monotonic_ms());
+        if (config.spin_us && tracing::now_ns() < spin_until_ns) timeout = 0;
+        auto &&event_cnt = epoll_wait(epoll_descriptor, events.data(), 10, timeout);
+        // the budget restarts with every event, a wakeup from a blocking wait costs more than it
+        if (config.spin_us && event_cnt > 0) spin_until_ns = tracing::now_ns() + config.spin_us * 1000;
         for (auto &&i = 0; i < event_cnt; ++i) {
             auto &&evt = events[i];
+            if (evt.data.fd == wakeup_descriptor) continue;
+            if (evt.data.fd == upgrade_descriptor) {
+                auto &&channel = accept4(upgrade_descriptor, nullptr, nullptr, SOCK_CLOEXEC);
+                if (channel != -1) hand_off(channel);
+                // the rest of the batch is about descriptors that belong to the new process now
+                if (handed_off) break;
+                continue;
+            }
+            // completions of MSG_ZEROCOPY replies raise EPOLLERR too, the sending worker drains them
+            if ((evt.events & EPOLLERR) && config.zerocopy_threshold && !has_socket_error(evt.data.fd)) {
+                std::this_thread::yield();
+                evt.events &= ~EPOLLERR;
+            }
             if (evt.events & EPOLLERR) {
                 std::cout <<  "Epoll error for socket" << evt.data.fd<< std::endl;
+                timers.cancel(evt.data.fd);
                 close_client(evt.data.fd);
             }
             if (evt.events & EPOLLHUP) {
                 std::cout <<  "client socket closed" << evt.data.fd<< std::endl;
+                timers.cancel(evt.data.fd);
                 close_client(evt.data.fd);
             }
             if (evt.events & EPOLLIN) {
                 if (evt.data.fd == server_socket) accept_client();
-                else {
-                    read_client_data(evt.data.fd);
+                else if (read_client_data(evt.data.fd)) {
                     handle_client_if_possible(evt.data.fd);
                 }
             }
         }
+        timers.advance(monotonic_ms(), [this](int client_d) { expire_client(client_d); });
     }
 }
 
 void server::Server::stop() {
-    if (terminate) return;
     terminate = true;
-    close(server_socket);
+    // the wakeup descriptor lives exactly as long as the server has not been stopped
+    if (wakeup_descriptor == -1) return;
+    uint64_t wakeup = 1;
+    write(wakeup_descriptor, &wakeup, sizeof(wakeup));
     if (server_thread.joinable()) {
         server_thread.join();
     }
+    workers.stop();
+    if (journal) journal->stop();
+    if (compactor) compactor->stop();
+    if (replication_follower) replication_follower->stop();
+    if (replication_primary) replication_primary->stop();
+    // nothing publishes any more; readers keep the last quotes and a successor can take the lock
+    if (quote_table) quote_table->close();
+    close_all_clients();
+    if (server_socket != -1) close(server_socket);
+    if (epoll_descriptor != -1) close(epoll_descriptor);
+    close(wakeup_descriptor);
+    if (upgrade_descriptor != -1) {
+        close(upgrade_descriptor);
+        // after a hand-off the socket path belongs to the new process
+        if (!handed_off) unlink(config.upgrade_socket_path.c_str());
+    }
+    server_socket = epoll_descriptor = wakeup_descriptor = upgrade_descriptor = -1;
+    capture_writer.close();
 }
 
 void server::Server::start() {
     terminate = false;
+    if (replication_primary) replication_primary->start();
+    if (replication_follower) replication_follower->start();
     server_thread = std::move(std::thread(&Server::epoll_loop, this));
 }
 
@@ -321,6 +917,11 @@ void server::Server::close_all_clients() {
     }
 }
 
+std::unique_ptr<server::transport::InProcessStream> server::Server::connect_in_process() {
+    auto &&in_process = dynamic_cast<transport::InProcessTransport *>(transport.get());
+    return in_process ? in_process->connect() : nullptr;
+}
+
 std::string server::Server::list_clients() {
     std::stringstream out_string;
     out_string << "Clients connected:";
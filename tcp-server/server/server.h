@@ -10,33 +10,55 @@
 #include <sys/epoll.h>
 #include <arpa/inet.h>
 
-#include "thread_pool/ThreadPool.h"
+#include "workers/worker_pool.h"
+#include "utils/timer_wheel.h"
 #include "database/findb.h"
+#include "database/ingest_journal.h"
+#include "database/history_compactor.h"
+#include "capture/capture.h"
+#include "replication/primary.h"
+#include "replication/follower.h"
+#include "quotes/quote_table.h"
+#include "feed/quote_feed.h"
+#include "tracing/trace.h"
+#include "protocol/framing.h"
+#include "transport/transport.h"
+#include "transport/in_process.h"
+#include "server_config.h"
 #include "defines.h"
 
 namespace server {
     class Client {
     public:
-        Client() : descriptor(-1), is_active(false), event{} {
+        Client() : descriptor(-1), connection_id(0), partial_frame_since_ms(0), event{}, is_active(false) {
             mutex = std::make_unique<std::mutex>();
         }
 
-        explicit Client(int descriptor, epoll_event &event, std::string &client_ip) :
-                descriptor(descriptor), is_active(true), event(event), client_ip_addr(client_ip) {
+        explicit Client(int descriptor, uint32_t connection_id, epoll_event &event, std::string &client_ip) :
+                descriptor(descriptor), connection_id(connection_id), partial_frame_since_ms(0), event(event), is_active(true),
+                client_ip_addr(client_ip) {
             mutex = std::make_unique<std::mutex>();
         }
 
         Client &operator=(Client &&other) noexcept {
             if (this != &other) {
                 descriptor = other.descriptor;
+                connection_id = other.connection_id;
+                partial_frame_since_ms = other.partial_frame_since_ms;
+                event = other.event;
                 is_active = other.is_active.load();
                 mutex = std::move(other.mutex);
                 receive_buffer = std::move(other.receive_buffer);
+                client_ip_addr = std::move(other.client_ip_addr);
             }
             return *this;
         }
 
         int descriptor;
+        // unlike descriptor, never reused during the server lifetime
+        uint32_t connection_id;
+        // when the first byte of a still incomplete frame arrived, 0 if the buffer holds none
+        uint64_t partial_frame_since_ms;
         epoll_event event;
         volatile std::atomic_bool is_active;
         std::string receive_buffer;
@@ -48,8 +70,32 @@ namespace server {
     class Server {
 
     public:
-        Server() : server_socket(-1), epoll_descriptor(-1), terminate(false), workers(4), database() {
-            create_server_socket();
+        explicit Server(ServerConfig config = {}) :
+                config(std::move(config)),
+                workers(4, 1024, [this](std::string &message, int client_id) {
+                    process_client_message(message, client_id);
+                }, this->config.worker_quantum_us),
+                database(this->config.database_path), next_connection_id(1),
+                timers(timer_tick_ms(this->config), monotonic_ms()), terminate(false),
+                server_socket(-1), epoll_descriptor(-1), wakeup_descriptor(-1), upgrade_descriptor(-1), bound_port(-1),
+                handed_off(false) {
+            create_transport();
+            if (this->config.take_over) take_over_running_server();
+            else create_server_socket();
+            if (this->config.zerocopy_threshold) enable_zerocopy();
+            if (this->config.low_latency) enable_low_latency();
+            create_wakeup_descriptor();
+            if (!this->config.upgrade_socket_path.empty()) create_upgrade_descriptor();
+            if (!this->config.capture_path.empty()) capture_writer.open(this->config.capture_path);
+            tracing::set_sample_every(this->config.trace_sample_every);
+            create_quote_table();
+            create_quote_feed();
+            create_replication();
+            create_journal();
+            create_compactor();
+            if (this->config.prioritize_writes) {
+                workers.set_priority_classifier([](const std::string &message) { return is_write_request(message); });
+            }
         }
 
         ~Server() {
@@ -57,14 +103,119 @@ namespace server {
         }
 
     private:
+        // What a route handler gets from the request, fields not required by the route are empty
+        struct RequestArgs {
+            std::string &currency;
+            double value;
+            int client_id;
+            std::string_view encoding;
+            uint64_t from = 0;
+            uint64_t to = 0;
+        };
+
+        enum RequiredFields : uint8_t {
+            NO_FIELDS = 0,
+            CURRENCY_FIELD = 1,
+            VALUE_FIELD = 2,
+            // from and to of FEED_GAP_FILL
+            RANGE_FIELDS = 4
+        };
+
+        struct Route {
+            protocol::MessageType kind;
+            uint8_t required_fields;
+            // refused by a read-only follower
+            bool writes;
+            void (*handle)(Server &server, RequestArgs &args);
+        };
+
+        // Compile-time perfect hash over every request opcode, see the table in server.cpp
+        static const Route *find_route(std::string_view opcode);
+
+        // Whether a raw frame is a request its route marks as writing, for the worker scheduler
+        static bool is_write_request(const std::string &message);
+
         void create_server_socket();
 
+        void create_wakeup_descriptor();
+
+        void create_upgrade_descriptor();
+
+        void create_quote_table();
+
+        void create_quote_feed();
+
+        // Primary or follower side, as configured
+        void create_replication();
+
+        void create_journal();
+
+        void create_compactor();
+
+        // Startup failure of an optional part: exits on a fresh start, a server that took clients
+        // over goes on without the part instead of dropping every connection
+        void start_failed(const std::string &message);
+
+        // Adopts the listening socket and clients of the server at config.upgrade_socket_path
+        void take_over_running_server();
+
+        // Passes everything to the process on channel, or resumes serving if it does not confirm
+        void hand_off(int channel);
+
+        // EPOLL_CTL_ADD or EPOLL_CTL_DEL for the listening socket and every client
+        bool watch_connections(int operation);
+
         void accept_client();
 
-        void read_client_data(int client_id);
+        // false when the client got closed
+        bool read_client_data(int client_id);
 
         void handle_client_if_possible(int client_id);
 
+        // Re-arms the idle or partial frame deadline after data from the client
+        void rearm_client_timer(Client &client, bool frame_completed);
+
+        void expire_client(int client_d);
+
+        // Picks the transport for config.transport
+        void create_transport();
+
+        // SO_ZEROCOPY on the listening socket and taken over clients, turns MSG_ZEROCOPY off if refused
+        void enable_zerocopy();
+
+        // Low-latency options on taken over clients, turns the mode off for a transport without TCP
+        void enable_low_latency();
+
+        // TCP_NODELAY and SO_BUSY_POLL on one client, false if the socket refused TCP_NODELAY
+        bool tune_client_socket(int client_d);
+
+        // Pushes a reply held back with MSG_MORE when the request after it sent nothing
+        void flush_held_reply(int client_id);
+
+        // Sends iov[0..count) in full with one gathering sendmsg per attempt; iov is consumed
+        void send_message(int client_id, iovec *iov, int count);
+
+        // Waits for POLLOUT (or for the error queue with events 0). False once the client has
+        // stalled for write_stall_timeout_ms, it is shut down then.
+        bool wait_for_client(int client_id, short events, uint64_t &stall_deadline);
+
+        // Waits until the kernel is done with the pages of the last `sends` MSG_ZEROCOPY sendmsg calls
+        void await_zerocopy(int client_id, uint32_t sends, uint64_t &stall_deadline);
+
+        // Giving up on the completions: reads what is queued and shuts the client down, so the
+        // level-triggered EPOLLERR of unread ones cannot keep the reactor spinning
+        void abandon_zerocopy(int client_id);
+
+        // Whether client_d has a pending socket error, as opposed to only zerocopy completions queued
+        static bool has_socket_error(int client_d);
+
+        void send_reply(int client_id, std::string_view prefix, std::string_view text, std::string_view detail = {});
+
+        static uint64_t monotonic_ms();
+
+        // Wheel resolution such that the longest configured timeout fits in one revolution
+        static uint64_t timer_tick_ms(const ServerConfig &config);
+
         void process_client_message(std::string &message, int client_id);
 
         void process_client_command(std::string_view command, int client_id);
@@ -81,7 +232,16 @@ namespace server {
 
         void process_list_all_currencies(int client_id);
 
-        void process_currency_history(std::string &currency, int client_id);
+        // GET_ALL_CURRENCIES of a quote reader
+        void list_quotes(int client_id);
+
+        void process_currency_history(std::string &currency, std::string_view encoding, int client_id);
+
+        // GET_CURRENCY_HISTORY reply in HISTORY_ENCODING_GORILLA, same status codes as findb
+        int compact_currency_history(SymbolId symbol, const std::string &currency, nlohmann::json &json);
+
+        // Datagrams from..to of the quote feed again, base64 encoded since frames have to stay MESSAGE_END safe
+        void process_feed_gap_fill(uint64_t from, uint64_t to, int client_id);
 
         void epoll_loop();
 
@@ -98,15 +258,50 @@ namespace server {
 
         std::string list_clients();
 
+        // port actually bound, differs from config.port when that is 0
+        int port() const { return bound_port; }
+
+        // Client end of a new in-process connection, null unless config.transport is in_process
+        std::unique_ptr<transport::InProcessStream> connect_in_process();
+
     private:
+        ServerConfig config;
+        std::unique_ptr<transport::Transport> transport;
         std::unordered_map<int, Client> clients;
         std::thread server_thread;
         std::mutex clients_mutex;
-        ThreadPool workers;
+        WorkerPool workers;
         findb database;
+        // in front of the database for added values when configured
+        std::unique_ptr<IngestJournal> journal;
+        // rolls old history into config.retention tiers, null when that is empty
+        std::unique_ptr<HistoryCompactor> compactor;
+        capture::CaptureWriter capture_writer;
+        std::unique_ptr<replication::Primary> replication_primary;
+        // follower listener of the server taken over, until create_replication adopts or closes it
+        int taken_replication_listener = -1;
+        std::unique_ptr<replication::Follower> replication_follower;
+        // written through the change listener, or only read with config.quote_reader
+        std::unique_ptr<quotes::QuoteTable> quote_table;
+        // multicast feed of accepted values, null when disabled
+        std::unique_ptr<feed::QuoteFeed> quote_feed;
+        uint32_t next_connection_id;
+        // reused by the epoll thread for every extracted frame
+        std::string frame_buffer;
+        // when the last read returned, the READ stage of a sampled frame; kept only while tracing
+        uint64_t last_read_ns = 0;
+        // idle and partial frame deadlines, only touched by the epoll thread
+        TimerWheel timers;
         volatile std::atomic_bool terminate;
         int server_socket;
         int epoll_descriptor;
+        // eventfd that wakes epoll_wait on stop, which may otherwise block without a timeout
+        int wakeup_descriptor;
+        // listening Unix socket for hot upgrades, -1 when disabled
+        int upgrade_descriptor;
+        int bound_port;
+        // set once a new process owns the connections, they must not be closed on stop then
+        bool handed_off;
     };
 };
 
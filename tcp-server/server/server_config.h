@@ -0,0 +1,84 @@
+#ifndef ECHOSERVER_SERVER_CONFIG_H
+#define ECHOSERVER_SERVER_CONFIG_H
+
+#include <string>
+#include <vector>
+#include "database/history_compactor.h"
+#include "defines.h"
+
+namespace server {
+    enum class TransportKind {
+        tcp,
+        // Unix domain stream socket at unix_socket_path
+        unix_socket,
+        // clients in the same process connect through Server::connect_in_process, see transport/in_process.h
+        in_process
+    };
+
+    struct ServerConfig {
+        // 0 picks an ephemeral port, see Server::port
+        int port = SERVER_PORT;
+        TransportKind transport = TransportKind::tcp;
+        std::string unix_socket_path;
+        std::string database_path = "finance.db";
+        // inbound frames are recorded here for later replay, empty disables capture
+        std::string capture_path;
+        // a client sending nothing for this long is disconnected, never by default
+        uint64_t idle_timeout_ms = CLIENT_IDLE_TIMEOUT_MS;
+        // a frame has to be completed this long after its first byte arrived
+        uint64_t partial_frame_timeout_ms = PARTIAL_FRAME_TIMEOUT_MS;
+        // a reply that cannot be written for this long drops the client
+        uint64_t write_stall_timeout_ms = WRITE_STALL_TIMEOUT_MS;
+        // Unix socket a new process connects to for a hot upgrade, empty disables
+        std::string upgrade_socket_path;
+        // start by taking the listening socket and clients over from the server at upgrade_socket_path
+        bool take_over = false;
+        // primary: port followers connect to, 0 picks an ephemeral one and -1 disables
+        int replication_port = -1;
+        size_t replication_log_size = REPLICATION_LOG_SIZE;
+        // follower: replicate from this primary and refuse writes, empty host runs standalone
+        std::string primary_host;
+        int primary_port = 0;
+        // values are acknowledged once in this journal and applied to the database in the background,
+        // empty writes them to the database directly
+        std::string journal_path;
+        int journal_sync_ms = JOURNAL_SYNC_MS;
+        size_t journal_checkpoint_bytes = JOURNAL_CHECKPOINT_BYTES;
+        // history tiers the background compactor keeps, empty keeps every row forever
+        std::vector<RetentionTier> retention;
+        size_t compaction_batch_rows = COMPACTION_BATCH_ROWS;
+        int compaction_pause_ms = COMPACTION_PAUSE_MS;
+        // shared-memory segment with the latest quote of every currency, kept up to date by this
+        // server, or read from when quote_reader is set; empty disables
+        std::string quote_table_path;
+        uint32_t quote_table_slots = QUOTE_TABLE_SLOTS;
+        // answer GET_ALL_CURRENCIES from quote_table_path written by another process, refuse writes
+        bool quote_reader = false;
+        // multicast group every accepted value is published to, empty disables; see feed/feed_wire.h
+        std::string feed_group;
+        int feed_port = FEED_PORT;
+        // address of the interface the feed goes out of, the loopback one keeps it on this host
+        std::string feed_interface = "127.0.0.1";
+        int feed_ttl = 1;
+        size_t feed_retransmit_slots = FEED_RETRANSMIT_SLOTS;
+        // trace one request in this many, 0 disables; see tracing/trace.h
+        uint32_t trace_sample_every = 0;
+        // worker time a client gets per scheduling round before other clients' requests go first
+        uint64_t worker_quantum_us = WORKER_QUANTUM_US;
+        // requests that change data are scheduled ahead of reads from other clients
+        bool prioritize_writes = false;
+        // replies of at least this many bytes are sent with MSG_ZEROCOPY, 0 copies every reply
+        size_t zerocopy_threshold = 0;
+        // TCP only: TCP_NODELAY and SO_BUSY_POLL on every client, and replies with more of the
+        // client's requests queued behind them are held back with MSG_MORE to leave together
+        bool low_latency = false;
+        // SO_BUSY_POLL with low_latency, 0 leaves the kernel default
+        int busy_poll_us = BUSY_POLL_US;
+        // the epoll thread polls without blocking for this long after its last event, 0 always blocks
+        uint64_t spin_us = 0;
+        // CPU the epoll thread is pinned to, -1 leaves it to the scheduler
+        int reactor_cpu = -1;
+    };
+}
+
+#endif //ECHOSERVER_SERVER_CONFIG_H
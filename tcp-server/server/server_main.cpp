@@ -1,5 +1,7 @@
 #include <iostream>
 #include <sstream>
+#include <poll.h>
+#include <unistd.h>
 #include "server.h"
 
 void help() {
@@ -9,20 +11,134 @@ void help() {
     out_string << "list: list connected clients\n";
     out_string << "kill [id]: disconnect client with specified id\n";
     out_string << "killall: disconnect all clients\n";
+    out_string << "trace [file]: write sampled request traces as Chrome trace json, trace.json by default\n";
     out_string << "shutdown: shutdown server\n";
+    out_string << "for a restart without dropping clients start the new server with --takeover\n";
 
     std::cout << out_string.str() << std::endl;
 }
 
+void usage() {
+    std::cout << "server [--port port | --unix-socket path] [--db finance.db] [--capture file]\n"
+              << "       [--idle-timeout-ms ms] [--partial-frame-timeout-ms ms] [--write-stall-timeout-ms ms]\n"
+              << "       [--upgrade-socket path [--takeover]]\n"
+              << "       [--replication-port port | --follow host:port]\n"
+              << "       [--journal file [--journal-sync-ms ms]] [--retention tiers [--compaction-pause-ms ms]]\n"
+              << "       [--worker-quantum-us us] [--prioritize-writes]\n"
+              << "       [--quote-table file | --quote-reader file] [--trace-sample n]\n"
+              << "       [--zerocopy-threshold bytes] [--feed group:port [--feed-interface address]]\n"
+              << "       [--low-latency [--busy-poll-us us]] [--spin-us us] [--reactor-cpu cpu]\n"
+              << "  --unix-socket path: listen on a Unix domain socket instead of TCP\n"
+              << "  --capture file: record every inbound frame for replay\n"
+              << "  --upgrade-socket path: accept hot upgrades on this Unix socket\n"
+              << "  --takeover: take the port and clients over from the server on --upgrade-socket\n"
+              << "  --replication-port port: ship every change to followers connecting on port\n"
+              << "  --follow host:port: read-only copy of the primary with that replication port\n"
+              << "  --journal file: acknowledge values once journaled, apply them in the background\n"
+              << "  --journal-sync-ms ms: fsync batching window, 0 syncs every append group, -1 never\n"
+              << "  --retention tiers: compact old history in the background, e.g. raw:7d,1m:90d,1h keeps raw\n"
+              << "    values for 7 days, the last one per minute for 90 days and the last one per hour after that\n"
+              << "  --compaction-pause-ms ms: pause after each compaction batch\n"
+              << "  --quote-table file: publish the latest quote of every currency in this shared memory file\n"
+              << "  --quote-reader file: read-only server answering GET_ALL_CURRENCIES from that file\n"
+              << "  --trace-sample n: trace one request in n, dump with the trace console command\n"
+              << "  --worker-quantum-us us: worker time per client and scheduling round\n"
+              << "  --prioritize-writes: serve clients whose next request writes ahead of readers\n"
+              << "  --feed group:port: multicast every accepted value, missed ones are served by FEED_GAP_FILL\n"
+              << "  --feed-interface address: interface the feed is sent out of, 127.0.0.1 by default\n"
+              << "  --zerocopy-threshold bytes: send replies at least this large with MSG_ZEROCOPY\n"
+              << "  --low-latency: TCP_NODELAY and SO_BUSY_POLL on clients, pipelined replies leave together\n"
+              << "  --busy-poll-us us: SO_BUSY_POLL of --low-latency, 0 keeps the kernel default\n"
+              << "  --spin-us us: keep polling epoll this long after the last event before blocking,\n"
+              << "    only worth it with a CPU to spare for the epoll thread, see --reactor-cpu\n"
+              << "  --reactor-cpu cpu: pin the epoll thread to this CPU\n"
+              << "  timeouts of 0 are disabled, the idle timeout is unless --idle-timeout-ms is given" << std::endl;
+}
+
 int main(int argc, char **argv) {
-    auto &&server = server::Server();
+    server::ServerConfig config;
+    for (auto &&i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto &&has_value = i + 1 < argc;
+        if (arg == "--port" && has_value) config.port = std::stoi(argv[++i]);
+        else if (arg == "--unix-socket" && has_value) {
+            config.transport = server::TransportKind::unix_socket;
+            config.unix_socket_path = argv[++i];
+        }
+        else if (arg == "--db" && has_value) config.database_path = argv[++i];
+        else if (arg == "--capture" && has_value) config.capture_path = argv[++i];
+        else if (arg == "--idle-timeout-ms" && has_value) config.idle_timeout_ms = std::stoull(argv[++i]);
+        else if (arg == "--partial-frame-timeout-ms" && has_value) config.partial_frame_timeout_ms = std::stoull(argv[++i]);
+        else if (arg == "--write-stall-timeout-ms" && has_value) config.write_stall_timeout_ms = std::stoull(argv[++i]);
+        else if (arg == "--upgrade-socket" && has_value) config.upgrade_socket_path = argv[++i];
+        else if (arg == "--takeover") config.take_over = true;
+        else if (arg == "--journal" && has_value) config.journal_path = argv[++i];
+        else if (arg == "--journal-sync-ms" && has_value) config.journal_sync_ms = std::stoi(argv[++i]);
+        else if (arg == "--retention" && has_value) {
+            if (!HistoryCompactor::parse_tiers(argv[++i], config.retention)) {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--compaction-pause-ms" && has_value) config.compaction_pause_ms = std::stoi(argv[++i]);
+        else if (arg == "--worker-quantum-us" && has_value) config.worker_quantum_us = std::stoull(argv[++i]);
+        else if (arg == "--prioritize-writes") config.prioritize_writes = true;
+        else if (arg == "--trace-sample" && has_value) config.trace_sample_every = std::stoul(argv[++i]);
+        else if (arg == "--zerocopy-threshold" && has_value) config.zerocopy_threshold = std::stoull(argv[++i]);
+        else if (arg == "--low-latency") config.low_latency = true;
+        else if (arg == "--busy-poll-us" && has_value) config.busy_poll_us = std::stoi(argv[++i]);
+        else if (arg == "--spin-us" && has_value) config.spin_us = std::stoull(argv[++i]);
+        else if (arg == "--reactor-cpu" && has_value) config.reactor_cpu = std::stoi(argv[++i]);
+        else if (arg == "--quote-table" && has_value) config.quote_table_path = argv[++i];
+        else if (arg == "--quote-reader" && has_value) {
+            config.quote_table_path = argv[++i];
+            config.quote_reader = true;
+        }
+        else if (arg == "--feed" && has_value && std::string(argv[i + 1]).find(':') != std::string::npos) {
+            std::string feed = argv[++i];
+            auto &&colon = feed.rfind(':');
+            config.feed_group = feed.substr(0, colon);
+            config.feed_port = std::stoi(feed.substr(colon + 1));
+        }
+        else if (arg == "--feed-interface" && has_value) config.feed_interface = argv[++i];
+        else if (arg == "--replication-port" && has_value) config.replication_port = std::stoi(argv[++i]);
+        else if (arg == "--follow" && has_value && std::string(argv[i + 1]).find(':') != std::string::npos) {
+            std::string primary = argv[++i];
+            auto &&colon = primary.rfind(':');
+            config.primary_host = primary.substr(0, colon);
+            config.primary_port = std::stoi(primary.substr(colon + 1));
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    // a follower applies changes without publishing them, so it cannot feed followers of its own
+    // a quote reader answers from a table another process writes, it has nothing to publish
+    if ((config.take_over && config.upgrade_socket_path.empty()) ||
+        (config.replication_port >= 0 && !config.primary_host.empty()) ||
+        (config.quote_reader && (config.replication_port >= 0 || !config.journal_path.empty()))) {
+        usage();
+        return 1;
+    }
+    // lets the console notice a hand-off while waiting for input, see in_avail below
+    std::ios::sync_with_stdio(false);
+    auto &&server = server::Server(config);
     server.start();
     std::string command;
     while (server.is_active()) {
-        std::getline(std::cin, command);
+        // the server stops by itself once a new process took everything over
+        pollfd console{STDIN_FILENO, POLLIN, 0};
+        if (std::cin.rdbuf()->in_avail() <= 0 && poll(&console, 1, 200) <= 0) continue;
+        if (!std::getline(std::cin, command)) break;
         if (command == "help") help();
         else if (command == "list") std::cout << server.list_clients() << std::endl;
         else if (command == "killall") server.close_all_clients();
+        else if (!command.compare(0, 5, "trace")) {
+            auto &&path = command.size() > 6 ? command.substr(6) : std::string("trace.json");
+            if (server::tracing::dump_chrome_trace(path)) std::cout << "Trace written to " << path << std::endl;
+            else std::cout << "Cannot write trace to " << path << std::endl;
+        }
         else if (!command.compare(0, 4, "kill")) {
             auto&& client_id = std::stoi(command.substr(5));
             server.close_client(client_id);
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "trace.h"
+#include "defines.h"
+#include "json/src/json.hpp"
+
+namespace {
+    // Fields are atomics only so the dump may read a slot the owner is overwriting; whether it
+    // did is decided by the written counter, see collect
+    struct Event {
+        std::atomic<uint64_t> trace{0};
+        std::atomic<uint64_t> time_ns{0};
+        std::atomic<uint8_t> stage{0};
+    };
+
+    struct ThreadBuffer {
+        int tid = 0;
+        std::string name;
+        std::atomic<uint64_t> written{0};
+        Event events[TRACE_BUFFER_EVENTS];
+    };
+
+    struct Collected {
+        uint64_t trace;
+        uint64_t time_ns;
+        server::tracing::Stage stage;
+        int tid;
+    };
+
+    std::atomic<uint32_t> sample_every{0};
+    uint64_t frames_seen = 0;
+    uint64_t next_trace = 0;
+    std::mutex registry_mutex;
+    // kept after their thread exits, the events outlive it
+    std::vector<std::shared_ptr<ThreadBuffer>> registry;
+    thread_local ThreadBuffer *own_buffer = nullptr;
+
+    ThreadBuffer &thread_buffer() {
+        if (!own_buffer) {
+            auto &&buffer = std::make_shared<ThreadBuffer>();
+            buffer->tid = static_cast<int>(syscall(SYS_gettid));
+            if (server::tracing::thread_label) buffer->name = server::tracing::thread_label;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(buffer);
+            own_buffer = buffer.get();
+        }
+        return *own_buffer;
+    }
+
+    void collect(ThreadBuffer &buffer, std::vector<Collected> &events) {
+        uint64_t written = buffer.written.load(std::memory_order_acquire);
+        uint64_t first = written > TRACE_BUFFER_EVENTS ? written - TRACE_BUFFER_EVENTS : 0;
+        size_t begin = events.size();
+        for (uint64_t i = first; i < written; ++i) {
+            auto &&event = buffer.events[i % TRACE_BUFFER_EVENTS];
+            events.push_back({event.trace.load(std::memory_order_relaxed), event.time_ns.load(std::memory_order_relaxed),
+                              static_cast<server::tracing::Stage>(event.stage.load(std::memory_order_relaxed)),
+                              buffer.tid});
+        }
+        // whatever the owner wrote meanwhile may have replaced the oldest copies, and the event it
+        // may be writing right now, index now_written, lands on the slot of now_written - N
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now_written = buffer.written.load(std::memory_order_relaxed);
+        uint64_t valid_from = now_written + 1 > TRACE_BUFFER_EVENTS ? now_written + 1 - TRACE_BUFFER_EVENTS : 0;
+        if (valid_from > first) {
+            uint64_t stale = std::min<uint64_t>(valid_from - first, written - first);
+            events.erase(events.begin() + static_cast<long>(begin), events.begin() + static_cast<long>(begin + stale));
+        }
+    }
+
+    // A span ends at each stage and is named after what happened since the previous one
+    const char *span_name(server::tracing::Stage stage) {
+        switch (stage) {
+            case server::tracing::FRAMED: return "frame";
+            case server::tracing::ENQUEUED: return "enqueue";
+            case server::tracing::DEQUEUED: return "queue wait";
+            case server::tracing::FINDB_START: return "dispatch";
+            case server::tracing::DB_LOCKED: return "db_mutex wait";
+            case server::tracing::FINDB_END: return "findb";
+            case server::tracing::ENCODED: return "encode";
+            case server::tracing::SENT: return "send";
+            default: return "read";
+        }
+    }
+}
+
+void server::tracing::set_sample_every(uint32_t every) {
+    sample_every.store(every, std::memory_order_relaxed);
+}
+
+uint64_t server::tracing::sample() {
+    auto &&every = sample_every.load(std::memory_order_relaxed);
+    if (every == 0 || frames_seen++ % every != 0) return 0;
+    return ++next_trace;
+}
+
+uint64_t server::tracing::now_ns() {
+    auto &&now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+void server::tracing::record(uint64_t trace, Stage stage, uint64_t time_ns) {
+    auto &&buffer = thread_buffer();
+    uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    auto &&event = buffer.events[index % TRACE_BUFFER_EVENTS];
+    event.trace.store(trace, std::memory_order_relaxed);
+    event.time_ns.store(time_ns, std::memory_order_relaxed);
+    event.stage.store(stage, std::memory_order_relaxed);
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+bool server::tracing::dump_chrome_trace(const std::string &path) {
+    std::vector<Collected> events;
+    nlohmann::json trace_events = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &&buffer : registry) {
+            collect(*buffer, events);
+            if (!buffer->name.empty()) {
+                trace_events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", getpid()},
+                                        {"tid", buffer->tid}, {"args", {{"name", buffer->name}}}});
+            }
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Collected &left, const Collected &right) {
+        return left.trace != right.trace ? left.trace < right.trace : left.time_ns < right.time_ns;
+    });
+    for (size_t first = 0; first < events.size();) {
+        size_t last = first;
+        while (last + 1 < events.size() && events[last + 1].trace == events[first].trace) ++last;
+        auto &&request = events[first];
+        // the whole request on the thread it arrived on, stages nested below it
+        trace_events.push_back({{"name", "request"}, {"cat", "request"}, {"ph", "X"}, {"pid", getpid()},
+                                {"tid", request.tid}, {"ts", request.time_ns / 1000.0},
+                                {"dur", (events[last].time_ns - request.time_ns) / 1000.0},
+                                {"args", {{"trace", request.trace}}}});
+        for (size_t i = first + 1; i <= last; ++i) {
+            auto &&from = events[i - 1];
+            auto &&to = events[i];
+            trace_events.push_back({{"name", span_name(to.stage)}, {"cat", "stage"}, {"ph", "X"}, {"pid", getpid()},
+                                    {"tid", to.tid}, {"ts", from.time_ns / 1000.0},
+                                    {"dur", (to.time_ns - from.time_ns) / 1000.0},
+                                    {"args", {{"trace", to.trace}}}});
+        }
+        first = last + 1;
+    }
+    std::ofstream out(path);
+    if (!out) return false;
+    out << nlohmann::json({{"traceEvents", trace_events}, {"displayTimeUnit", "ms"}}).dump();
+    return static_cast<bool>(out);
+}
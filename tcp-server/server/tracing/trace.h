@@ -0,0 +1,69 @@
+#ifndef ECHOSERVER_TRACE_H
+#define ECHOSERVER_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Sampled request tracing. One frame in sample_every gets a trace id on the epoll thread and
+// every stage it passes through is timestamped with the monotonic clock into a buffer owned by
+// the recording thread. Buffers are single producer rings without locks; the oldest events are
+// overwritten. dump_chrome_trace turns what the rings hold into Chrome trace-event JSON, one
+// span per stage of each request, loadable in chrome://tracing or Perfetto.
+namespace server::tracing {
+    enum Stage : uint8_t {
+        READ,
+        FRAMED,
+        ENQUEUED,
+        DEQUEUED,
+        FINDB_START,
+        // db_mutex acquired, only on the paths that take it
+        DB_LOCKED,
+        FINDB_END,
+        ENCODED,
+        SENT
+    };
+
+    // Trace id of the request the calling thread is working on, 0 for none
+    inline thread_local uint64_t current_trace = 0;
+
+    // 0 disables sampling, tracing then costs a branch per stage
+    void set_sample_every(uint32_t every);
+
+    // Called once per frame on the epoll thread: the id to trace it under, or 0
+    uint64_t sample();
+
+    uint64_t now_ns();
+
+    void record(uint64_t trace, Stage stage, uint64_t time_ns);
+
+    inline void record(uint64_t trace, Stage stage) {
+        if (trace) record(trace, stage, now_ns());
+    }
+
+    // Stage of the calling thread's current request
+    inline void mark(Stage stage) {
+        record(current_trace, stage);
+    }
+
+    // Shown as the thread name in the trace viewer, set by a thread before it records anything
+    inline thread_local const char *thread_label = nullptr;
+
+    // Marks start now and end when it goes out of scope
+    class StageScope {
+    public:
+        StageScope(Stage start, Stage end) : end(end) {
+            mark(start);
+        }
+
+        ~StageScope() {
+            mark(end);
+        }
+
+    private:
+        Stage end;
+    };
+
+    bool dump_chrome_trace(const std::string &path);
+}
+
+#endif //ECHOSERVER_TRACE_H
@@ -0,0 +1,227 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "in_process.h"
+
+namespace {
+    void signal(int event) {
+        uint64_t one = 1;
+        write(event, &one, sizeof(one));
+    }
+
+    void drain(int event) {
+        uint64_t count;
+        read(event, &count, sizeof(count));
+    }
+
+    // true when event became readable within timeout_ms, -1 waits forever
+    bool wait_for(int event, int timeout_ms) {
+        pollfd readable{event, POLLIN, 0};
+        return poll(&readable, 1, timeout_ms) != 0;
+    }
+
+    // Full ring: flag the reader, then look again before sleeping. The fences pair with the
+    // reader's, so either the reader sees the flag or this side sees the room it made.
+    template<typename HasRoom>
+    void sleep_until_room(std::atomic<bool> &blocked, int event, int timeout_ms, HasRoom has_room) {
+        blocked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!has_room() && wait_for(event, timeout_ms)) drain(event);
+        blocked.store(false, std::memory_order_relaxed);
+    }
+
+    void wake_writer(std::atomic<bool> &blocked, int event) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (blocked.load(std::memory_order_relaxed)) signal(event);
+    }
+}
+
+server::transport::InProcessConnection::InProcessConnection(size_t ring_bytes) :
+        to_server(ring_bytes), to_client(ring_bytes),
+        server_event(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), client_event(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        space_event(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+server::transport::InProcessConnection::~InProcessConnection() {
+    for (auto &&event : {server_event, client_event, space_event}) {
+        if (event != -1) ::close(event);
+    }
+}
+
+bool server::transport::InProcessStream::send(const char *data, size_t size) {
+    auto &&ring = connection->to_server;
+    while (size > 0) {
+        if (connection->server_closed.load()) return false;
+        auto &&queued = ring.write(data, size);
+        data += queued;
+        size -= queued;
+        signal(connection->server_event);
+        if (size > 0) {
+            sleep_until_room(connection->client_blocked, connection->client_event, -1,
+                             [&]() { return connection->server_closed.load() || !ring.full(); });
+        }
+    }
+    return true;
+}
+
+size_t server::transport::InProcessStream::receive(char *buffer, size_t size) {
+    while (true) {
+        // closed is read before the ring so bytes sent just before closing are still delivered
+        auto &&closed = connection->server_closed.load();
+        auto &&count = connection->to_client.read(buffer, size);
+        if (count > 0) {
+            wake_writer(connection->server_blocked, connection->space_event);
+            return count;
+        }
+        if (closed) return 0;
+        if (wait_for(connection->client_event, -1)) drain(connection->client_event);
+    }
+}
+
+void server::transport::InProcessStream::close() {
+    if (!connection) return;
+    connection->client_closed = true;
+    signal(connection->server_event);
+    signal(connection->space_event);
+    connection.reset();
+}
+
+server::transport::InProcessTransport::~InProcessTransport() {
+    // streams still held by clients see the server go away
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &&[descriptor, connection] : connections) {
+        connection->server_closed = true;
+        signal(connection->client_event);
+    }
+    for (auto &&connection : pending) {
+        connection->server_closed = true;
+        signal(connection->client_event);
+    }
+}
+
+std::unique_ptr<server::transport::InProcessStream> server::transport::InProcessTransport::connect() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (listener == -1) return nullptr;
+    auto &&connection = std::make_shared<InProcessConnection>(ring_bytes);
+    if (connection->server_event == -1 || connection->client_event == -1 || connection->space_event == -1) {
+        std::cout <<  "Cannot create in-process connection eventfds" << std::endl;
+        return nullptr;
+    }
+    pending.push_back(connection);
+    signal(listener);
+    return std::make_unique<InProcessStream>(connection);
+}
+
+int server::transport::InProcessTransport::listen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    listener = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listener == -1) std::cout <<  "Cannot create in-process listener eventfd" << std::endl;
+    return listener;
+}
+
+int server::transport::InProcessTransport::accept(int, std::string &peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+        drain(listener);
+        errno = EAGAIN;
+        return -1;
+    }
+    int descriptor = pending.front()->server_event;
+    connections[descriptor] = pending.front();
+    pending.pop_front();
+    if (pending.empty()) drain(listener);
+    peer = "in-process";
+    return descriptor;
+}
+
+std::shared_ptr<server::transport::InProcessConnection> server::transport::InProcessTransport::find(int connection) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &&found = connections.find(connection);
+    if (found == connections.end()) return nullptr;
+    return found->second;
+}
+
+// The server event stays readable while bytes are queued, since the epoll loop reads one buffer
+// per wake-up. It is only reset once the ring is empty, and set again if the client raced in.
+ssize_t server::transport::InProcessTransport::read(int connection, char *buffer, size_t size) {
+    auto &&found = find(connection);
+    if (!found) {
+        errno = EBADF;
+        return -1;
+    }
+    auto &&closed = found->client_closed.load();
+    auto &&count = found->to_server.read(buffer, size);
+    if (count > 0) wake_writer(found->client_blocked, found->client_event);
+    if (found->to_server.empty()) {
+        drain(connection);
+        if (!found->to_server.empty() || found->client_closed.load()) signal(connection);
+    }
+    if (count > 0) return static_cast<ssize_t>(count);
+    if (closed || found->server_closed.load()) return 0;
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t server::transport::InProcessTransport::send(int connection, const msghdr &message, int) {
+    auto &&found = find(connection);
+    if (!found) {
+        errno = EBADF;
+        return -1;
+    }
+    if (found->client_closed.load() || found->server_closed.load()) {
+        errno = EPIPE;
+        return -1;
+    }
+    size_t sent = 0;
+    for (size_t i = 0; i < message.msg_iovlen; ++i) {
+        auto &&part = message.msg_iov[i];
+        auto &&queued = found->to_client.write(static_cast<const char *>(part.iov_base), part.iov_len);
+        sent += queued;
+        if (queued < part.iov_len) break;
+    }
+    if (sent == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    signal(found->client_event);
+    return static_cast<ssize_t>(sent);
+}
+
+short server::transport::InProcessTransport::wait(int connection, short events, int timeout_ms) {
+    auto &&found = find(connection);
+    if (!found) return POLLNVAL;
+    if (!(events & POLLOUT)) return 0;
+    auto &&room = [&]() { return found->client_closed.load() || !found->to_client.full(); };
+    // wake-ups left over on space_event return early without room, those go back to sleep
+    auto &&deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!room()) {
+        auto &&left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (timeout_ms >= 0 && left.count() <= 0) return 0;
+        sleep_until_room(found->server_blocked, found->space_event,
+                         timeout_ms < 0 ? -1 : static_cast<int>(left.count()), room);
+    }
+    return POLLOUT;
+}
+
+void server::transport::InProcessTransport::shutdown(int connection) {
+    auto &&found = find(connection);
+    if (!found) return;
+    found->server_closed = true;
+    signal(found->client_event);
+    // the epoll loop reads end of stream and closes the connection
+    signal(connection);
+}
+
+void server::transport::InProcessTransport::close(int connection) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto &&found = connections.find(connection);
+    if (found == connections.end()) return;
+    std::shared_ptr<InProcessConnection> closing = found->second;
+    connections.erase(found);
+    lock.unlock();
+    closing->server_closed = true;
+    signal(closing->client_event);
+}
@@ -0,0 +1,109 @@
+#ifndef ECHOSERVER_IN_PROCESS_H
+#define ECHOSERVER_IN_PROCESS_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "transport.h"
+#include "spsc_byte_ring.h"
+
+namespace server::transport {
+    // Both ends of one in-process connection: a byte ring each way and eventfds to sleep on.
+    // Bytes never pass through the kernel, the eventfds only carry wake-ups.
+    struct InProcessConnection {
+        explicit InProcessConnection(size_t ring_bytes);
+
+        InProcessConnection(const InProcessConnection &) = delete;
+
+        InProcessConnection &operator=(const InProcessConnection &) = delete;
+
+        // closes the eventfds, once both ends are done with the connection
+        ~InProcessConnection();
+
+        SpscByteRing to_server;
+        SpscByteRing to_client;
+        // readable while to_server has bytes or the client is gone; the server's descriptor for the connection
+        int server_event;
+        // readable while to_client has bytes or the server is gone
+        int client_event;
+        // signalled by the client after taking bytes out of to_client while server_blocked is set
+        int space_event;
+        // a side found the ring it writes to full and sleeps until the reader makes room
+        std::atomic<bool> server_blocked{false};
+        std::atomic<bool> client_blocked{false};
+        std::atomic<bool> client_closed{false};
+        std::atomic<bool> server_closed{false};
+    };
+
+    // Client end of an in-process connection. Each direction is single producer, single consumer,
+    // so a stream is used from one thread at a time.
+    class InProcessStream {
+    public:
+        explicit InProcessStream(std::shared_ptr<InProcessConnection> connection) : connection(std::move(connection)) {}
+
+        InProcessStream(const InProcessStream &) = delete;
+
+        InProcessStream &operator=(const InProcessStream &) = delete;
+
+        ~InProcessStream() {
+            close();
+        }
+
+        // Blocks until all of data is queued. False if the server closed the connection first.
+        bool send(const char *data, size_t size);
+
+        // Blocks until some bytes arrive and returns how many, 0 once the server closed the connection
+        size_t receive(char *buffer, size_t size);
+
+        void close();
+
+    private:
+        std::shared_ptr<InProcessConnection> connection;
+    };
+
+    // Transport whose clients live in the same process. Connections are queued by connect and
+    // picked up by the epoll loop through accept like sockets would be, after that the server
+    // reads and writes the rings directly. Reads come from the epoll thread and sends from the
+    // one worker serving the client at a time, which keeps each ring single producer, single consumer.
+    class InProcessTransport : public Transport {
+    public:
+        explicit InProcessTransport(size_t ring_bytes) : ring_bytes(ring_bytes) {}
+
+        ~InProcessTransport() override;
+
+        // Client side: a new connection, accepted by the server's epoll loop. Null before listen.
+        std::unique_ptr<InProcessStream> connect();
+
+        int listen() override;
+
+        int accept(int listener, std::string &peer) override;
+
+        ssize_t read(int connection, char *buffer, size_t size) override;
+
+        ssize_t send(int connection, const msghdr &message, int flags) override;
+
+        short wait(int connection, short events, int timeout_ms) override;
+
+        void shutdown(int connection) override;
+
+        void close(int connection) override;
+
+        bool kernel_sockets() const override { return false; }
+
+    private:
+        std::shared_ptr<InProcessConnection> find(int connection);
+
+        size_t ring_bytes;
+        // eventfd readable while connections wait to be accepted
+        int listener = -1;
+        std::mutex mutex;
+        std::deque<std::shared_ptr<InProcessConnection>> pending;
+        // accepted connections by their server_event descriptor
+        std::unordered_map<int, std::shared_ptr<InProcessConnection>> connections;
+    };
+}
+
+#endif //ECHOSERVER_IN_PROCESS_H
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <poll.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include "socket_transport.h"
+#include "utils/sockutils.h"
+
+int server::transport::SocketTransport::listen() {
+    auto &&listener = unix_path.empty() ? listen_tcp() : listen_unix();
+    if (listener == -1) return -1;
+    if (!socket_utils::set_socket_nonblock(listener)) {
+        std::cout <<  "Cannot set server socket nonblock" << std::endl;
+        ::close(listener);
+        return -1;
+    }
+    // connections arriving during a hot upgrade wait here until the new process accepts them
+    if (::listen(listener, SOMAXCONN) == -1) {
+        std::cout <<  "set server socket listen error" << std::endl;
+        ::close(listener);
+        return -1;
+    }
+    if (unix_path.empty()) {
+        sockaddr_in server_address{};
+        socklen_t address_len = sizeof(server_address);
+        getsockname(listener, reinterpret_cast<sockaddr *>(&server_address), &address_len);
+        bound_port = ntohs(server_address.sin_port);
+    }
+    return listener;
+}
+
+int server::transport::SocketTransport::listen_tcp() {
+    auto &&server_d = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_d < 0) {
+        std::cout <<  "Cannot open socket" << std::endl;
+        return -1;
+    }
+    int enable_options = 1;
+    setsockopt(server_d, SOL_SOCKET, SO_REUSEADDR, &enable_options, sizeof(enable_options));
+
+    sockaddr_in server_address{};
+    bzero(&server_address, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_addr.s_addr = INADDR_ANY;
+    server_address.sin_port = htons(static_cast<uint16_t>(listen_port));
+    auto &&bind_addr = reinterpret_cast<const sockaddr *>(&server_address);
+    if (bind(server_d, bind_addr, sizeof(server_address)) < 0) {
+        std::cout <<  "Cannot bind" << std::endl;
+        ::close(server_d);
+        return -1;
+    }
+    return server_d;
+}
+
+int server::transport::SocketTransport::listen_unix() {
+    sockaddr_un address{};
+    if (unix_path.size() >= sizeof(address.sun_path)) {
+        std::cout <<  "Unix socket path too long: " << unix_path << std::endl;
+        return -1;
+    }
+    auto &&server_d = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_d < 0) {
+        std::cout <<  "Cannot open socket" << std::endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    unix_path.copy(address.sun_path, unix_path.size());
+    if (!socket_utils::remove_stale_unix_socket(address)) {
+        std::cout <<  "Unix socket " << unix_path << " is in use by another server" << std::endl;
+        ::close(server_d);
+        return -1;
+    }
+    if (bind(server_d, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0) {
+        std::cout <<  "Cannot bind " << unix_path << std::endl;
+        ::close(server_d);
+        return -1;
+    }
+    return server_d;
+}
+
+int server::transport::SocketTransport::accept(int listener, std::string &peer) {
+    sockaddr_storage client_addr{};
+    auto &&client_addr_len = static_cast<socklen_t>(sizeof(client_addr));
+    auto &&client_d = ::accept(listener, reinterpret_cast<sockaddr *>(&client_addr), &client_addr_len);
+    if (client_d == -1) return -1;
+    if (!socket_utils::set_socket_nonblock(client_d)) {
+        std::cerr <<  "Cannot set client socket nonblock" << client_d<< std::endl;
+        ::close(client_d);
+        errno = EIO;
+        return -1;
+    }
+    if (client_addr.ss_family == AF_INET) peer = inet_ntoa(reinterpret_cast<sockaddr_in &>(client_addr).sin_addr);
+    else peer = "unix:" + unix_path;
+    return client_d;
+}
+
+ssize_t server::transport::SocketTransport::read(int connection, char *buffer, size_t size) {
+    return ::read(connection, buffer, size);
+}
+
+ssize_t server::transport::SocketTransport::send(int connection, const msghdr &message, int flags) {
+    return sendmsg(connection, &message, flags);
+}
+
+short server::transport::SocketTransport::wait(int connection, short events, int timeout_ms) {
+    pollfd client{connection, events, 0};
+    auto &&ready = poll(&client, 1, timeout_ms);
+    if (ready == 0) return 0;
+    // interrupted, the caller retries its send and waits again if need be
+    if (ready < 0) return events;
+    return client.revents;
+}
+
+void server::transport::SocketTransport::shutdown(int connection) {
+    ::shutdown(connection, SHUT_RDWR);
+}
+
+void server::transport::SocketTransport::close(int connection) {
+    ::close(connection);
+}
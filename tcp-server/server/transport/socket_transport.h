@@ -0,0 +1,38 @@
+#ifndef ECHOSERVER_SOCKET_TRANSPORT_H
+#define ECHOSERVER_SOCKET_TRANSPORT_H
+
+#include <string>
+#include "transport.h"
+
+namespace server::transport {
+    // Kernel sockets: TCP on a port, or a Unix domain stream socket bound to a path
+    class SocketTransport : public Transport {
+    public:
+        // TCP on port (0 picks an ephemeral one) when unix_path is empty, the Unix socket otherwise
+        SocketTransport(int port, std::string unix_path) : listen_port(port), unix_path(std::move(unix_path)) {}
+
+        int listen() override;
+
+        int accept(int listener, std::string &peer) override;
+
+        ssize_t read(int connection, char *buffer, size_t size) override;
+
+        ssize_t send(int connection, const msghdr &message, int flags) override;
+
+        short wait(int connection, short events, int timeout_ms) override;
+
+        void shutdown(int connection) override;
+
+        void close(int connection) override;
+
+    private:
+        int listen_tcp();
+
+        int listen_unix();
+
+        int listen_port;
+        std::string unix_path;
+    };
+}
+
+#endif //ECHOSERVER_SOCKET_TRANSPORT_H
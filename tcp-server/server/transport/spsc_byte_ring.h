@@ -0,0 +1,70 @@
+#ifndef ECHOSERVER_SPSC_BYTE_RING_H
+#define ECHOSERVER_SPSC_BYTE_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace server::transport {
+    // Bounded byte queue between exactly one producer thread and one consumer thread, without
+    // locks. Each side advances only its own index and reads the other's; the indexes count bytes
+    // forever and the capacity is a power of two, so positions wrap by masking.
+    class SpscByteRing {
+    public:
+        // capacity is rounded up to a power of two
+        explicit SpscByteRing(size_t capacity) : mask(round_up(capacity) - 1), buffer(new char[mask + 1]) {}
+
+        SpscByteRing(const SpscByteRing &) = delete;
+
+        SpscByteRing &operator=(const SpscByteRing &) = delete;
+
+        // Producer: copies as much of data as fits, returns the number of bytes queued
+        size_t write(const char *data, size_t size) {
+            size_t head = write_index.load(std::memory_order_relaxed);
+            size_t tail = read_index.load(std::memory_order_acquire);
+            size_t count = std::min(size, mask + 1 - (head - tail));
+            size_t first = std::min(count, mask + 1 - (head & mask));
+            memcpy(buffer.get() + (head & mask), data, first);
+            memcpy(buffer.get(), data + first, count - first);
+            write_index.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        // Consumer: moves up to size queued bytes into data, returns how many
+        size_t read(char *data, size_t size) {
+            size_t tail = read_index.load(std::memory_order_relaxed);
+            size_t head = write_index.load(std::memory_order_acquire);
+            size_t count = std::min(size, head - tail);
+            size_t first = std::min(count, mask + 1 - (tail & mask));
+            memcpy(data, buffer.get() + (tail & mask), first);
+            memcpy(data + first, buffer.get(), count - first);
+            read_index.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        bool empty() const {
+            return read_index.load(std::memory_order_acquire) == write_index.load(std::memory_order_acquire);
+        }
+
+        bool full() const {
+            return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire) > mask;
+        }
+
+    private:
+        static size_t round_up(size_t capacity) {
+            size_t rounded = 1;
+            while (rounded < capacity) rounded <<= 1;
+            return rounded;
+        }
+
+        const size_t mask;
+        std::unique_ptr<char[]> buffer;
+        // on separate cache lines so the two sides do not invalidate each other on every update
+        alignas(128) std::atomic<size_t> write_index{0};
+        alignas(128) std::atomic<size_t> read_index{0};
+    };
+}
+
+#endif //ECHOSERVER_SPSC_BYTE_RING_H
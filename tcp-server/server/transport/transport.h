@@ -0,0 +1,47 @@
+#ifndef ECHOSERVER_TRANSPORT_H
+#define ECHOSERVER_TRANSPORT_H
+
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace server::transport {
+    // How the server reaches its clients. Each connection is named by a descriptor the epoll loop
+    // can watch: readable while read may return something, and the listener readable while accept
+    // may return a connection. Framing, workers and timers above it only ever see descriptors.
+    class Transport {
+    public:
+        virtual ~Transport() = default;
+
+        // Creates the listener and returns its descriptor, or -1 after printing why
+        virtual int listen() = 0;
+
+        // Next pending connection, already nonblocking, or -1 with errno set. peer describes it for logs.
+        virtual int accept(int listener, std::string &peer) = 0;
+
+        // Same contract as read(2): 0 once the peer is gone, -1 and EAGAIN while nothing is buffered
+        virtual ssize_t read(int connection, char *buffer, size_t size) = 0;
+
+        // Same contract as sendmsg(2) on a nonblocking socket, partial writes included
+        virtual ssize_t send(int connection, const msghdr &message, int flags) = 0;
+
+        // Waits like poll(2) for events on connection. Returns the events that happened, 0 on timeout.
+        virtual short wait(int connection, short events, int timeout_ms) = 0;
+
+        // Fails both directions; the epoll loop then reads end of stream and closes the connection
+        virtual void shutdown(int connection) = 0;
+
+        virtual void close(int connection) = 0;
+
+        // Descriptors are kernel sockets: they can be handed to another process and use MSG_ZEROCOPY
+        virtual bool kernel_sockets() const { return true; }
+
+        // TCP port bound by listen, -1 for transports without ports
+        int port() const { return bound_port; }
+
+    protected:
+        int bound_port = -1;
+    };
+}
+
+#endif //ECHOSERVER_TRANSPORT_H
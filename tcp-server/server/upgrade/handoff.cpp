@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "handoff.h"
+#include "utils/sockutils.h"
+
+namespace {
+    // a peer that stops talking in the middle of a hand-off must not wedge the other process
+    const int CHANNEL_TIMEOUT_SEC = 5;
+    // SCM_MAX_FD, the kernel limit of descriptors in one message
+    const size_t FDS_PER_MESSAGE = 253;
+    // the metadata of a sane server is far below this, anything bigger is garbage
+    const uint64_t MAX_STATE_SIZE = 1ull << 30;
+
+    bool set_channel_timeout(int channel) {
+        timeval timeout{CHANNEL_TIMEOUT_SEC, 0};
+        return setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+               setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+    }
+
+    bool make_address(const std::string &path, sockaddr_un &address) {
+        address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cout << "Upgrade socket path too long: " << path << std::endl;
+            return false;
+        }
+        memcpy(address.sun_path, path.data(), path.size());
+        return true;
+    }
+
+    bool write_all(int channel, const char *data, size_t length) {
+        while (length > 0) {
+            auto &&written = send(channel, data, length, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    bool read_all(int channel, char *data, size_t length) {
+        while (length > 0) {
+            auto &&count = read(channel, data, length);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    void put_u32(std::string &out, uint32_t value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void put_string(std::string &out, const std::string &value) {
+        put_u32(out, static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+
+    bool get_u32(const std::string &in, size_t &offset, uint32_t &value) {
+        if (in.size() - offset < sizeof(value)) return false;
+        memcpy(&value, in.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    }
+
+    bool get_string(const std::string &in, size_t &offset, std::string &value) {
+        uint32_t length;
+        if (!get_u32(in, offset, length) || in.size() - offset < length) return false;
+        value.assign(in, offset, length);
+        offset += length;
+        return true;
+    }
+
+    bool send_descriptors(int channel, const int *descriptors, uint32_t count) {
+        char control[CMSG_SPACE(sizeof(int) * FDS_PER_MESSAGE)]{};
+        iovec data{&count, sizeof(count)};
+        msghdr message{};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        auto &&header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(header), descriptors, sizeof(int) * count);
+        return sendmsg(channel, &message, MSG_NOSIGNAL) == sizeof(count);
+    }
+
+    // Appends the descriptors of one batch, false if the batch is not what was announced
+    bool receive_descriptors(int channel, std::vector<int> &descriptors) {
+        char control[CMSG_SPACE(sizeof(int) * FDS_PER_MESSAGE)]{};
+        uint32_t count = 0;
+        iovec data{&count, sizeof(count)};
+        msghdr message{};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        auto &&received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+        if (received <= 0) return false;
+        size_t batch_size = 0;
+        for (auto &&header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+            auto &&first = reinterpret_cast<const int *>(CMSG_DATA(header));
+            batch_size = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            descriptors.insert(descriptors.end(), first, first + batch_size);
+        }
+        auto &&rest = sizeof(count) - static_cast<size_t>(received);
+        if (rest && !read_all(channel, reinterpret_cast<char *>(&count) + received, rest)) return false;
+        return !(message.msg_flags & MSG_CTRUNC) && batch_size == count;
+    }
+}
+
+int server::handoff::listen_channel(const std::string &path, bool replace_running) {
+    sockaddr_un address{};
+    if (!make_address(path, address)) return -1;
+    // the server just taken over still listens until it exits and leaves the path to us then
+    if (replace_running) unlink(path.c_str());
+    else if (!socket_utils::remove_stale_unix_socket(address)) {
+        std::cout << "Upgrade socket " << path << " is in use by another server" << std::endl;
+        return -1;
+    }
+    auto &&channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (channel == -1) return -1;
+    if (bind(channel, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1 ||
+        listen(channel, 1) == -1) {
+        close(channel);
+        return -1;
+    }
+    return channel;
+}
+
+int server::handoff::request_takeover(const std::string &path) {
+    sockaddr_un address{};
+    if (!make_address(path, address)) return -1;
+    auto &&channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (channel == -1) return -1;
+    if (!set_channel_timeout(channel) ||
+        connect(channel, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1 ||
+        !write_all(channel, HANDOFF_MAGIC, HANDOFF_MAGIC_LEN)) {
+        close(channel);
+        return -1;
+    }
+    return channel;
+}
+
+bool server::handoff::read_takeover_request(int channel) {
+    char magic[HANDOFF_MAGIC_LEN];
+    return set_channel_timeout(channel) && read_all(channel, magic, sizeof(magic)) &&
+           memcmp(magic, HANDOFF_MAGIC, HANDOFF_MAGIC_LEN) == 0;
+}
+
+bool server::handoff::send_state(int channel, const State &state) {
+    std::string metadata(HANDOFF_MAGIC, HANDOFF_MAGIC_LEN);
+    put_u32(metadata, state.next_connection_id);
+    put_u32(metadata, state.replication_descriptor != -1 ? 1 : 0);
+    put_u32(metadata, static_cast<uint32_t>(state.clients.size()));
+    std::vector<int> descriptors{state.listen_descriptor};
+    if (state.replication_descriptor != -1) descriptors.push_back(state.replication_descriptor);
+    for (auto &&client : state.clients) {
+        put_u32(metadata, client.connection_id);
+        put_string(metadata, client.client_ip);
+        put_string(metadata, client.receive_buffer);
+        descriptors.push_back(client.descriptor);
+    }
+    uint64_t length = metadata.size();
+    if (!write_all(channel, reinterpret_cast<const char *>(&length), sizeof(length)) ||
+        !write_all(channel, metadata.data(), metadata.size())) {
+        return false;
+    }
+    for (size_t sent = 0; sent < descriptors.size(); sent += FDS_PER_MESSAGE) {
+        auto &&batch = static_cast<uint32_t>(std::min(FDS_PER_MESSAGE, descriptors.size() - sent));
+        if (!send_descriptors(channel, descriptors.data() + sent, batch)) return false;
+    }
+    return true;
+}
+
+bool server::handoff::receive_state(int channel, State &state) {
+    state = State{};
+    uint64_t length = 0;
+    if (!read_all(channel, reinterpret_cast<char *>(&length), sizeof(length)) || length > MAX_STATE_SIZE) {
+        return false;
+    }
+    std::string metadata(length, '\0');
+    if (!read_all(channel, &metadata[0], metadata.size())) return false;
+    size_t offset = HANDOFF_MAGIC_LEN;
+    uint32_t has_replication = 0, client_count = 0;
+    if (metadata.compare(0, HANDOFF_MAGIC_LEN, HANDOFF_MAGIC) != 0 ||
+        !get_u32(metadata, offset, state.next_connection_id) || !get_u32(metadata, offset, has_replication) ||
+        has_replication > 1 || !get_u32(metadata, offset, client_count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < client_count; ++i) {
+        ClientState client{-1, 0, {}, {}};
+        if (!get_u32(metadata, offset, client.connection_id) || !get_string(metadata, offset, client.client_ip) ||
+            !get_string(metadata, offset, client.receive_buffer)) {
+            state.clients.clear();
+            return false;
+        }
+        state.clients.push_back(std::move(client));
+    }
+
+    std::vector<int> descriptors;
+    auto &&expected = size_t(1) + has_replication + client_count;
+    auto &&complete = true;
+    while (complete && descriptors.size() < expected) {
+        complete = receive_descriptors(channel, descriptors);
+    }
+    if (!complete || descriptors.size() != expected) {
+        for (auto &&descriptor : descriptors) close(descriptor);
+        state = State{};
+        return false;
+    }
+    state.listen_descriptor = descriptors[0];
+    if (has_replication) state.replication_descriptor = descriptors[1];
+    for (size_t i = 0; i < state.clients.size(); ++i) {
+        state.clients[i].descriptor = descriptors[i + 1 + has_replication];
+    }
+    return true;
+}
+
+bool server::handoff::send_ack(int channel) {
+    char ack = 1;
+    return write_all(channel, &ack, sizeof(ack));
+}
+
+bool server::handoff::wait_ack(int channel) {
+    char ack = 0;
+    return read_all(channel, &ack, sizeof(ack)) && ack == 1;
+}
@@ -0,0 +1,62 @@
+#ifndef ECHOSERVER_HANDOFF_H
+#define ECHOSERVER_HANDOFF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hot upgrade: a running server listens on a Unix socket, a new process started with
+// --takeover connects to it and receives the listening socket, the replication listener of a
+// primary and every live client.
+//
+// Channel layout (host byte order, both processes run on the same machine):
+//   new -> old: "FINHOF02" takeover request
+//   old -> new: uint64 length, then "FINHOF02", uint32 next connection id, uint32 1 if a
+//               replication listener follows the listening socket and 0 otherwise, uint32 client
+//               count and per client uint32 connection id, uint32 + ip, uint32 + buffered partial frame
+//   old -> new: descriptors as SCM_RIGHTS in batches, each carried by a uint32 batch size,
+//               the listening socket first, then the replication listener if any and then the
+//               clients in the order above
+//   new -> old: one ack byte once the new process owns everything
+namespace server::handoff {
+    const char HANDOFF_MAGIC[] = "FINHOF02";
+    const size_t HANDOFF_MAGIC_LEN = 8;
+
+    struct ClientState {
+        int descriptor;
+        uint32_t connection_id;
+        std::string client_ip;
+        // already read from the socket but not yet a whole frame
+        std::string receive_buffer;
+    };
+
+    struct State {
+        int listen_descriptor = -1;
+        // followers connect here, -1 unless the running server is a replication primary
+        int replication_descriptor = -1;
+        uint32_t next_connection_id = 1;
+        std::vector<ClientState> clients;
+    };
+
+    // Listening end in the running server, replaces a stale socket file at path but fails while
+    // another server listens there, unless replace_running after taking that one over. -1 on failure
+    int listen_channel(const std::string &path, bool replace_running);
+
+    // Connects from the new process and sends the takeover request. -1 on failure
+    int request_takeover(const std::string &path);
+
+    // Checks the request on a channel accepted by the running server
+    bool read_takeover_request(int channel);
+
+    bool send_state(int channel, const State &state);
+
+    // On failure every descriptor received so far is closed and state is left empty
+    bool receive_state(int channel, State &state);
+
+    bool send_ack(int channel);
+
+    // Until the ack arrives the old process still owns its descriptors and can resume serving
+    bool wait_ack(int channel);
+}
+
+#endif //ECHOSERVER_HANDOFF_H
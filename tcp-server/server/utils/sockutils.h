@@ -1,11 +1,16 @@
 #ifndef _SOCKET_UTILS
 #define _SOCKET_UTILS
 
+#include <cerrno>
 #include <fcntl.h>
 #include <c++/5/iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace socket_utils {
-    bool set_socket_nonblock(int &sock) {
+    inline bool set_socket_nonblock(int &sock) {
         auto &&flags = fcntl(sock, F_GETFL, 0);
         if (flags == -1) {
             std::cout <<  "fcntl failed (F_GETFL)" << std::endl;
@@ -20,5 +25,20 @@ namespace socket_utils {
         }
         return true;
     }
+
+    // A socket file left behind by a server that is gone would make bind fail. Removes the path
+    // only if it is a socket nobody accepts on; false when a server still answers there, a
+    // running server keeps its path
+    inline bool remove_stale_unix_socket(const sockaddr_un &address) {
+        struct stat status{};
+        if (lstat(address.sun_path, &status) == -1 || !S_ISSOCK(status.st_mode)) return true;
+        auto &&probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe == -1) return false;
+        auto &&refused = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1 &&
+                         errno == ECONNREFUSED;
+        close(probe);
+        if (refused) unlink(address.sun_path);
+        return refused;
+    }
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <climits>
+#include "timer_wheel.h"
+
+void server::TimerWheel::link(uint32_t index) {
+    auto &&node = nodes[index];
+    auto &&slot = node.tick % SLOTS;
+    node.prev = NONE;
+    node.next = slot_head[slot];
+    if (node.next != NONE) nodes[node.next].prev = index;
+    slot_head[slot] = index;
+    non_empty[slot / 64] |= uint64_t(1) << (slot % 64);
+    node.scheduled = true;
+    active++;
+}
+
+void server::TimerWheel::unlink(uint32_t index) {
+    auto &&node = nodes[index];
+    auto &&slot = node.tick % SLOTS;
+    if (node.prev != NONE) nodes[node.prev].next = node.next;
+    else slot_head[slot] = node.next;
+    if (node.next != NONE) nodes[node.next].prev = node.prev;
+    if (slot_head[slot] == NONE) non_empty[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    node.scheduled = false;
+    active--;
+}
+
+void server::TimerWheel::schedule(int descriptor, uint64_t deadline_ms) {
+    auto &&index = static_cast<uint32_t>(descriptor);
+    if (index >= nodes.size()) nodes.resize(std::max<size_t>(index + 1, nodes.size() * 2));
+    if (nodes[index].scheduled) unlink(index);
+    // round up so a timer never fires early, and never schedule into a slot already passed
+    nodes[index].tick = std::max((deadline_ms + tick_ms - 1) / tick_ms, current_tick);
+    link(index);
+}
+
+void server::TimerWheel::cancel(int descriptor) {
+    auto &&index = static_cast<uint32_t>(descriptor);
+    if (index < nodes.size() && nodes[index].scheduled) unlink(index);
+}
+
+void server::TimerWheel::advance(uint64_t now_ms, const std::function<void(int descriptor)> &on_expired) {
+    auto &&now_tick = now_ms / tick_ms;
+    if (now_tick < current_tick) return;
+    // after a long pause every slot is visited once rather than once per missed tick
+    uint64_t ticks = std::min<uint64_t>(now_tick - current_tick + 1, SLOTS);
+    uint64_t first_tick = current_tick;
+    // timers scheduled from the callback land after now and are left for the next advance
+    current_tick = now_tick + 1;
+    for (uint64_t i = 0; i < ticks; ++i) {
+        auto &&slot = (first_tick + i) % SLOTS;
+        uint32_t index = slot_head[slot];
+        while (index != NONE) {
+            uint32_t next = nodes[index].next;
+            if (nodes[index].tick <= now_tick) {
+                unlink(index);
+                on_expired(static_cast<int>(index));
+            }
+            index = next;
+        }
+    }
+}
+
+int server::TimerWheel::next_timeout_ms(uint64_t now_ms) const {
+    if (active == 0) return -1;
+    // first non-empty slot at or after the current tick, found a word of the bitmap at a time
+    auto &&start = current_tick % SLOTS;
+    for (size_t distance = 0; distance < SLOTS;) {
+        auto &&slot = (start + distance) % SLOTS;
+        auto &&word = non_empty[slot / 64] >> (slot % 64);
+        if (word == 0) {
+            distance += 64 - slot % 64;
+            continue;
+        }
+        distance += __builtin_ctzll(word);
+        if (distance >= SLOTS) break;
+        auto &&due_ms = (current_tick + distance) * tick_ms;
+        return due_ms <= now_ms ? 0 : static_cast<int>(std::min<uint64_t>(due_ms - now_ms, INT_MAX));
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef ECHOSERVER_TIMER_WHEEL_H
+#define ECHOSERVER_TIMER_WHEEL_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace server {
+    // Hashed timing wheel keyed by descriptor, owned by one reactor thread.
+    // Each descriptor has at most one pending deadline, stored in an intrusive list of the
+    // slot its tick hashes to, so schedule and cancel are O(1) whatever the number of timers.
+    // Deadlines further away than one revolution wait in their slot for the right round, but
+    // may wake the reactor early, so pick tick_ms to make the longest timeout fit one revolution.
+    class TimerWheel {
+    public:
+        static constexpr size_t SLOTS = 512;
+
+        explicit TimerWheel(uint64_t tick_ms, uint64_t now_ms) :
+                tick_ms(tick_ms), current_tick(now_ms / tick_ms), active(0), slot_head{}, non_empty{} {
+            slot_head.fill(NONE);
+        }
+
+        // Replaces any pending deadline of descriptor
+        void schedule(int descriptor, uint64_t deadline_ms);
+
+        void cancel(int descriptor);
+
+        // Fires every deadline up to now_ms. The callback may reschedule the expired descriptor
+        // but must not cancel other ones.
+        void advance(uint64_t now_ms, const std::function<void(int descriptor)> &on_expired);
+
+        // Milliseconds until the next slot with timers comes due, -1 when nothing is scheduled.
+        // Ready to be used as the epoll_wait timeout.
+        int next_timeout_ms(uint64_t now_ms) const;
+
+        size_t size() const { return active; }
+
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        struct Node {
+            uint32_t prev = NONE;
+            uint32_t next = NONE;
+            uint64_t tick = 0;
+            bool scheduled = false;
+        };
+
+        void link(uint32_t index);
+
+        void unlink(uint32_t index);
+
+        uint64_t tick_ms;
+        uint64_t current_tick;
+        size_t active;
+        std::vector<Node> nodes;
+        std::array<uint32_t, SLOTS> slot_head;
+        std::array<uint64_t, SLOTS / 64> non_empty;
+    };
+}
+
+#endif //ECHOSERVER_TIMER_WHEEL_H
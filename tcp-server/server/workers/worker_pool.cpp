@@ -0,0 +1,206 @@
+#include <atomic>
+#include <iostream>
+#include "worker_pool.h"
+#include "defines.h"
+#include "tracing/trace.h"
+
+namespace {
+    thread_local std::pmr::memory_resource *current_arena = nullptr;
+    thread_local bool current_more_queued = false;
+    std::atomic<std::pmr::memory_resource *> arena_upstream{nullptr};
+
+    std::pmr::memory_resource *upstream_resource() {
+        auto &&upstream = arena_upstream.load(std::memory_order_acquire);
+        return upstream ? upstream : std::pmr::new_delete_resource();
+    }
+}
+
+std::pmr::memory_resource *server::request_arena() {
+    return current_arena ? current_arena : upstream_resource();
+}
+
+void server::set_arena_upstream(std::pmr::memory_resource *upstream) {
+    arena_upstream.store(upstream, std::memory_order_release);
+}
+
+bool server::WorkerPool::more_queued() {
+    return current_more_queued;
+}
+
+server::WorkerPool::WorkerPool(size_t threads, size_t queue_capacity, Handler handler, uint64_t quantum_us) :
+        handler(std::move(handler)), quantum_us(static_cast<int64_t>(std::max<uint64_t>(quantum_us, 1))),
+        slots(std::max<size_t>(queue_capacity, 1)), free_slots(0), queued(0), busy(0), stopping(false) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+        slots[i].message.reserve(MESSAGE_SIZE);
+        slots[i].next = i + 1 < slots.size() ? static_cast<uint32_t>(i + 1) : NO_SLOT;
+    }
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) workers.push_back(std::make_unique<Worker>(upstream_resource()));
+    for (auto &&worker : workers) {
+        worker->thread = std::thread(&WorkerPool::worker_loop, this, std::ref(*worker));
+    }
+}
+
+void server::WorkerPool::set_priority_classifier(Classifier classifier) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    is_priority = std::move(classifier);
+}
+
+uint32_t server::WorkerPool::take_free_slot() {
+    if (free_slots == NO_SLOT) {
+        // only happens when the workers fall behind by more than the pool size
+        size_t old_size = slots.size();
+        slots.resize(old_size * 2);
+        for (size_t i = old_size; i < slots.size(); ++i) {
+            slots[i].next = i + 1 < slots.size() ? static_cast<uint32_t>(i + 1) : NO_SLOT;
+        }
+        free_slots = static_cast<uint32_t>(old_size);
+    }
+    uint32_t slot = free_slots;
+    free_slots = slots[slot].next;
+    slots[slot].next = NO_SLOT;
+    return slot;
+}
+
+void server::WorkerPool::push_back(Ring &ring, Flow &flow) {
+    flow.next_in_ring = nullptr;
+    flow.in_ring = true;
+    if (ring.tail) ring.tail->next_in_ring = &flow;
+    else ring.head = &flow;
+    ring.tail = &flow;
+}
+
+server::WorkerPool::Flow *server::WorkerPool::pop_front(Ring &ring) {
+    auto flow = ring.head;
+    if (!flow) return nullptr;
+    ring.head = flow->next_in_ring;
+    if (!ring.head) ring.tail = nullptr;
+    flow->next_in_ring = nullptr;
+    flow->in_ring = false;
+    return flow;
+}
+
+void server::WorkerPool::schedule(Flow &flow) {
+    push_back(slots[flow.head].priority ? priority_ring : normal_ring, flow);
+}
+
+void server::WorkerPool::enqueue(int client_id, std::string &message, uint64_t trace) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (stopping) return;
+    auto &&slot = take_free_slot();
+    auto &&task = slots[slot];
+    task.message.swap(message);
+    message.clear();
+    task.priority = is_priority && is_priority(task.message);
+    task.trace = trace;
+
+    auto &&flow = flows[client_id];
+    flow.client_id = client_id;
+    if (flow.closed) {
+        // the descriptor was reused before the old client's frames drained
+        flow.closed = false;
+        flow.deficit = 0;
+    }
+    if (flow.tail == NO_SLOT) flow.head = slot;
+    else slots[flow.tail].next = slot;
+    flow.tail = slot;
+    queued++;
+    // a flow being served is rescheduled by its worker once the handler returns
+    if (!flow.in_service && !flow.in_ring) schedule(flow);
+    // under the lock, so it cannot come after the worker's DEQUEUED
+    tracing::record(trace, tracing::ENQUEUED);
+    lock.unlock();
+    queue_not_empty.notify_one();
+}
+
+server::WorkerPool::Flow *server::WorkerPool::pick_flow() {
+    for (auto &&ring : {&priority_ring, &normal_ring}) {
+        while (auto &&flow = pop_front(*ring)) {
+            if (flow->deficit > 0) {
+                flow->in_service = true;
+                return flow;
+            }
+            // with nobody to share the ring with there is no point in paying the debt off
+            flow->deficit = ring->head ? flow->deficit + quantum_us : std::max(flow->deficit + quantum_us, quantum_us);
+            push_back(*ring, *flow);
+        }
+    }
+    return nullptr;
+}
+
+void server::WorkerPool::worker_loop(Worker &worker) {
+    current_arena = &worker.arena;
+    tracing::thread_label = "worker";
+    std::string message;
+    message.reserve(MESSAGE_SIZE);
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        // frames of a flow in service wait for the worker serving it, not for this one
+        queue_not_empty.wait(lock, [this] { return stopping || priority_ring.head || normal_ring.head; });
+        auto &&flow = pick_flow();
+        if (!flow) return;
+        uint32_t slot = flow->head;
+        auto &&task = slots[slot];
+        task.message.swap(message);
+        flow->head = task.next;
+        if (flow->head == NO_SLOT) flow->tail = NO_SLOT;
+        task.next = free_slots;
+        free_slots = slot;
+        queued--;
+        busy++;
+        int client_id = flow->client_id;
+        current_more_queued = flow->head != NO_SLOT;
+        tracing::current_trace = task.trace;
+        lock.unlock();
+        tracing::mark(tracing::DEQUEUED);
+
+        auto &&started = std::chrono::steady_clock::now();
+        try {
+            handler(message, client_id);
+        } catch (std::exception &ex) {
+            std::cerr << "Worker exception: " << ex.what() << std::endl;
+        }
+        worker.arena.release();
+        current_more_queued = false;
+        tracing::current_trace = 0;
+        auto &&spent = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count();
+
+        lock.lock();
+        busy--;
+        flow->in_service = false;
+        flow->deficit -= std::max<int64_t>(spent, 1);
+        if (flow->head != NO_SLOT) {
+            schedule(*flow);
+        } else if (flow->closed) {
+            flows.erase(client_id);
+        } else if (flow->deficit > 0) {
+            // an idle flow keeps its debt but does not bank credit
+            flow->deficit = 0;
+        }
+        if (queued == 0 && busy == 0) queue_idle.notify_all();
+    }
+}
+
+void server::WorkerPool::forget(int client_id) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    auto &&found = flows.find(client_id);
+    if (found == flows.end()) return;
+    auto &&flow = found->second;
+    if (flow.in_service || flow.head != NO_SLOT) flow.closed = true;
+    else flows.erase(found);
+}
+
+void server::WorkerPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_idle.wait(lock, [this] { return queued == 0 && busy == 0; });
+}
+
+void server::WorkerPool::stop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    stopping = true;
+    lock.unlock();
+    queue_not_empty.notify_all();
+    for (auto &&worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
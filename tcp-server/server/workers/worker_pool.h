@@ -0,0 +1,151 @@
+#ifndef ECHOSERVER_WORKER_POOL_H
+#define ECHOSERVER_WORKER_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+    // Memory for everything built while handling one request. On a worker thread this is the
+    // worker's monotonic arena which is released after every request, elsewhere it is the heap.
+    std::pmr::memory_resource *request_arena();
+
+    // Where worker arenas go once their buffer is used up, and what request_arena() is off the
+    // workers: the heap unless set. Takes effect for pools created afterwards, the bench counts
+    // request path allocations through it.
+    void set_arena_upstream(std::pmr::memory_resource *upstream);
+
+    // Fixed set of worker threads serving per-client queues with deficit round-robin.
+    //
+    // Every client has its own flow of frames. Flows waiting for a worker sit in a round-robin
+    // ring; a flow at the front is served if it has deficit left, otherwise it is credited one
+    // quantum and goes to the back. The deficit is charged with the time the handler actually
+    // took, so a client pipelining expensive requests gets the same share of worker time as one
+    // sending cheap ones instead of the same share of requests. A flow is handled by at most one
+    // worker at a time, so replies leave in request order and clients may pipeline requests
+    // without tagging them.
+    //
+    // With a priority classifier set, flows whose next frame it accepts wait in a second ring
+    // that is always served first. Order within a client is kept either way.
+    //
+    // Frames live in a shared pool of reusable task slots and are swapped in and out rather than
+    // copied, so once the slots have grown to the usual frame size neither enqueue nor the hand-off
+    // to a worker touches the global allocator. Only the first frame of a new client descriptor
+    // allocates its flow.
+    class WorkerPool {
+    public:
+        using Handler = std::function<void(std::string &message, int client_id)>;
+        using Classifier = std::function<bool(const std::string &message)>;
+
+        // queue_capacity is the initial number of task slots, quantum_us the worker time a flow is
+        // credited per round
+        WorkerPool(size_t threads, size_t queue_capacity, Handler handler, uint64_t quantum_us = 200);
+
+        ~WorkerPool() {
+            stop();
+        }
+
+        // Frames the classifier accepts go ahead of the others, set before the first enqueue
+        void set_priority_classifier(Classifier classifier);
+
+        // Takes over the contents of message and leaves it holding a spare buffer from the pool.
+        // A non-zero trace id becomes tracing::current_trace of the worker handling the frame
+        void enqueue(int client_id, std::string &message, uint64_t trace = 0);
+
+        // The client is gone: its flow is dropped once the frames it already queued are handled, so a
+        // descriptor reused by a later client starts without the old deficit
+        void forget(int client_id);
+
+        // Blocks until the queues are empty and no handler is running
+        void wait_idle();
+
+        // Runs what is already queued, then joins the workers
+        void stop();
+
+        // Inside a handler: whether more frames of the same client were queued behind the one being
+        // handled when it was dequeued, so its reply is not the last one for now. False elsewhere
+        static bool more_queued();
+
+        static constexpr size_t ARENA_SIZE = 64 * 1024;
+
+    private:
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        struct Task {
+            std::string message;
+            uint64_t trace = 0;
+            bool priority = false;
+            // next frame of the same flow, or the next free slot
+            uint32_t next = NO_SLOT;
+        };
+
+        struct Flow {
+            int client_id = -1;
+            uint32_t head = NO_SLOT;
+            uint32_t tail = NO_SLOT;
+            // worker time left this round in microseconds, negative after an expensive request
+            int64_t deficit = 0;
+            // inside a handler, the flow is out of the rings meanwhile
+            bool in_service = false;
+            bool in_ring = false;
+            // forgotten while frames were still queued or in service
+            bool closed = false;
+            Flow *next_in_ring = nullptr;
+        };
+
+        struct Ring {
+            Flow *head = nullptr;
+            Flow *tail = nullptr;
+        };
+
+        struct Worker {
+            explicit Worker(std::pmr::memory_resource *upstream) : arena(buffer, ARENA_SIZE, upstream) {}
+
+            alignas(std::max_align_t) char buffer[ARENA_SIZE];
+            std::pmr::monotonic_buffer_resource arena;
+            std::thread thread;
+        };
+
+        void worker_loop(Worker &worker);
+
+        uint32_t take_free_slot();
+
+        // Puts a flow with queued frames at the back of the ring its next frame belongs to
+        void schedule(Flow &flow);
+
+        // Next flow to serve, out of its ring and marked in service; nullptr when nothing is queued
+        Flow *pick_flow();
+
+        static void push_back(Ring &ring, Flow &flow);
+
+        static Flow *pop_front(Ring &ring);
+
+        Handler handler;
+        Classifier is_priority;
+        const int64_t quantum_us;
+        std::mutex queue_mutex;
+        std::condition_variable queue_not_empty;
+        std::condition_variable queue_idle;
+        std::vector<Task> slots;
+        uint32_t free_slots;
+        // node based, so the Flow pointers kept in the rings stay valid as clients come and go;
+        // a flow is erased once its client closed and nothing of it is queued or in service
+        std::unordered_map<int, Flow> flows;
+        Ring priority_ring;
+        Ring normal_ring;
+        size_t queued;
+        // handlers running
+        size_t busy;
+        bool stopping;
+        std::vector<std::unique_ptr<Worker>> workers;
+    };
+}
+
+#endif //ECHOSERVER_WORKER_POOL_H
@@ -2,6 +2,45 @@
 #define MESSAGE_SIZE 1024
 #define SERVER_PORT 7777
 
+// server side timeouts, 0 disables
+// off by default: clients may hold a connection open without traffic, as they always could
+#define CLIENT_IDLE_TIMEOUT_MS 0
+#define PARTIAL_FRAME_TIMEOUT_MS 30000
+#define WRITE_STALL_TIMEOUT_MS 10000
+
+// worker time in microseconds a client is credited per deficit round-robin round
+#define WORKER_QUANTUM_US 200
+
+// currencies the shared-memory quote table has room for
+#define QUOTE_TABLE_SLOTS 4096
+
+// request tracing: events each thread keeps before overwriting the oldest
+#define TRACE_BUFFER_EVENTS 16384
+
+// bytes queued each way on an in-process transport connection before the writer waits
+#define IN_PROCESS_RING_BYTES (256 * 1024)
+
+// multicast quote feed: default UDP port, datagrams kept for gap-fill requests and the most
+// one request gets back
+#define FEED_PORT 7780
+#define FEED_RETRANSMIT_SLOTS 65536
+#define FEED_GAP_FILL_MAX 512
+
+// SO_BUSY_POLL of client sockets in low-latency mode, microseconds
+#define BUSY_POLL_US 50
+
+// changes a primary keeps for followers that reconnect, older ones need a snapshot
+#define REPLICATION_LOG_SIZE 100000
+
+// ingest journal: fsync batching window (0 syncs every group, -1 never) and checkpoint size
+#define JOURNAL_SYNC_MS 2
+#define JOURNAL_CHECKPOINT_BYTES (4 * 1024 * 1024)
+
+// history compaction: rows per transaction, pause after a batch and between checks once caught up
+#define COMPACTION_BATCH_ROWS 256
+#define COMPACTION_PAUSE_MS 20
+#define COMPACTION_IDLE_MS 10000
+
 // message
 #define MESSAGE_END "\r\n\r\n"
 #define CMD_PREFIX "cmd:"
@@ -11,11 +50,16 @@
 #define MESSAGE_PREFIX_LEN 4
 
 // request
+#define REQUEST_DISCONNECT "disconnect"
 #define REQUEST_ADD_CURRENCY "ADD_CURRENCY"
 #define REQUEST_DEL_CURRENCY "DEL_CURRENCY"
 #define REQUEST_ADD_CURRENCY_VALUE "ADD_CURRENCY_VALUE"
 #define REQUEST_GET_ALL_CURRENCIES "GET_ALL_CURRENCIES"
 #define REQUEST_GET_CURRENCY_HISTORY "GET_CURRENCY_HISTORY"
+#define REQUEST_FEED_GAP_FILL "FEED_GAP_FILL"
+
+// optional "encoding" of a GET_CURRENCY_HISTORY reply, see protocol/history_encoding.h
+#define HISTORY_ENCODING_GORILLA "gorilla"
 
 #define ERROR_MESSAGE_SIZE (-2)
 #define RECV_ERROR (-3)
@@ -0,0 +1,122 @@
+#!/bin/bash
+# Hot upgrade of a replication primary on loopback, several server processes:
+#   ./upgrade_test.sh [build dir]
+# A primary with a follower and an ingest journal serves a client, a second primary process
+# takes it over with --takeover. The client's connection has to survive, the follower has to
+# reconnect to the new process, and changes made before and after the upgrade have to reach it
+# exactly once. Builds into build/
+# unless a build dir holding server and initdb is given. Exits non-zero on the first failure.
+set -e
+cd "$(dirname "$0")"
+if [ -n "$1" ]; then
+    bin=$1
+else
+    bin=build
+    cmake -S . -B $bin -DCMAKE_BUILD_TYPE=Release > /dev/null
+    cmake --build $bin --target server initdb > /dev/null
+fi
+bin=$(cd "$bin" && pwd)
+work=$(mktemp -d)
+port=17101
+replication_port=17102
+follower_port=17103
+pids=""
+
+cleanup() {
+    for pid in $pids; do kill $pid 2> /dev/null || true; done
+    wait 2> /dev/null || true
+    rm -rf "$work"
+}
+trap cleanup EXIT
+# a connection that died is reported by request, not by the shell getting killed
+trap '' PIPE
+
+fail() {
+    echo "FAILED: $*"
+    for log in "$work"/*.log; do echo "--- $log"; cat "$log"; done
+    exit 1
+}
+
+# a server reads console commands from stdin and stops on its end, so it gets one that stays open
+start_server() {
+    local log=$1
+    shift
+    tail -f /dev/null | "$bin/server" "$@" > "$work/$log.log" 2>&1 &
+    pids="$pids $!"
+    last_pid=$!
+}
+
+wait_for_log() {
+    for _ in $(seq 50); do
+        grep -q "$2" "$work/$1.log" 2> /dev/null && return 0
+        sleep 0.1
+    done
+    fail "$1 never logged '$2'"
+}
+
+# request fd frame: sends one frame and leaves the reply without its terminator in $reply
+request() {
+    printf '%s\r\n\r\n' "$2" >&"$1" 2> /dev/null || fail "connection lost sending $2"
+    reply=""
+    while IFS= read -r -t 5 line <&"$1"; do
+        line=${line%$'\r'}
+        [ -z "$line" ] && return 0
+        reply="$reply$line"
+    done
+    fail "no reply to $2"
+}
+
+expect_reply() {
+    request "$1" "$2"
+    case "$reply" in
+        $3*) ;;
+        *) fail "$2 got '$reply', expected $3" ;;
+    esac
+}
+
+"$bin/initdb" "$work/primary.db"
+"$bin/initdb" "$work/follower.db"
+start_server old --port $port --db "$work/primary.db" --replication-port $replication_port \
+    --journal "$work/primary.journal" --upgrade-socket "$work/upgrade.sock"
+old_pid=$last_pid
+wait_for_log old "Replication log"
+start_server follower --port $follower_port --db "$work/follower.db" --follow 127.0.0.1:$replication_port
+wait_for_log follower "snapshot"
+
+exec 3<> /dev/tcp/127.0.0.1/$port
+expect_reply 3 'jsn:{"type":"ADD_CURRENCY","currency":"USD"}' "txt:"
+expect_reply 3 'jsn:{"type":"ADD_CURRENCY_VALUE","currency":"USD","value":61.25}' "txt:"
+
+start_server new --port $port --db "$work/primary.db" --replication-port $replication_port \
+    --journal "$work/primary.journal" --upgrade-socket "$work/upgrade.sock" --takeover
+new_pid=$last_pid
+wait_for_log new "Took over 1 clients"
+wait_for_log old "Handed 1 clients over"
+for _ in $(seq 50); do
+    kill -0 $old_pid 2> /dev/null || break
+    sleep 0.1
+done
+kill -0 $old_pid 2> /dev/null && fail "old primary still running after the hand-off"
+kill -0 $new_pid 2> /dev/null || fail "new primary exited after taking over"
+grep -q "Cannot ship changes to followers" "$work/new.log" && fail "new primary lost the replication listener"
+
+# same connection, now served by the new process
+expect_reply 3 'jsn:{"type":"ADD_CURRENCY_VALUE","currency":"USD","value":62.5}' "txt:"
+exec 3>&-
+
+exec 4<> /dev/tcp/127.0.0.1/$follower_port
+for _ in $(seq 50); do
+    request 4 'jsn:{"type":"GET_CURRENCY_HISTORY","currency":"USD"}'
+    case "$reply" in
+        *61.25*62.5*) break ;;
+    esac
+    sleep 0.1
+done
+case "$reply" in
+    *61.25*62.5*) ;;
+    *) fail "follower did not catch up with the new primary: $reply" ;;
+esac
+values=$(echo "$reply" | grep -o '"value"' | wc -l)
+[ "$values" = 2 ] || fail "follower has $values values instead of 2: $reply"
+exec 4>&-
+echo "PASSED: client kept its connection, follower caught up with the new primary, no value applied twice"
@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "load.h"
+
+#define TXT_PREFIX "txt:"
+#define MESSAGE_END "\r\n\r\n"
+
+struct connection {
+    int fd;
+    size_t sent, received;
+    uint64_t started_ns;
+};
+
+struct latencies {
+    uint64_t *samples;
+    size_t count, capacity;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+/* user plus system time of a process in microseconds, -1 if unreadable */
+static double process_cpu_us(pid_t pid) {
+    char path[64], line[1024], *fields;
+    unsigned long user, system;
+    FILE *stat;
+
+    if (!pid) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1e6 +
+               usage.ru_stime.tv_usec;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    stat = fopen(path, "r");
+    if (!stat) return -1;
+    fields = fgets(line, sizeof(line), stat);
+    fclose(stat);
+    /* the command name may hold spaces, fields 14 and 15 count from after it */
+    if (!fields || !(fields = strrchr(line, ')'))) return -1;
+    if (sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2) return -1;
+    return (double) (user + system) * 1e6 / (double) sysconf(_SC_CLK_TCK);
+}
+
+static void record(struct latencies *latencies, uint64_t sample) {
+    if (latencies->count == latencies->capacity) {
+        latencies->capacity = latencies->capacity ? 2 * latencies->capacity : 65536;
+        latencies->samples = realloc(latencies->samples, latencies->capacity * sizeof(uint64_t));
+    }
+    latencies->samples[latencies->count++] = sample;
+}
+
+static int compare_samples(const void *left, const void *right) {
+    uint64_t a = *(const uint64_t *) left, b = *(const uint64_t *) right;
+    return a < b ? -1 : a > b;
+}
+
+/* Writes what is left of the request; 0, or -1 once the connection failed */
+static int send_request(struct connection *connection, const char *request, size_t size) {
+    ssize_t n;
+
+    while (connection->sent < size) {
+        n = write(connection->fd, request + connection->sent, size - connection->sent);
+        if (n < 0 && errno == EAGAIN) return 0;
+        if (n <= 0) return -1;
+        connection->sent += (size_t) n;
+    }
+    return 0;
+}
+
+static int open_connections(const struct load_options *options, struct connection *connections, int count,
+                            int epoll_fd) {
+    struct epoll_event event;
+    int i, one = 1;
+
+    for (i = 0; i < count; ++i) {
+        connections[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connections[i].fd < 0 ||
+            connect(connections[i].fd, (const struct sockaddr *) &options->address, sizeof(options->address)) < 0) {
+            perror("ERROR connecting");
+            return -1;
+        }
+        setsockopt(connections[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (fcntl(connections[i].fd, F_SETFL, fcntl(connections[i].fd, F_GETFL) | O_NONBLOCK) < 0) return -1;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.ptr = &connections[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &event) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Bytes a complete reply has, tcp-server drops the prefix when it echoes text */
+static size_t reply_size(const struct load_options *options) {
+    return options->framed ? options->size - strlen(TXT_PREFIX) : options->size;
+}
+
+static int run_once(const struct load_options *options, int count, char *request, char *reply,
+                    struct latencies *latencies) {
+    struct connection *connections = calloc((size_t) count, sizeof(struct connection));
+    struct epoll_event events[256];
+    struct connection *connection;
+    size_t expected = reply_size(options);
+    uint64_t started, deadline, elapsed, requests = 0;
+    double server_cpu, client_cpu;
+    int epoll_fd = epoll_create1(0), i, ready, status = 0;
+    ssize_t n;
+
+    latencies->count = 0;
+    if (epoll_fd < 0 || open_connections(options, connections, count, epoll_fd) < 0) status = 1;
+
+    server_cpu = options->server_pid ? process_cpu_us(options->server_pid) : 0;
+    client_cpu = process_cpu_us(0);
+    started = now_ns();
+    deadline = started + (uint64_t) options->seconds * 1000000000u;
+    for (i = 0; !status && i < count; ++i) {
+        connections[i].started_ns = now_ns();
+        if (send_request(&connections[i], request, options->size) < 0) status = 1;
+    }
+    while (!status && now_ns() < deadline) {
+        ready = epoll_wait(epoll_fd, events, 256, 100);
+        for (i = 0; i < ready && !status; ++i) {
+            connection = events[i].data.ptr;
+            n = -1;
+            if (send_request(connection, request, options->size) < 0) status = 1;
+            /* edge triggered: drain until EAGAIN */
+            while (!status && (n = read(connection->fd, reply, expected)) != 0) {
+                if (n < 0) {
+                    if (errno != EAGAIN) status = 1;
+                    break;
+                }
+                connection->received += (size_t) n;
+                if (connection->received < expected) continue;
+                /* one request in flight per connection, so the echo cannot run ahead */
+                record(latencies, now_ns() - connection->started_ns);
+                ++requests;
+                connection->sent = connection->received = 0;
+                connection->started_ns = now_ns();
+                if (send_request(connection, request, options->size) < 0) status = 1;
+            }
+            if (n == 0) status = 1;
+        }
+    }
+    elapsed = now_ns() - started;
+    if (options->server_pid) server_cpu = process_cpu_us(options->server_pid) - server_cpu;
+    client_cpu = process_cpu_us(0) - client_cpu;
+
+    for (i = 0; i < count; ++i) {
+        if (connections[i].fd > 0) close(connections[i].fd);
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    free(connections);
+    if (status) {
+        fprintf(stderr, "ERROR during the run with %d connections\n", count);
+        return status;
+    }
+    if (!latencies->count) return 0;
+
+    qsort(latencies->samples, latencies->count, sizeof(uint64_t), compare_samples);
+    printf("%-10s %6d %12.0f %10.1f %10.1f %12.2f %12.2f\n", options->label, count,
+           (double) requests * 1e9 / (double) elapsed,
+           (double) latencies->samples[latencies->count / 2] / 1e3,
+           (double) latencies->samples[(latencies->count - 1) * 99 / 100] / 1e3,
+           options->server_pid ? server_cpu / (double) requests : 0.0,
+           client_cpu / (double) requests);
+    fflush(stdout);
+    return 0;
+}
+
+int run_load(const struct load_options *options) {
+    struct latencies latencies = {NULL, 0, 0};
+    char *request = malloc(options->size), *reply = malloc(reply_size(options));
+    int i, status = 0;
+
+    memset(request, 'x', options->size);
+    if (options->framed) {
+        memcpy(request, TXT_PREFIX, strlen(TXT_PREFIX));
+        memcpy(request + options->size - strlen(MESSAGE_END), MESSAGE_END, strlen(MESSAGE_END));
+    }
+    printf("%-10s %6s %12s %10s %10s %12s %12s\n", "model", "conns", "req/s", "p50 us", "p99 us",
+           "server us/r", "client us/r");
+    for (i = 0; i < options->runs && !status; ++i) {
+        status = run_once(options, options->connections[i], request, reply, &latencies);
+    }
+    free(latencies.samples);
+    free(request);
+    free(reply);
+    return status;
+}
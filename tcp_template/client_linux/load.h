@@ -0,0 +1,30 @@
+#ifndef CLIENT_LINUX_LOAD_H
+#define CLIENT_LINUX_LOAD_H
+
+#include <netinet/in.h>
+#include <sys/types.h>
+
+struct load_options {
+    struct sockaddr_in address;
+    /* one run per entry, each with this many connections */
+    int *connections;
+    int runs;
+    /* bytes per request, the reply is the same bytes echoed */
+    size_t size;
+    /* tcp-server framing: a request is "txt:", payload and "\r\n\r\n", size
+     * bytes in all, and the reply is the payload and "\r\n\r\n" */
+    int framed;
+    int seconds;
+    /* server process whose CPU time is charged to the requests, 0 for none */
+    pid_t server_pid;
+    const char *label;
+};
+
+/* Closed loop: every connection sends a request as soon as the reply to
+ * its previous one is complete. All connections run on one epoll thread,
+ * so the client costs the same against every server model. Prints one
+ * line per run: requests per second, p50 and p99 latency, and server and
+ * client CPU microseconds per request. Returns 0, or 1 on an error. */
+int run_load(const struct load_options *options);
+
+#endif
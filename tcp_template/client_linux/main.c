@@ -7,6 +7,44 @@
 
 #include <string.h>
 
+#include "load.h"
+
+/* "1,16,64" into a new array, the number of entries in runs */
+static int *parse_connections(char *list, int *runs) {
+    int *connections = malloc((strlen(list) / 2 + 1) * sizeof(int));
+    char *entry;
+
+    *runs = 0;
+    for (entry = strtok(list, ","); entry; entry = strtok(NULL, ",")) {
+        if ((connections[*runs] = atoi(entry)) < 1) return NULL;
+        ++*runs;
+    }
+    return *runs ? connections : NULL;
+}
+
+/* The benchmark mode: hostname port --connections list [options], see load.h */
+static int bench(int argc, char *argv[], struct sockaddr_in *serv_addr) {
+    struct load_options options = {*serv_addr, NULL, 0, 64, 0, 5, 0, "echo"};
+    int i;
+
+    for (i = 3; i < argc; ++i) {
+        if (!strcmp(argv[i], "--connections") && i + 1 < argc) options.connections = parse_connections(argv[++i], &options.runs);
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc) options.size = (size_t) atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) options.seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--server-pid") && i + 1 < argc) options.server_pid = (pid_t) atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--label") && i + 1 < argc) options.label = argv[++i];
+        else if (!strcmp(argv[i], "--framed")) options.framed = 1;
+        else break;
+    }
+    /* a framed request needs room for the prefix, the terminator and a payload */
+    if (i < argc || !options.connections || options.size <= (options.framed ? 8 : 0) || options.seconds < 1) {
+        fprintf(stderr, "usage %s hostname port --connections n[,n...] [--size bytes] [--seconds s]"
+                " [--server-pid pid] [--label name] [--framed]\n", argv[0]);
+        return 1;
+    }
+    return run_load(&options);
+}
+
 int main(int argc, char *argv[]) {
     int sockfd, n;
     uint16_t portno;
@@ -16,7 +54,7 @@ int main(int argc, char *argv[]) {
     char buffer[256];
 
     if (argc < 3) {
-        fprintf(stderr, "usage %s hostname port\n", argv[0]);
+        fprintf(stderr, "usage %s hostname port [--connections n[,n...] ...]\n", argv[0]);
         exit(0);
     }
 
@@ -42,6 +80,12 @@ int main(int argc, char *argv[]) {
     bcopy(server->h_addr, (char *) &serv_addr.sin_addr.s_addr, (size_t) server->h_length);
     serv_addr.sin_port = htons(portno);
 
+    /* anything after the port runs the benchmark instead of the one message exchange */
+    if (argc > 3) {
+        close(sockfd);
+        return bench(argc, argv, &serv_addr);
+    }
+
     /* Now connect to the server */
     if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
         perror("ERROR connecting");
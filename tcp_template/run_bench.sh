@@ -0,0 +1,45 @@
+#!/bin/sh
+# Every server model under the same echo load, one row per model and connection count:
+#   ./run_bench.sh [connections] [seconds] [size]
+# e.g. ./run_bench.sh 1,16,64,256 5 64. Builds both projects and ../tcp-server into build/ first.
+# The epoll model only approximates tcp-server in C; the tcp-server row sends the same load as
+# txt: frames through the real server, its echo path included.
+set -e
+cd "$(dirname "$0")"
+connections=${1:-1,16,64,256}
+seconds=${2:-5}
+size=${3:-64}
+port=5001
+
+for project in server_linux client_linux; do
+    cmake -S $project -B build/$project -DCMAKE_BUILD_TYPE=Release > /dev/null
+    cmake --build build/$project > /dev/null
+done
+cmake -S ../tcp-server -B build/tcp-server -DCMAKE_BUILD_TYPE=Release > /dev/null
+cmake --build build/tcp-server --target server initdb > /dev/null
+
+header=1
+for model in thread epoll uring; do
+    build/server_linux/server_linux --model $model --port $port > /dev/null &
+    server=$!
+    sleep 0.5
+    build/client_linux/client_linux 127.0.0.1 $port --connections $connections --seconds $seconds \
+        --size $size --server-pid $server --label $model | if [ $header = 1 ]; then cat; else tail -n +2; fi
+    kill $server
+    wait $server 2> /dev/null || true
+    header=0
+done
+
+# tcp-server reads console commands from stdin and stops when it closes, a fifo holds it open
+work=$(mktemp -d)
+build/tcp-server/initdb "$work/bench.db" > /dev/null
+mkfifo "$work/console"
+build/tcp-server/server --port $port --db "$work/bench.db" < "$work/console" > /dev/null 2>&1 &
+server=$!
+exec 9> "$work/console"
+sleep 0.5
+build/client_linux/client_linux 127.0.0.1 $port --connections $connections --seconds $seconds \
+    --size $size --server-pid $server --label tcp-server --framed | tail -n +2
+exec 9>&-
+wait $server 2> /dev/null || true
+rm -rf "$work"
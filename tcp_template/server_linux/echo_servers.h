@@ -0,0 +1,26 @@
+#ifndef SERVER_LINUX_ECHO_SERVERS_H
+#define SERVER_LINUX_ECHO_SERVERS_H
+
+/* Every model echoes whatever a connection sends until it closes, so the
+ * client can drive all of them with the same workload. Each one takes over
+ * the listening socket and only returns on a fatal error. */
+
+#define ECHO_BUFFER_SIZE 16384
+
+/* One thread per accepted connection, blocking read and write */
+void serve_threads(int listener);
+
+/* One epoll thread reading, a pool of workers writing the replies back; a
+ * connection is re-armed once its reply is out. Only an approximation of
+ * tcp-server: no framing, no per-client queues, no deficit round-robin.
+ * run_bench.sh measures the real server as its own row */
+void serve_epoll(int listener, int workers);
+
+/* One thread submitting accept, recv and send to an io_uring and reaping
+ * the completions, without liburing */
+void serve_uring(int listener, unsigned entries);
+
+/* TCP_NODELAY on an accepted connection, every model sets it */
+void set_nodelay(int fd);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "echo_servers.h"
+
+/* Bytes one read returned, for a worker to send back */
+struct task {
+    int fd;
+    ssize_t length;
+    struct task *next;
+    char data[];
+};
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static struct task *queue_head, *queue_tail;
+static int epoll_fd;
+
+static void push_task(struct task *task) {
+    task->next = NULL;
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_tail) queue_tail->next = task;
+    else queue_head = task;
+    queue_tail = task;
+    pthread_mutex_unlock(&queue_mutex);
+    pthread_cond_signal(&queue_ready);
+}
+
+static struct task *pop_task(void) {
+    struct task *task;
+
+    pthread_mutex_lock(&queue_mutex);
+    while (!queue_head) pthread_cond_wait(&queue_ready, &queue_mutex);
+    task = queue_head;
+    queue_head = task->next;
+    if (!queue_head) queue_tail = NULL;
+    pthread_mutex_unlock(&queue_mutex);
+    return task;
+}
+
+/* EPOLLONESHOT keeps a connection out of epoll while its reply is queued,
+ * so two workers never write to it at once and replies stay in order */
+static void arm(int fd, int operation) {
+    struct epoll_event event;
+
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, operation, fd, &event) < 0) {
+        perror("ERROR arming connection");
+        close(fd);
+    }
+}
+
+static void *worker(void *argument) {
+    struct task *task;
+    ssize_t sent, written;
+
+    (void) argument;
+    for (;;) {
+        task = pop_task();
+        for (sent = 0; sent < task->length; sent += written) {
+            written = write(task->fd, task->data + sent, (size_t) (task->length - sent));
+            if (written <= 0) break;
+        }
+        if (sent < task->length) close(task->fd);
+        else arm(task->fd, EPOLL_CTL_MOD);
+        free(task);
+    }
+    return NULL;
+}
+
+void serve_epoll(int listener, int workers) {
+    struct epoll_event events[256];
+    struct task *task;
+    pthread_t thread;
+    int i, count, fd;
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("ERROR creating epoll");
+        exit(1);
+    }
+    for (i = 0; i < workers; ++i) {
+        if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+            perror("ERROR creating worker");
+            exit(1);
+        }
+    }
+    events[0].events = EPOLLIN;
+    events[0].data.fd = listener;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &events[0]);
+
+    for (;;) {
+        count = epoll_wait(epoll_fd, events, 256, -1);
+        for (i = 0; i < count; ++i) {
+            fd = events[i].data.fd;
+            if (fd == listener) {
+                fd = accept(listener, NULL, NULL);
+                if (fd < 0) {
+                    perror("ERROR on accept");
+                    continue;
+                }
+                set_nodelay(fd);
+                arm(fd, EPOLL_CTL_ADD);
+                continue;
+            }
+            /* the reading happens here, as in tcp-server, only the reply goes to the pool */
+            task = malloc(sizeof(struct task) + ECHO_BUFFER_SIZE);
+            task->fd = fd;
+            task->length = read(fd, task->data, ECHO_BUFFER_SIZE);
+            if (task->length <= 0) {
+                close(fd);
+                free(task);
+                continue;
+            }
+            push_task(task);
+        }
+    }
+}
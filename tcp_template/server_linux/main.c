@@ -3,17 +3,37 @@
 
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 
 #include <string.h>
 
+#include "echo_servers.h"
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage %s [--model thread|epoll|uring] [--port port] [--workers n]\n", name);
+    exit(1);
+}
+
+void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
 int main(int argc, char *argv[]) {
-    int sockfd, newsockfd;
-    uint16_t portno;
-    unsigned int clilen;
-    char buffer[256];
-    struct sockaddr_in serv_addr, cli_addr;
-    ssize_t n;
+    int sockfd, one = 1, workers = 4, i;
+    uint16_t portno = 5001;
+    const char *model = "thread";
+    struct sockaddr_in serv_addr;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--model") && i + 1 < argc) model = argv[++i];
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc) portno = (uint16_t) atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--workers") && i + 1 < argc) workers = atoi(argv[++i]);
+        else usage(argv[0]);
+    }
+    if (strcmp(model, "thread") && strcmp(model, "epoll") && strcmp(model, "uring")) usage(argv[0]);
+    if (workers < 1) usage(argv[0]);
 
     /* First call to socket() function */
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -23,9 +43,11 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    /* a benchmark restarts the server on the same port right away */
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
     /* Initialize socket structure */
     bzero((char *) &serv_addr, sizeof(serv_addr));
-    portno = 5001;
 
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = INADDR_ANY;
@@ -37,39 +59,14 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    /* Now start listening for the clients, here process will
-       * go in sleep mode and will wait for the incoming connection
-    */
-
-    listen(sockfd, 5);
-    clilen = sizeof(cli_addr);
-
-    /* Accept actual connection from the client */
-    newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-
-    if (newsockfd < 0) {
-        perror("ERROR on accept");
-        exit(1);
-    }
-
-    /* If connection is established then start communicating */
-    bzero(buffer, 256);
-    n = read(newsockfd, buffer, 255); // recv on Windows
-
-    if (n < 0) {
-        perror("ERROR reading from socket");
-        exit(1);
-    }
-
-    printf("Here is the message: %s\n", buffer);
-
-    /* Write a response to the client */
-    n = write(newsockfd, "I got your message", 18); // send on Windows
+    /* the client opens hundreds of connections at once */
+    listen(sockfd, SOMAXCONN);
+    printf("Serving echo with model %s on port %d\n", model, portno);
+    fflush(stdout);
 
-    if (n < 0) {
-        perror("ERROR writing to socket");
-        exit(1);
-    }
+    if (!strcmp(model, "thread")) serve_threads(sockfd);
+    else if (!strcmp(model, "epoll")) serve_epoll(sockfd, workers);
+    else serve_uring(sockfd, 4096);
 
-    return 0;
+    return 1;
 }
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "echo_servers.h"
+
+static void *serve_connection(void *argument) {
+    int fd = (int) (intptr_t) argument;
+    char buffer[ECHO_BUFFER_SIZE];
+    ssize_t n, sent, written;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (sent = 0; sent < n; sent += written) {
+            written = write(fd, buffer + sent, (size_t) (n - sent));
+            if (written <= 0) break;
+        }
+        if (sent < n) break;
+    }
+    close(fd);
+    return NULL;
+}
+
+void serve_threads(int listener) {
+    pthread_attr_t attributes;
+    pthread_t thread;
+    int fd;
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    /* the buffer is the only thing on the stack, the default 8 MiB would only cost address space */
+    pthread_attr_setstacksize(&attributes, 4 * ECHO_BUFFER_SIZE);
+
+    for (;;) {
+        fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            perror("ERROR on accept");
+            continue;
+        }
+        set_nodelay(fd);
+        if (pthread_create(&thread, &attributes, serve_connection, (void *) (intptr_t) fd) != 0) {
+            perror("ERROR creating connection thread");
+            close(fd);
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "echo_servers.h"
+
+/* The parts of the mapped rings this server touches, see io_uring_setup(2) */
+struct ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries, to_submit;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+/* A connection has exactly one recv or send in flight, its user_data is the
+ * connection itself; the pending accept has user_data 0 */
+struct connection {
+    int fd;
+    int sending;
+    size_t length, sent;
+    char buffer[ECHO_BUFFER_SIZE];
+};
+
+static void *map_ring(int fd, size_t size, off_t offset) {
+    void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+    if (mapped == MAP_FAILED) {
+        perror("ERROR mapping io_uring");
+        exit(1);
+    }
+    return mapped;
+}
+
+static void setup_ring(struct ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq, *cq;
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        perror("ERROR creating io_uring");
+        exit(1);
+    }
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        sq = map_ring(ring->fd, sq_size, IORING_OFF_SQ_RING);
+        cq = sq;
+    } else {
+        sq = map_ring(ring->fd, sq_size, IORING_OFF_SQ_RING);
+        cq = map_ring(ring->fd, cq_size, IORING_OFF_CQ_RING);
+    }
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    ring->sqes = map_ring(ring->fd, params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES);
+    ring->to_submit = 0;
+}
+
+/* Submits what is queued and, with wait set, blocks for at least one completion */
+static void enter(struct ring *ring, int wait) {
+    int submitted;
+
+    do {
+        submitted = (int) syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait ? 1 : 0,
+                                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted < 0) {
+        perror("ERROR entering io_uring");
+        exit(1);
+    }
+    ring->to_submit -= (unsigned) submitted;
+}
+
+static struct io_uring_sqe *next_sqe(struct ring *ring) {
+    unsigned tail = *ring->sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    /* the kernel consumes everything on enter, a full ring only needs a submit */
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries) enter(ring, 0);
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+static void queue_sqe(struct ring *ring) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+}
+
+static void queue_accept(struct ring *ring, int listener) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->user_data = 0;
+    queue_sqe(ring);
+}
+
+static void queue_transfer(struct ring *ring, struct connection *connection) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+
+    sqe->fd = connection->fd;
+    sqe->user_data = (uint64_t) (uintptr_t) connection;
+    if (connection->sending) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = (uint64_t) (uintptr_t) (connection->buffer + connection->sent);
+        sqe->len = (unsigned) (connection->length - connection->sent);
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = (uint64_t) (uintptr_t) connection->buffer;
+        sqe->len = ECHO_BUFFER_SIZE;
+    }
+    queue_sqe(ring);
+}
+
+static void complete(struct ring *ring, int listener, uint64_t user_data, int result) {
+    struct connection *connection = (struct connection *) (uintptr_t) user_data;
+
+    if (!connection) {
+        queue_accept(ring, listener);
+        if (result < 0) return;
+        connection = malloc(sizeof(struct connection));
+        connection->fd = result;
+        connection->sending = 0;
+        set_nodelay(result);
+        queue_transfer(ring, connection);
+        return;
+    }
+    if (result <= 0) {
+        close(connection->fd);
+        free(connection);
+        return;
+    }
+    if (!connection->sending) {
+        connection->sending = 1;
+        connection->length = (size_t) result;
+        connection->sent = 0;
+    } else if ((connection->sent += (size_t) result) == connection->length) {
+        connection->sending = 0;
+    }
+    queue_transfer(ring, connection);
+}
+
+void serve_uring(int listener, unsigned entries) {
+    struct ring ring;
+    struct io_uring_cqe *cqe;
+    unsigned head;
+
+    setup_ring(&ring, entries);
+    queue_accept(&ring, listener);
+    for (;;) {
+        enter(&ring, 1);
+        head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            complete(&ring, listener, cqe->user_data, cqe->res);
+            ++head;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+}